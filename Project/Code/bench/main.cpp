@@ -0,0 +1,776 @@
+#include "BIGFile.h"
+#include "FileAccess.h"
+#include "FileFinder.h"
+#include "FileSystem.h"
+#include "Stats.h"
+#include "commandline.h"
+#include "timer.h"
+#include "utils.h"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if _MSC_VER
+#pragma comment(lib, "Shlwapi.lib")
+#pragma comment(lib, "Psapi.lib")
+#endif
+
+#define COMMANDLINE_ARG_HELP         "-help"
+#define COMMANDLINE_ARG_ENTRIES      "-entries"
+#define COMMANDLINE_ARG_DISTRIBUTION "-distribution"
+#define COMMANDLINE_ARG_DUPLICATES   "-duplicates"
+#define COMMANDLINE_ARG_MAXBYTES     "-maxbytes"
+#define COMMANDLINE_ARG_SEED         "-seed"
+#define COMMANDLINE_ARG_DEPTH        "-depth"
+#define COMMANDLINE_ARG_WORKDIR      "-workdir"
+#define COMMANDLINE_ARG_OUTPUT       "-output"
+
+
+namespace
+{
+	int Error = 1;
+	int NoError = 0;
+}
+
+enum EDistribution
+{
+	eDistribution_Ini = 0, // Many tiny INI files
+	eDistribution_Mixed,   // Mostly tiny INI files, some models and few huge textures
+	eDistribution_Texture, // Only large textures
+};
+
+struct SOptions
+{
+	SOptions()
+		: entries(1000)
+		, distribution(eDistribution_Mixed)
+		, duplicates(0.0)
+		, maxBytes(1024ull * 1024ull * 1024ull)
+		, seed(1)
+		, depth(0)
+		, wcsWorkdir(L"bigbench")
+		, wcsOutput(0)
+	{}
+
+	uint32 entries;
+	EDistribution distribution;
+	double duplicates;
+	uint64 maxBytes;
+	uint32 seed;
+	uint32 depth;
+	const wchar_t* wcsWorkdir;
+	const wchar_t* wcsOutput;
+};
+
+struct SResult
+{
+	SResult(const char* szName, double seconds, uint64 items, uint64 bytes, uint64 allocations = 0, uint64 allocationBytes = 0)
+		: name(szName)
+		, seconds(seconds)
+		, items(items)
+		, bytes(bytes)
+		, allocations(allocations)
+		, allocationBytes(allocationBytes)
+	{}
+
+	std::string name;
+	double seconds;
+	uint64 items;
+	uint64 bytes;
+	uint64 allocations;
+	uint64 allocationBytes;
+};
+
+// Sums up heap allocations made between each Start and Stop
+class CAllocationCounter
+{
+public:
+	CAllocationCounter()
+		: m_allocations(0)
+		, m_allocationBytes(0)
+		, m_startAllocations(0)
+		, m_startAllocationBytes(0)
+	{}
+
+	void Start()
+	{
+		m_startAllocations = stats::GetCount(stats::eCounter_Allocation);
+		m_startAllocationBytes = stats::GetCount(stats::eCounter_AllocationBytes);
+	}
+
+	void Stop()
+	{
+		m_allocations += stats::GetCount(stats::eCounter_Allocation) - m_startAllocations;
+		m_allocationBytes += stats::GetCount(stats::eCounter_AllocationBytes) - m_startAllocationBytes;
+	}
+
+	uint64 GetAllocations() const { return m_allocations; }
+	uint64 GetAllocationBytes() const { return m_allocationBytes; }
+
+private:
+	uint64 m_allocations;
+	uint64 m_allocationBytes;
+	uint64 m_startAllocations;
+	uint64 m_startAllocationBytes;
+};
+
+typedef std::vector<SResult> TResults;
+typedef std::vector<std::string> TStrings;
+typedef std::vector<std::wstring> TWStrings;
+
+
+class CRandom
+{
+public:
+	explicit CRandom(uint32 seed)
+		: m_state(seed ? seed : 1)
+	{}
+
+	uint32 Next()
+	{
+		// Xorshift keeps the generated data independent of the C runtime
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+
+	uint32 Range(uint32 min, uint32 max)
+	{
+		return min + Next() % (max - min + 1);
+	}
+
+private:
+	uint32 m_state;
+};
+
+
+const char* GetDistributionName(EDistribution distribution)
+{
+	switch (distribution)
+	{
+	case eDistribution_Ini:     return "ini";
+	case eDistribution_Mixed:   return "mixed";
+	case eDistribution_Texture: return "texture";
+	default:                    return "unknown";
+	}
+}
+
+bool ParseDistribution(EDistribution& distribution, const wchar_t* wcsDistribution)
+{
+	for (int i = eDistribution_Ini; i <= eDistribution_Texture; ++i)
+	{
+		std::wstring name;
+		const char* szName = GetDistributionName(static_cast<EDistribution>(i));
+		name.assign(szName, szName + ::strlen(szName));
+
+		if (name == wcsDistribution)
+		{
+			distribution = static_cast<EDistribution>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void GetSyntheticFile(std::wstring& subdir, std::wstring& fileName, uint32& size, CRandom& random, EDistribution distribution, uint32 depth, uint32 index)
+{
+	enum EKind { eKind_Ini, eKind_Model, eKind_Texture };
+	EKind kind = eKind_Ini;
+
+	switch (distribution)
+	{
+	case eDistribution_Ini:
+		kind = eKind_Ini;
+		break;
+	case eDistribution_Mixed:
+		{
+			const uint32 roll = random.Range(0, 999);
+			kind = (roll < 950) ? eKind_Ini : (roll < 999) ? eKind_Model : eKind_Texture;
+		}
+		break;
+	case eDistribution_Texture:
+		kind = eKind_Texture;
+		break;
+	}
+
+	// Spread files over directories like the game data does
+	const uint32 filesPerDirectory = 256;
+	std::wostringstream stream;
+
+	switch (kind)
+	{
+	case eKind_Ini:
+		size = random.Range(100, 4 * 1024);
+		stream << L"Data\\INI\\Object" << (index / filesPerDirectory) << L"\\";
+		subdir = stream.str();
+		stream.str(L"");
+		stream << L"Object" << index << L".ini";
+		break;
+	case eKind_Model:
+		size = random.Range(16 * 1024, 256 * 1024);
+		stream << L"Art\\W3D\\Set" << (index / filesPerDirectory) << L"\\";
+		subdir = stream.str();
+		stream.str(L"");
+		stream << L"Model" << index << L".w3d";
+		break;
+	case eKind_Texture:
+		size = random.Range(256 * 1024, 8 * 1024 * 1024);
+		stream << L"Art\\Textures\\Set" << (index / filesPerDirectory) << L"\\";
+		subdir = stream.str();
+		stream.str(L"");
+		stream << L"Texture" << index << L".dds";
+		break;
+	}
+	fileName = stream.str();
+
+	// Nest files deeper to stress path handling
+	stream.str(L"");
+	for (uint32 level = 0; level < depth; ++level)
+		stream << L"Level" << level << L"\\";
+	subdir.append(stream.str());
+	std::replace(subdir.begin(), subdir.end(), L'\\', filesystem::PathSeparator);
+}
+
+bool CreateDirectories(const std::wstring& path, std::set<std::wstring>& createdDirectories)
+{
+	// Creates all directories of a path that ends with a separator
+	std::wstring directory;
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		if (path[i] == L'\\' || path[i] == L'/')
+		{
+			directory.assign(path, 0, i);
+			if (!directory.empty() && createdDirectories.insert(directory).second)
+			{
+				// Directory may exist already from a previous run
+				filesystem::MakeDirectory(directory.c_str());
+			}
+		}
+	}
+	return !directory.empty() && fileaccess::FileExists(directory.c_str());
+}
+
+bool GenerateSourceTree(const SOptions& options, const std::wstring& rootdir, uint64& totalBytes)
+{
+	CRandom random(options.seed);
+	std::set<std::wstring> createdDirectories;
+	fileaccess::TVectorData data;
+	std::wstring subdir;
+	std::wstring fileName;
+	std::wstring path;
+	totalBytes = 0;
+
+	for (uint32 index = 0; index < options.entries; ++index)
+	{
+		uint32 size = 0;
+		GetSyntheticFile(subdir, fileName, size, random, options.distribution, options.depth, index);
+
+		// Keep total size below the limit, because .big files cannot exceed 4 GB
+		if (totalBytes + size > options.maxBytes)
+			size = random.Range(1, 1024);
+
+		path.assign(rootdir).append(subdir);
+		if (!CreateDirectories(path, createdDirectories))
+		{
+			std::wcerr << "Error: '" << path << "' cannot be created" << std::endl;
+			return false;
+		}
+
+		data.resize(size);
+		for (uint32 i = 0; i < size; ++i)
+			data[i] = static_cast<char>(random.Next());
+
+		path.append(fileName);
+		if (fileaccess::WriteDataToFile(path.c_str(), data) != fileaccess::eError_Success)
+		{
+			std::wcerr << "Error: '" << path << "' cannot be written" << std::endl;
+			return false;
+		}
+		totalBytes += size;
+	}
+	return true;
+}
+
+uint64 GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+#else
+	struct rusage usage;
+	if (::getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		// Linux reports kilobytes
+		return static_cast<uint64>(usage.ru_maxrss) * 1024ull;
+	}
+#endif
+	return 0;
+}
+
+bool CheckSharedFileData(const std::wstring& bigFileName)
+{
+	// Adding a file and reading its pending data must share the file data. A copy shows
+	// up as an allocation of at least the data size, once the buffer pool holds no blocks.
+	const size_t dataSize = 1024 * 1024;
+	CBIGFile::TDataPtr dataPtr = new CBIGFile::SDataRef();
+	dataPtr->data.resize(dataSize);
+
+	CBIGFile bigFile;
+	if (!bigFile.OpenFile(bigFileName.c_str(), CBIGFile::eFlags_Write))
+	{
+		std::wcerr << "Error: '" << bigFileName << "' cannot be opened" << std::endl;
+		return false;
+	}
+	CBufferPool::GetInstance().Trim();
+
+	CAllocationCounter addAllocations;
+	addAllocations.Start();
+	const bool added = bigFile.AddNewFile("check.bin", dataPtr);
+	addAllocations.Stop();
+
+	if (!added || addAllocations.GetAllocationBytes() >= dataSize)
+	{
+		std::cerr << "Error: CBIGFile::AddNewFile copies file data" << std::endl;
+		return false;
+	}
+
+	CBIGFile::TConstDataPtr readDataPtr;
+	CAllocationCounter readAllocations;
+	readAllocations.Start();
+	const bool read = bigFile.ReadFileDataById(0, readDataPtr);
+	readAllocations.Stop();
+
+	if (!read || readDataPtr.get() != dataPtr.get() || readAllocations.GetAllocationBytes() >= dataSize)
+	{
+		std::cerr << "Error: CBIGFile::ReadFileDataById copies pending file data" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CheckEntryReader(const std::wstring& bigFileName)
+{
+	// Reads of file data on disk go through a buffer. Reads that start in the buffer and end
+	// past it, and seeks to either side of its bounds, must still return the file data.
+	const uint32 bufferSize = CBIGFile::CEntryReader::DefaultBufferSize;
+	const uint32 dataSize = 3 * bufferSize + 123;
+	CBIGFile::TData data;
+	data.resize(dataSize);
+	for (uint32 i = 0; i < dataSize; ++i)
+		data[i] = static_cast<char>(i % 251);
+
+	filesystem::RemoveFile(bigFileName.c_str());
+	CBIGFile bigFile;
+	if (!bigFile.OpenFile(bigFileName.c_str(), CBIGFile::eFlags_Write) || !bigFile.AddNewFile("check.bin", data) || !bigFile.WriteOutPendingFileChanges())
+	{
+		std::wcerr << "Error: '" << bigFileName << "' cannot be written" << std::endl;
+		return false;
+	}
+
+	struct SRead
+	{
+		uint32 position;
+		uint32 size;
+	};
+	const SRead reads[] =
+	{
+		{ 0, 16 },                              // Fills the buffer
+		{ bufferSize - 8, 16 },                 // Starts in the buffer and ends past it
+		{ bufferSize - 8, 16 },                 // Starts before the refilled buffer
+		{ bufferSize + 8, 8 },                  // Within the refilled buffer
+		{ 2 * bufferSize + 8 - 1, 1 },          // Last byte of the refilled buffer
+		{ 2 * bufferSize + 8 - 4, bufferSize }, // Large read past the buffer
+		{ 100, 2 * bufferSize },                // Large read from before the buffer
+		{ dataSize - 10, 100 },                 // Ends at the end of the file
+		{ dataSize, 1 },                        // Nothing at the end of the file
+	};
+
+	CBIGFile::TEntryReaderPtr entryReaderPtr = bigFile.OpenEntryReader(0);
+	bool success = entryReaderPtr.get() != NULL;
+	CBIGFile::TData readData;
+
+	for (size_t readIndex = 0; success && readIndex < sizeof(reads) / sizeof(reads[0]); ++readIndex)
+	{
+		const SRead& read = reads[readIndex];
+		const size_t expectedSize = std::min(read.size, dataSize - read.position);
+		readData.resize(read.size);
+
+		success = entryReaderPtr->Seek(read.position)
+			&& entryReaderPtr->Read(&readData[0], read.size) == expectedSize
+			&& std::equal(readData.data(), readData.data() + expectedSize, data.data() + read.position)
+			&& entryReaderPtr->GetPosition() == read.position + expectedSize;
+	}
+
+	success = success && !entryReaderPtr->Seek(dataSize + 1) && !entryReaderPtr->HasReadError();
+	entryReaderPtr.reset();
+	bigFile.CloseFile();
+	filesystem::RemoveFile(bigFileName.c_str());
+
+	if (!success)
+	{
+		std::cerr << "Error: CBIGFile::CEntryReader reads wrong data across its buffer" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool RunBenchmarks(const SOptions& options, TResults& results)
+{
+	std::wostringstream stream;
+	const wchar_t separator = filesystem::PathSeparator;
+	stream << options.wcsWorkdir << separator << L"tree_" << GetDistributionName(options.distribution) << L"_" << options.entries << L"_" << options.seed << L"_" << options.depth << separator;
+	const std::wstring rootdir = stream.str();
+	const std::wstring bigFileName = std::wstring(options.wcsWorkdir) + separator + L"bench.big";
+
+	if (!CheckSharedFileData(bigFileName))
+		return false;
+
+	if (!CheckEntryReader(std::wstring(options.wcsWorkdir) + separator + L"check.big"))
+		return false;
+
+	uint64 totalBytes = 0;
+	timer::CTimer timer;
+	if (!GenerateSourceTree(options, rootdir, totalBytes))
+		return false;
+	results.push_back(SResult("GenerateSourceTree", timer.GetElapsedSeconds(), options.entries, totalBytes));
+
+	CFileFinder fileFinder;
+	CAllocationCounter findAllocations;
+	timer.Restart();
+	findAllocations.Start();
+	if (!fileFinder.Initialize(rootdir.c_str(), L"*.*", 999, CBIGFile::eFlags_None))
+		return false;
+	findAllocations.Stop();
+	results.push_back(SResult("CFileFinder::Initialize", timer.GetElapsedSeconds(), fileFinder.GetFileCount(), 0, findAllocations.GetAllocations(), findAllocations.GetAllocationBytes()));
+
+	CBIGFile bigFile;
+	if (!bigFile.OpenFile(bigFileName.c_str(), CBIGFile::eFlags_Write))
+	{
+		std::wcerr << "Error: '" << bigFileName << "' cannot be opened" << std::endl;
+		return false;
+	}
+	bigFile.SetCurrentFileId(~0u);
+
+	TStrings names;
+	TWStrings paths;
+	names.reserve(fileFinder.GetFileCount());
+	paths.reserve(fileFinder.GetFileCount());
+
+	uint64 readTicks = 0;
+	uint64 addTicks = 0;
+	uint64 addedBytes = 0;
+	uint32 addedFiles = 0;
+	CAllocationCounter readAllocations;
+	CAllocationCounter addAllocations;
+	CBIGFile::TConstDataPtr dataPtr;
+
+	// File data is shared from read to write out, so adding files should not allocate file data
+	for (const char* szFileName = fileFinder.GetFirstFileName(); szFileName && *szFileName; szFileName = fileFinder.GetNextFileName())
+	{
+		timer.Restart();
+		readAllocations.Start();
+		if (fileFinder.ReadDataFromCurrentFile(dataPtr) != fileaccess::eError_Success)
+			return false;
+		readAllocations.Stop();
+		readTicks += timer.GetElapsedTicks();
+
+		timer.Restart();
+		addAllocations.Start();
+		if (!bigFile.AddNewFile(szFileName, dataPtr))
+			return false;
+		addAllocations.Stop();
+		addTicks += timer.GetElapsedTicks();
+
+		names.push_back(szFileName);
+		paths.push_back(std::wstring());
+		fileFinder.GetCurrentFileDescription()->GetPath(paths.back());
+		addedBytes += dataPtr->data.size();
+		++addedFiles;
+	}
+
+	// Duplicates are added behind the originals, which is where the game looks for them
+	CRandom random(options.seed + 1);
+	const uint32 duplicateCount = static_cast<uint32>(options.duplicates * names.size());
+
+	for (uint32 i = 0; i < duplicateCount && !names.empty(); ++i)
+	{
+		const uint32 index = random.Range(0, static_cast<uint32>(names.size()) - 1);
+
+		timer.Restart();
+		readAllocations.Start();
+		CBIGFile::TDataPtr newDataPtr = new CBIGFile::SDataRef();
+		if (fileaccess::ReadDataFromFile(paths[index].c_str(), newDataPtr->data) != fileaccess::eError_Success)
+			return false;
+		dataPtr = newDataPtr;
+		readAllocations.Stop();
+		readTicks += timer.GetElapsedTicks();
+
+		timer.Restart();
+		addAllocations.Start();
+		if (!bigFile.AddNewFile(names[index].c_str(), dataPtr))
+			return false;
+		addAllocations.Stop();
+		addTicks += timer.GetElapsedTicks();
+
+		addedBytes += dataPtr->data.size();
+		++addedFiles;
+	}
+	dataPtr.reset();
+
+	results.push_back(SResult("fileaccess::ReadDataFromFile", timer::TicksToSeconds(readTicks), addedFiles, addedBytes, readAllocations.GetAllocations(), readAllocations.GetAllocationBytes()));
+	results.push_back(SResult("CBIGFile::AddNewFile", timer::TicksToSeconds(addTicks), addedFiles, addedBytes, addAllocations.GetAllocations(), addAllocations.GetAllocationBytes()));
+
+	CAllocationCounter writeOutAllocations;
+	timer.Restart();
+	writeOutAllocations.Start();
+	if (!bigFile.WriteOutPendingFileChanges())
+	{
+		std::wcerr << "Error: '" << bigFileName << "' write out failed" << std::endl;
+		return false;
+	}
+	writeOutAllocations.Stop();
+	results.push_back(SResult("CBIGFile::WriteOutPendingFileChanges", timer.GetElapsedSeconds(), addedFiles, addedBytes, writeOutAllocations.GetAllocations(), writeOutAllocations.GetAllocationBytes()));
+
+	bigFile.CloseFile();
+
+	// Narrowing of all full source paths, which is done for every path component during search
+	const uint32 pathCount = static_cast<uint32>(paths.size());
+	uint64 narrowBytes = 0;
+	std::string narrowPath;
+	timer.Restart();
+	for (uint32 index = 0; index < pathCount; ++index)
+	{
+		narrowPath.clear();
+		if (!utils::AppendWideString(narrowPath, paths[index].c_str()))
+			return false;
+		narrowBytes += narrowPath.size();
+	}
+	results.push_back(SResult("utils::AppendWideString", timer.GetElapsedSeconds(), pathCount, narrowBytes));
+
+	// Compares reads into a new heap vector per file with reads into a new pooled buffer per file
+	uint64 vectorBytes = 0;
+	CAllocationCounter vectorAllocations;
+	timer.Restart();
+	vectorAllocations.Start();
+	for (uint32 index = 0; index < pathCount; ++index)
+	{
+		fileaccess::TVectorData vectorData;
+		if (fileaccess::ReadDataFromFile(paths[index].c_str(), vectorData) != fileaccess::eError_Success)
+			return false;
+		vectorBytes += vectorData.size();
+	}
+	vectorAllocations.Stop();
+	results.push_back(SResult("fileaccess::ReadDataFromFile(TVectorData)", timer.GetElapsedSeconds(), pathCount, vectorBytes, vectorAllocations.GetAllocations(), vectorAllocations.GetAllocationBytes()));
+
+	uint64 bufferBytes = 0;
+	CAllocationCounter bufferAllocations;
+	timer.Restart();
+	bufferAllocations.Start();
+	for (uint32 index = 0; index < pathCount; ++index)
+	{
+		fileaccess::TBufferData bufferData;
+		if (fileaccess::ReadDataFromFile(paths[index].c_str(), bufferData) != fileaccess::eError_Success)
+			return false;
+		bufferBytes += bufferData.size();
+	}
+	bufferAllocations.Stop();
+	results.push_back(SResult("fileaccess::ReadDataFromFile(TBufferData)", timer.GetElapsedSeconds(), pathCount, bufferBytes, bufferAllocations.GetAllocations(), bufferAllocations.GetAllocationBytes()));
+
+	fileFinder.Clean();
+	utils::ClearMemory(names);
+	utils::ClearMemory(paths);
+
+	const CBIGFile::TFlags readFlags = CBIGFile::eFlags_Read | CBIGFile::eFlags_UseSimplifiedName | CBIGFile::eFlags_IgnoreDuplicates;
+	timer.Restart();
+	if (!bigFile.OpenFile(bigFileName.c_str(), readFlags))
+	{
+		std::wcerr << "Error: '" << bigFileName << "' cannot be opened" << std::endl;
+		return false;
+	}
+	results.push_back(SResult("CBIGFile::OpenFile", timer.GetElapsedSeconds(), addedFiles, 0));
+
+	uint32 nameCount = 0;
+	uint64 nameBytes = 0;
+	timer.Restart();
+	for (const char* szFileName = bigFile.GetFirstFileName(); szFileName; szFileName = bigFile.GetNextFileName())
+	{
+		nameBytes += ::strlen(szFileName);
+		++nameCount;
+	}
+	results.push_back(SResult("CBIGFile::GetNextFileName", timer.GetElapsedSeconds(), nameCount, nameBytes));
+
+	const uint32 fileCount = bigFile.GetFileCount();
+	uint64 readBytes = 0;
+	CAllocationCounter bigReadAllocations;
+	timer.Restart();
+	bigReadAllocations.Start();
+	for (uint32 fileId = 0; fileId < fileCount; ++fileId)
+	{
+		if (!bigFile.ReadFileDataById(fileId, dataPtr))
+			return false;
+		readBytes += dataPtr->data.size();
+	}
+	bigReadAllocations.Stop();
+	dataPtr.reset();
+	results.push_back(SResult("CBIGFile::ReadFileDataById", timer.GetElapsedSeconds(), fileCount, readBytes, bigReadAllocations.GetAllocations(), bigReadAllocations.GetAllocationBytes()));
+
+	// Reads only the start of each file, as when telling file types apart by their headers
+	char fileStart[16];
+	uint64 startBytes = 0;
+	CAllocationCounter readerAllocations;
+	timer.Restart();
+	readerAllocations.Start();
+	for (uint32 fileId = 0; fileId < fileCount; ++fileId)
+	{
+		CBIGFile::TEntryReaderPtr entryReaderPtr = bigFile.OpenEntryReader(fileId);
+		if (!entryReaderPtr.get())
+			return false;
+		startBytes += entryReaderPtr->Read(fileStart, sizeof(fileStart));
+		if (entryReaderPtr->HasReadError())
+			return false;
+	}
+	readerAllocations.Stop();
+	results.push_back(SResult("CBIGFile::OpenEntryReader", timer.GetElapsedSeconds(), fileCount, startBytes, readerAllocations.GetAllocations(), readerAllocations.GetAllocationBytes()));
+
+	bigFile.CloseFile();
+	return true;
+}
+
+void WriteJsonString(std::ostream& stream, const std::string& str)
+{
+	stream << '"';
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		const char c = str[i];
+		if (c == '"' || c == '\\')
+			stream << '\\';
+		stream << c;
+	}
+	stream << '"';
+}
+
+void WriteJsonReport(std::ostream& stream, const SOptions& options, const TResults& results)
+{
+	const size_t resultCount = results.size();
+
+	stream << "{" << std::endl;
+	stream << "  \"config\": {" << std::endl;
+	stream << "    \"entries\": " << options.entries << "," << std::endl;
+	stream << "    \"distribution\": \"" << GetDistributionName(options.distribution) << "\"," << std::endl;
+	stream << "    \"duplicates\": " << options.duplicates << "," << std::endl;
+	stream << "    \"maxbytes\": " << options.maxBytes << "," << std::endl;
+	stream << "    \"seed\": " << options.seed << "," << std::endl;
+	stream << "    \"depth\": " << options.depth << std::endl;
+	stream << "  }," << std::endl;
+	stream << "  \"results\": [" << std::endl;
+
+	for (size_t i = 0; i < resultCount; ++i)
+	{
+		const SResult& result = results[i];
+		const double seconds = result.seconds > 0.0 ? result.seconds : 1e-9;
+
+		stream << "    { \"name\": ";
+		WriteJsonString(stream, result.name);
+		stream << ", \"seconds\": " << result.seconds;
+		stream << ", \"items\": " << result.items;
+		stream << ", \"bytes\": " << result.bytes;
+		stream << ", \"items_per_second\": " << (result.items / seconds);
+		stream << ", \"bytes_per_second\": " << (result.bytes / seconds);
+		stream << ", \"allocations\": " << result.allocations;
+		stream << ", \"allocation_bytes\": " << result.allocationBytes;
+		stream << " }" << (i + 1 < resultCount ? "," : "") << std::endl;
+	}
+
+	stream << "  ]," << std::endl;
+	stream << "  \"peak_rss_bytes\": " << GetPeakMemoryUsage() << std::endl;
+	stream << "}" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineRAII::SetProcessArgs(argc, argv);
+	CommandLineRAII commandline;
+	SOptions options;
+
+	const wchar_t* wcsEntries = commandline.FindArgAssignment(W(COMMANDLINE_ARG_ENTRIES));
+	const wchar_t* wcsDistribution = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DISTRIBUTION));
+	const wchar_t* wcsDuplicates = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DUPLICATES));
+	const wchar_t* wcsMaxBytes = commandline.FindArgAssignment(W(COMMANDLINE_ARG_MAXBYTES));
+	const wchar_t* wcsSeed = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SEED));
+	const wchar_t* wcsDepth = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DEPTH));
+	const wchar_t* wcsWorkdir = commandline.FindArgAssignment(W(COMMANDLINE_ARG_WORKDIR));
+	options.wcsOutput = commandline.FindArgAssignment(W(COMMANDLINE_ARG_OUTPUT));
+
+	if (commandline.HasArg(W(COMMANDLINE_ARG_HELP)))
+	{
+		std::cout
+		<< "h: " << "ARGUMENT"                 "      [TYPE1|TYPE2 {default}]"                                                      << std::endl
+		<< "   " << COMMANDLINE_ARG_ENTRIES "      [NUMBER {1000}]                -> Number of files in synthetic source tree" << std::endl
+		<< "   " << COMMANDLINE_ARG_DISTRIBUTION " [ini|mixed|texture {mixed}]    -> File size distribution"                   << std::endl
+		<< "   " << COMMANDLINE_ARG_DUPLICATES "   [NUMBER {0}]                   -> Ratio of duplicate file names in BIG file" << std::endl
+		<< "   " << COMMANDLINE_ARG_MAXBYTES "     [NUMBER {1073741824}]          -> Max total size of synthetic files"         << std::endl
+		<< "   " << COMMANDLINE_ARG_SEED "         [NUMBER {1}]                   -> Seed for synthetic file sizes and data"    << std::endl
+		<< "   " << COMMANDLINE_ARG_DEPTH "        [NUMBER {0}]                   -> Extra directory levels above each file"    << std::endl
+		<< "   " << COMMANDLINE_ARG_WORKDIR "      [PATH {bigbench}]              -> Existing directory for generated files"    << std::endl
+		<< "   " << COMMANDLINE_ARG_OUTPUT "       [FILE {}]                      -> Write JSON report to file instead of stdout" << std::endl;
+		return NoError;
+	}
+
+	if (wcsEntries)
+		options.entries = static_cast<uint32>(::_wtoi(wcsEntries));
+	if (wcsDuplicates)
+		options.duplicates = ::wcstod(wcsDuplicates, NULL);
+	if (wcsMaxBytes)
+		options.maxBytes = static_cast<uint64>(::wcstod(wcsMaxBytes, NULL));
+	if (wcsSeed)
+		options.seed = static_cast<uint32>(::_wtoi(wcsSeed));
+	if (wcsDepth)
+		options.depth = static_cast<uint32>(::_wtoi(wcsDepth));
+	if (wcsWorkdir)
+		options.wcsWorkdir = wcsWorkdir;
+
+	if (wcsDistribution && !ParseDistribution(options.distribution, wcsDistribution))
+	{
+		std::wcerr << "Error: '" << wcsDistribution << "' is no valid distribution" << std::endl;
+		return Error;
+	}
+
+	if (!fileaccess::FileExists(options.wcsWorkdir))
+	{
+		std::wcerr << "Error: '" << options.wcsWorkdir << "' is no valid path" << std::endl;
+		return Error;
+	}
+
+	// Stats count heap allocations for the report
+	stats::Enable(true);
+
+	TResults results;
+	if (!RunBenchmarks(options, results))
+	{
+		std::cerr << "Error: benchmark failed" << std::endl;
+		return Error;
+	}
+
+	if (options.wcsOutput)
+	{
+		std::ofstream file;
+		filesystem::OpenStream(file, options.wcsOutput, std::ios::out | std::ios::trunc);
+		WriteJsonReport(file, options, results);
+		return file.good() ? NoError : Error;
+	}
+
+	WriteJsonReport(std::cout, options, results);
+	return NoError;
+}
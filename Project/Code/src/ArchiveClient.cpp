@@ -0,0 +1,175 @@
+#include "ArchiveClient.h"
+#include "ArchiveProtocol.h"
+#include "FileSystem.h"
+#include "platform.h"
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+
+CArchiveClient::CArchiveClient()
+: m_socket(-1)
+{
+}
+
+CArchiveClient::~CArchiveClient()
+{
+	Close();
+}
+
+bool CArchiveClient::IsConnected() const
+{
+	return m_socket >= 0;
+}
+
+bool CArchiveClient::LookupFile(const wchar_t* wcsArchivePath, const char* szFileName, uint32& size)
+{
+	return Request(archiveprotocol::eRequest_Lookup, wcsArchivePath, szFileName, NULL, size);
+}
+
+bool CArchiveClient::ReadFile(const wchar_t* wcsArchivePath, const char* szFileName, CBuffer& data)
+{
+	uint32 size = 0;
+	return Request(archiveprotocol::eRequest_Read, wcsArchivePath, szFileName, &data, size);
+}
+
+#ifdef _WIN32
+
+bool CArchiveClient::Connect(const wchar_t*)
+{
+	return false;
+}
+
+void CArchiveClient::Close()
+{
+}
+
+bool CArchiveClient::Request(uint32, const wchar_t*, const char*, CBuffer*, uint32&)
+{
+	return false;
+}
+
+#else // POSIX
+
+bool CArchiveClient::Connect(const wchar_t* wcsSocketPath)
+{
+	Close();
+
+	struct sockaddr_un address;
+	::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	std::string socketPath;
+	if (!filesystem::ToNativePath(socketPath, wcsSocketPath) || socketPath.size() >= sizeof(address.sun_path))
+		return false;
+	::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+	m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_socket < 0)
+		return false;
+	::fcntl(m_socket, F_SETFD, FD_CLOEXEC);
+
+	if (::connect(m_socket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CArchiveClient::Close()
+{
+	if (m_socket >= 0)
+	{
+		::close(m_socket);
+		m_socket = -1;
+	}
+}
+
+bool CArchiveClient::Request(uint32 request, const wchar_t* wcsArchivePath, const char* szFileName, CBuffer* pData, uint32& size)
+{
+	if (m_socket < 0)
+		return false;
+
+	// The server can run in another working directory
+	std::string archivePath;
+	if (!filesystem::ToNativePath(archivePath, wcsArchivePath))
+		return false;
+	char* szRealPath = ::realpath(archivePath.c_str(), NULL);
+	if (!szRealPath)
+		return false;
+	archivePath = szRealPath;
+	::free(szRealPath);
+
+	archiveprotocol::SRequestHeader requestHeader;
+	requestHeader.request = request;
+	requestHeader.archivePathSize = static_cast<uint32>(archivePath.size());
+	requestHeader.fileNameSize = static_cast<uint32>(::strlen(szFileName));
+
+	std::string message(reinterpret_cast<const char*>(&requestHeader), sizeof(requestHeader));
+	message.append(archivePath).append(szFileName);
+
+	archiveprotocol::SResponseHeader responseHeader;
+	int memoryFd = -1;
+
+	if (!archiveprotocol::Send(m_socket, message.data(), message.size())
+		|| !archiveprotocol::Receive(m_socket, &responseHeader, sizeof(responseHeader), &memoryFd))
+	{
+		if (memoryFd >= 0)
+			::close(memoryFd);
+		Close();
+		return false;
+	}
+
+	if (!pData && responseHeader.transfer != archiveprotocol::eTransfer_None)
+	{
+		// Protocol violation, the stream position is lost
+		if (memoryFd >= 0)
+			::close(memoryFd);
+		Close();
+		return false;
+	}
+
+	size = static_cast<uint32>(responseHeader.fileSize);
+	bool ok = responseHeader.status == archiveprotocol::eStatus_Success;
+
+	switch (responseHeader.transfer)
+	{
+	case archiveprotocol::eTransfer_Inline:
+		pData->resize(size);
+		if (size != 0 && !archiveprotocol::Receive(m_socket, pData->data(), size))
+		{
+			Close();
+			ok = false;
+		}
+		break;
+
+	case archiveprotocol::eTransfer_MemoryFile:
+	{
+		pData->resize(size);
+		size_t offset = 0;
+		while (ok && offset < size)
+		{
+			const ssize_t readSize = ::pread(memoryFd, pData->data() + offset, size - offset, static_cast<off_t>(offset));
+			if (readSize < 0 && errno == EINTR)
+				continue;
+			ok = readSize > 0;
+			offset += ok ? readSize : 0;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (memoryFd >= 0)
+		::close(memoryFd);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "types.h"
+#include "Buffer.h"
+
+// Looks up and reads files of .big files through an archive server,
+// which keeps the .big files open and their hot files cached.
+
+class CArchiveClient
+{
+public:
+	CArchiveClient();
+	~CArchiveClient();
+
+	bool Connect(const wchar_t* wcsSocketPath);
+	void Close();
+	bool IsConnected() const;
+
+	// Return false if the archive or file does not exist or the server cannot be reached.
+	// File names are matched ignoring case and slash kind.
+	bool LookupFile(const wchar_t* wcsArchivePath, const char* szFileName, uint32& size);
+	bool ReadFile(const wchar_t* wcsArchivePath, const char* szFileName, CBuffer& data);
+
+private:
+	CArchiveClient(const CArchiveClient&);
+	CArchiveClient& operator=(const CArchiveClient&);
+
+	bool Request(uint32 request, const wchar_t* wcsArchivePath, const char* szFileName, CBuffer* pData, uint32& size);
+
+	int m_socket;
+};
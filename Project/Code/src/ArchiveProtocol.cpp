@@ -0,0 +1,190 @@
+#include "ArchiveProtocol.h"
+#include "platform.h"
+
+#ifndef _WIN32
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#endif
+
+
+namespace archiveprotocol {
+
+#ifdef _WIN32
+
+bool Send(int, const void*, size_t, int)
+{
+	return false;
+}
+
+bool Receive(int, void*, size_t, int*)
+{
+	return false;
+}
+
+bool SendSome(int, const void*, size_t, size_t&, int)
+{
+	return false;
+}
+
+bool ReceiveSome(int, void*, size_t, size_t&)
+{
+	return false;
+}
+
+#else // POSIX
+
+namespace {
+
+ssize_t SendMessage(int socket, const char* pData, size_t size, int fd)
+{
+	struct iovec iov;
+	iov.iov_base = const_cast<char*>(pData);
+	iov.iov_len = size;
+
+	struct msghdr message;
+	::memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+
+	// Descriptor travels with the first byte
+	char control[CMSG_SPACE(sizeof(int))];
+	if (fd >= 0)
+	{
+		::memset(control, 0, sizeof(control));
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		struct cmsghdr* pControl = CMSG_FIRSTHDR(&message);
+		pControl->cmsg_level = SOL_SOCKET;
+		pControl->cmsg_type = SCM_RIGHTS;
+		pControl->cmsg_len = CMSG_LEN(sizeof(int));
+		::memcpy(CMSG_DATA(pControl), &fd, sizeof(int));
+	}
+
+#ifdef MSG_NOSIGNAL
+	return ::sendmsg(socket, &message, MSG_NOSIGNAL);
+#else
+	return ::sendmsg(socket, &message, 0);
+#endif
+}
+
+ssize_t ReceiveMessage(int socket, char* pData, size_t size, int* pFd)
+{
+	struct iovec iov;
+	iov.iov_base = pData;
+	iov.iov_len = size;
+
+	struct msghdr message;
+	::memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	const ssize_t received = ::recvmsg(socket, &message, 0);
+	if (received <= 0)
+		return received;
+
+	for (struct cmsghdr* pControl = CMSG_FIRSTHDR(&message); pControl != NULL; pControl = CMSG_NXTHDR(&message, pControl))
+	{
+		if (pControl->cmsg_level == SOL_SOCKET && pControl->cmsg_type == SCM_RIGHTS)
+		{
+			int fd;
+			::memcpy(&fd, CMSG_DATA(pControl), sizeof(int));
+			if (pFd && *pFd < 0)
+				*pFd = fd;
+			else
+				::close(fd);
+		}
+	}
+	return received;
+}
+
+bool WouldBlock()
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+} // namespace
+
+bool Send(int socket, const void* data, size_t size, int fd)
+{
+	const char* pData = static_cast<const char*>(data);
+
+	while (size != 0)
+	{
+		const ssize_t sent = SendMessage(socket, pData, size, fd);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+
+		pData += sent;
+		size -= sent;
+		fd = -1;
+	}
+	return true;
+}
+
+bool Receive(int socket, void* data, size_t size, int* pFd)
+{
+	char* pData = static_cast<char*>(data);
+	if (pFd)
+		*pFd = -1;
+
+	while (size != 0)
+	{
+		const ssize_t received = ReceiveMessage(socket, pData, size, pFd);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return false;
+
+		pData += received;
+		size -= received;
+	}
+	return true;
+}
+
+bool SendSome(int socket, const void* data, size_t size, size_t& sentSize, int fd)
+{
+	sentSize = 0;
+	for (;;)
+	{
+		const ssize_t sent = SendMessage(socket, static_cast<const char*>(data), size, fd);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && WouldBlock())
+			return true;
+		if (sent <= 0)
+			return false;
+
+		sentSize = static_cast<size_t>(sent);
+		return true;
+	}
+}
+
+bool ReceiveSome(int socket, void* data, size_t size, size_t& receivedSize)
+{
+	receivedSize = 0;
+	for (;;)
+	{
+		const ssize_t received = ReceiveMessage(socket, static_cast<char*>(data), size, NULL);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received < 0 && WouldBlock())
+			return true;
+		if (received <= 0)
+			return false;
+
+		receivedSize = static_cast<size_t>(received);
+		return true;
+	}
+}
+
+#endif
+
+} // namespace archiveprotocol
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "types.h"
+#include <stddef.h>
+
+// Messages between the archive server and its clients over a local stream socket.
+// Both ends run on the same machine, so numbers are sent in native byte order.
+//
+// --- REQUEST
+// Request header
+// Archive path (archive path size bytes, native encoding, absolute)
+// File name (file name size bytes, as stored in the archive)
+//
+// --- RESPONSE
+// Response header
+// File data (file size bytes) if transferred inline,
+// or nothing if a memory file descriptor is passed along with the header
+
+namespace archiveprotocol
+{
+	enum ERequest : uint32
+	{
+		eRequest_Lookup = 0, // Responds with the file size only
+		eRequest_Read,       // Responds with the file size and data
+	};
+
+	enum EStatus : uint32
+	{
+		eStatus_Success = 0,
+		eStatus_ArchiveNotFound,
+		eStatus_FileNotFound,
+		eStatus_ReadError,
+		eStatus_BadRequest,
+	};
+
+	enum ETransfer : uint32
+	{
+		eTransfer_None = 0,   // No data follows
+		eTransfer_Inline,     // Data follows the header on the socket
+		eTransfer_MemoryFile, // Data is in a sealed memory file passed with the header
+	};
+
+	enum : uint32
+	{
+		MaxPathSize = 4096,
+		MaxNameSize = 4096,
+	};
+
+	struct SRequestHeader
+	{
+		uint32 request;
+		uint32 archivePathSize;
+		uint32 fileNameSize;
+	};
+
+	struct SResponseHeader
+	{
+		uint32 status;
+		uint32 transfer;
+		uint64 fileSize;
+	};
+
+	// Sends all bytes and optionally passes a file descriptor with them
+	bool Send(int socket, const void* data, size_t size, int fd = -1);
+	// Receives all bytes and optionally a passed file descriptor, which is -1 if there is none
+	bool Receive(int socket, void* data, size_t size, int* pFd = NULL);
+
+	// Send or receive as many bytes as a non-blocking socket takes without waiting, which can be none.
+	// Return false on errors and if the other end closed the socket.
+	bool SendSome(int socket, const void* data, size_t size, size_t& sentSize, int fd = -1);
+	bool ReceiveSome(int socket, void* data, size_t size, size_t& receivedSize);
+}
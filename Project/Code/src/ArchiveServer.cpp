@@ -0,0 +1,557 @@
+#include "ArchiveServer.h"
+#include "FileSystem.h"
+#include "Trace.h"
+#include "platform.h"
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+
+#ifdef _WIN32
+
+CArchiveServer::CArchiveServer()
+: m_listenSocket(-1)
+, m_cachedBytes(0)
+, m_maxCachedBytes(0)
+{
+}
+
+CArchiveServer::~CArchiveServer()
+{
+}
+
+bool CArchiveServer::Start(const wchar_t*, uint64)
+{
+	return false;
+}
+
+bool CArchiveServer::Run()
+{
+	return false;
+}
+
+void CArchiveServer::Stop()
+{
+}
+
+bool CArchiveServer::IsSupported()
+{
+	return false;
+}
+
+#else // POSIX
+
+namespace {
+
+volatile sig_atomic_t s_stopRequested = 0;
+
+void OnStopSignal(int)
+{
+	s_stopRequested = 1;
+}
+
+int CreateMemoryFile(const CBIGFile::TData& data)
+{
+	// Sealed so that clients cannot change what other clients read
+#if defined(MFD_CLOEXEC) && defined(MFD_ALLOW_SEALING)
+	const int fd = ::memfd_create("bigfile", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -1;
+
+	const char* pData = data.data();
+	size_t size = data.size();
+	while (size != 0)
+	{
+		const ssize_t written = ::write(fd, pData, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+		{
+			::close(fd);
+			return -1;
+		}
+		pData += written;
+		size -= written;
+	}
+
+#ifdef F_ADD_SEALS
+	::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+	return fd;
+#else
+	(void)data;
+	return -1;
+#endif
+}
+
+} // namespace
+
+
+CArchiveServer::CArchiveServer()
+: m_listenSocket(-1)
+, m_cachedBytes(0)
+, m_maxCachedBytes(DefaultCacheSize)
+{
+}
+
+CArchiveServer::~CArchiveServer()
+{
+	Stop();
+}
+
+bool CArchiveServer::Start(const wchar_t* wcsSocketPath, uint64 cacheSize)
+{
+	Stop();
+	m_maxCachedBytes = cacheSize;
+
+	struct sockaddr_un address;
+	::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (!filesystem::ToNativePath(m_socketPath, wcsSocketPath) || m_socketPath.size() >= sizeof(address.sun_path))
+		return false;
+	::memcpy(address.sun_path, m_socketPath.c_str(), m_socketPath.size());
+
+	m_listenSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listenSocket < 0)
+		return false;
+	::fcntl(m_listenSocket, F_SETFD, FD_CLOEXEC);
+
+	// A socket file left behind by a server that died is replaced,
+	// anything else at the path is kept, so that a mistyped path cannot delete a file
+	struct stat status;
+	if (::lstat(m_socketPath.c_str(), &status) == 0)
+	{
+		if (!S_ISSOCK(status.st_mode))
+		{
+			std::cout << "Error: '" << m_socketPath << "' exists and is no socket" << std::endl;
+			::close(m_listenSocket);
+			m_listenSocket = -1;
+			return false;
+		}
+		::unlink(m_socketPath.c_str());
+	}
+
+	if (::bind(m_listenSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+		|| ::listen(m_listenSocket, SOMAXCONN) != 0)
+	{
+		::close(m_listenSocket);
+		m_listenSocket = -1;
+		return false;
+	}
+	return true;
+}
+
+bool CArchiveServer::Run()
+{
+	if (m_listenSocket < 0)
+		return false;
+
+	s_stopRequested = 0;
+	::signal(SIGINT, OnStopSignal);
+	::signal(SIGTERM, OnStopSignal);
+	::signal(SIGPIPE, SIG_IGN);
+
+	std::vector<struct pollfd> pollFds;
+
+	while (!s_stopRequested)
+	{
+		pollFds.resize(m_clients.size() + 1);
+		pollFds[0].fd = m_listenSocket;
+		pollFds[0].events = POLLIN;
+		pollFds[0].revents = 0;
+		for (size_t clientIndex = 0; clientIndex < m_clients.size(); ++clientIndex)
+		{
+			// A client is read from again once its response is sent
+			const SClient& client = m_clients[clientIndex];
+			pollFds[clientIndex + 1].fd = client.socket;
+			pollFds[clientIndex + 1].events = client.responseSize != 0 ? POLLOUT : POLLIN;
+			pollFds[clientIndex + 1].revents = 0;
+		}
+
+		if (::poll(&pollFds[0], pollFds.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		// Serve connected clients first, new clients are appended behind them
+		for (size_t pollIndex = pollFds.size() - 1; pollIndex != 0; --pollIndex)
+		{
+			if (pollFds[pollIndex].revents == 0)
+				continue;
+
+			SClient& client = m_clients[pollIndex - 1];
+			const bool ok = client.responseSize != 0 ? SendResponse(client) : ReceiveRequest(client);
+			if (!ok)
+			{
+				CloseClient(client);
+				m_clients.erase(m_clients.begin() + (pollIndex - 1));
+			}
+		}
+
+		if (pollFds[0].revents & POLLIN)
+		{
+			SClient client;
+			client.socket = ::accept(m_listenSocket, NULL, NULL);
+			if (client.socket >= 0)
+			{
+				::fcntl(client.socket, F_SETFD, FD_CLOEXEC);
+				::fcntl(client.socket, F_SETFL, ::fcntl(client.socket, F_GETFL) | O_NONBLOCK);
+				m_clients.push_back(client);
+			}
+		}
+	}
+	return true;
+}
+
+void CArchiveServer::Stop()
+{
+	for (size_t clientIndex = 0; clientIndex < m_clients.size(); ++clientIndex)
+	{
+		CloseClient(m_clients[clientIndex]);
+	}
+	m_clients.clear();
+
+	if (m_listenSocket >= 0)
+	{
+		::close(m_listenSocket);
+		::unlink(m_socketPath.c_str());
+		m_listenSocket = -1;
+	}
+
+	for (TCacheEntries::iterator it = m_cacheEntries.begin(); it != m_cacheEntries.end(); ++it)
+	{
+		if (it->memoryFd >= 0)
+			::close(it->memoryFd);
+	}
+	m_cacheEntries.clear();
+	m_cacheIndex.clear();
+	m_cachedBytes = 0;
+
+	for (TArchives::iterator it = m_archives.begin(); it != m_archives.end(); ++it)
+	{
+		delete *it;
+	}
+	m_archives.clear();
+	m_archiveIndex.clear();
+}
+
+bool CArchiveServer::IsSupported()
+{
+	return true;
+}
+
+void CArchiveServer::CloseClient(SClient& client)
+{
+	if (client.memoryFd >= 0)
+		::close(client.memoryFd);
+	::close(client.socket);
+}
+
+bool CArchiveServer::ReceiveRequest(SClient& client)
+{
+	// Receives what has arrived and handles the request once it is complete
+	const size_t headerSize = sizeof(archiveprotocol::SRequestHeader);
+	if (client.request.empty())
+		client.request.resize(headerSize);
+
+	for (;;)
+	{
+		if (client.receivedSize == headerSize && client.request.size() == headerSize)
+		{
+			archiveprotocol::SRequestHeader requestHeader;
+			::memcpy(&requestHeader, client.request.data(), headerSize);
+			if (requestHeader.archivePathSize > archiveprotocol::MaxPathSize || requestHeader.fileNameSize > archiveprotocol::MaxNameSize)
+				return false;
+			client.request.resize(headerSize + requestHeader.archivePathSize + requestHeader.fileNameSize);
+		}
+
+		if (client.receivedSize == client.request.size())
+		{
+			HandleRequest(client);
+			client.request.clear();
+			client.receivedSize = 0;
+			return SendResponse(client);
+		}
+
+		size_t receivedSize = 0;
+		if (!archiveprotocol::ReceiveSome(client.socket, &client.request[client.receivedSize], client.request.size() - client.receivedSize, receivedSize))
+			return false;
+		if (receivedSize == 0)
+			return true;
+		client.receivedSize += receivedSize;
+	}
+}
+
+bool CArchiveServer::SendResponse(SClient& client)
+{
+	// Sends what the socket takes, the rest is sent when the client reads again
+	const size_t headerSize = sizeof(client.responseHeader);
+
+	while (client.sentSize < client.responseSize)
+	{
+		const char* pData;
+		size_t size;
+		if (client.sentSize < headerSize)
+		{
+			pData = reinterpret_cast<const char*>(&client.responseHeader) + client.sentSize;
+			size = headerSize - client.sentSize;
+		}
+		else
+		{
+			pData = client.dataPtr->data.data() + (client.sentSize - headerSize);
+			size = client.responseSize - client.sentSize;
+		}
+
+		size_t sentSize = 0;
+		if (!archiveprotocol::SendSome(client.socket, pData, size, sentSize, client.memoryFd))
+			return false;
+		if (sentSize == 0)
+			return true;
+
+		// The memory file went with the first byte
+		if (client.memoryFd >= 0)
+		{
+			::close(client.memoryFd);
+			client.memoryFd = -1;
+		}
+		client.sentSize += sentSize;
+	}
+
+	client.dataPtr.reset();
+	client.responseSize = 0;
+	client.sentSize = 0;
+	return true;
+}
+
+void CArchiveServer::HandleRequest(SClient& client)
+{
+	// Prepares the response to the received request
+	archiveprotocol::SRequestHeader requestHeader;
+	::memcpy(&requestHeader, client.request.data(), sizeof(requestHeader));
+	const char* pRequestData = client.request.data() + sizeof(requestHeader);
+	const std::string archivePath(pRequestData, requestHeader.archivePathSize);
+	std::string fileName(pRequestData + requestHeader.archivePathSize, requestHeader.fileNameSize);
+
+	TRACE_SCOPED_EVENT("serve request", fileName.c_str());
+
+	archiveprotocol::SResponseHeader& responseHeader = client.responseHeader;
+	responseHeader.status = archiveprotocol::eStatus_Success;
+	responseHeader.transfer = archiveprotocol::eTransfer_None;
+	responseHeader.fileSize = 0;
+	client.responseSize = sizeof(responseHeader);
+	client.sentSize = 0;
+
+	if (requestHeader.request != archiveprotocol::eRequest_Lookup && requestHeader.request != archiveprotocol::eRequest_Read)
+	{
+		responseHeader.status = archiveprotocol::eStatus_BadRequest;
+		return;
+	}
+
+	SArchive* pArchive = GetArchive(archivePath);
+	if (!pArchive)
+	{
+		responseHeader.status = archiveprotocol::eStatus_ArchiveNotFound;
+		return;
+	}
+
+	// Names are looked up like the game does, ignoring case and slash kind
+	CBIGFile::ApplySimplifiedCharset(fileName);
+
+	std::string key(archivePath);
+	key.push_back('\0');
+	key.append(fileName);
+
+	TCacheIndex::iterator indexIt = m_cacheIndex.find(key);
+	if (indexIt != m_cacheIndex.end())
+	{
+		// Warm read, mark entry as most recently used
+		m_cacheEntries.splice(m_cacheEntries.begin(), m_cacheEntries, indexIt->second);
+	}
+	else
+	{
+		const uint32 fileId = pArchive->bigFile.FindFileIdByName(fileName.c_str());
+		if (fileId == pArchive->bigFile.GetFileCount())
+		{
+			responseHeader.status = archiveprotocol::eStatus_FileNotFound;
+			return;
+		}
+
+		if (requestHeader.request == archiveprotocol::eRequest_Lookup)
+		{
+			// Lookups do not need file data, so they do not fill the cache
+			responseHeader.fileSize = pArchive->bigFile.GetFileSizeById(fileId);
+			return;
+		}
+
+		SCacheEntry cacheEntry;
+		cacheEntry.key = key;
+		cacheEntry.archivePath = archivePath;
+		if (!LoadCacheEntry(cacheEntry, *pArchive, fileId))
+		{
+			responseHeader.status = archiveprotocol::eStatus_ReadError;
+			return;
+		}
+
+		m_cacheEntries.push_front(cacheEntry);
+		indexIt = m_cacheIndex.insert(TCacheIndex::value_type(key, m_cacheEntries.begin())).first;
+		m_cachedBytes += cacheEntry.size;
+	}
+
+	// The client keeps a reference until the response is sent, trimming can drop the entry from the cache
+	const SCacheEntry& cacheEntry = *indexIt->second;
+	responseHeader.fileSize = cacheEntry.size;
+
+	if (requestHeader.request == archiveprotocol::eRequest_Read)
+	{
+		if (cacheEntry.memoryFd >= 0)
+			client.memoryFd = ::dup(cacheEntry.memoryFd);
+
+		if (client.memoryFd >= 0)
+		{
+			responseHeader.transfer = archiveprotocol::eTransfer_MemoryFile;
+		}
+		else if (cacheEntry.dataPtr.get())
+		{
+			responseHeader.transfer = archiveprotocol::eTransfer_Inline;
+			client.dataPtr = cacheEntry.dataPtr;
+			client.responseSize += client.dataPtr->data.size();
+		}
+		else
+		{
+			responseHeader.status = archiveprotocol::eStatus_ReadError;
+		}
+	}
+
+	TrimCache();
+}
+
+CArchiveServer::SArchive* CArchiveServer::GetArchive(const std::string& archivePath)
+{
+	// An archive that was replaced on disk is reopened and its cached files are dropped
+	struct stat status;
+	if (::stat(archivePath.c_str(), &status) != 0)
+		return NULL;
+
+	TArchiveIndex::iterator indexIt = m_archiveIndex.find(archivePath);
+	if (indexIt != m_archiveIndex.end())
+	{
+		SArchive* pArchive = *indexIt->second;
+		if (pArchive->device == static_cast<uint64>(status.st_dev)
+			&& pArchive->inode == static_cast<uint64>(status.st_ino)
+			&& pArchive->size == static_cast<uint64>(status.st_size)
+			&& pArchive->modifyTime == static_cast<int64>(status.st_mtime))
+		{
+			// Mark archive as most recently used
+			m_archives.splice(m_archives.begin(), m_archives, indexIt->second);
+			return pArchive;
+		}
+
+		RemoveArchive(indexIt);
+	}
+
+	std::wstring wcsArchivePath;
+	filesystem::FromNativePath(wcsArchivePath, archivePath.c_str());
+
+	const CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Read | CBIGFile::eFlags_UseSimplifiedName | CBIGFile::eFlags_IgnoreDuplicates;
+	SArchive* pArchive = new SArchive();
+	if (!pArchive->bigFile.OpenFile(wcsArchivePath.c_str(), bigFlags))
+	{
+		delete pArchive;
+		return NULL;
+	}
+
+	pArchive->path = archivePath;
+	pArchive->device = static_cast<uint64>(status.st_dev);
+	pArchive->inode = static_cast<uint64>(status.st_ino);
+	pArchive->size = static_cast<uint64>(status.st_size);
+	pArchive->modifyTime = static_cast<int64>(status.st_mtime);
+	m_archives.push_front(pArchive);
+	m_archiveIndex[archivePath] = m_archives.begin();
+
+	// Least recently used archives are closed, their cached files are dropped,
+	// because a closed archive is not checked for being replaced on disk
+	if (m_archiveIndex.size() > MaxOpenArchiveCount)
+	{
+		RemoveArchive(m_archiveIndex.find(m_archives.back()->path));
+	}
+
+	std::cout << "Opened '" << archivePath << "'" << std::endl;
+	return pArchive;
+}
+
+void CArchiveServer::RemoveArchive(TArchiveIndex::iterator indexIt)
+{
+	SArchive* pArchive = *indexIt->second;
+	RemoveCacheEntries(pArchive->path);
+	m_archives.erase(indexIt->second);
+	m_archiveIndex.erase(indexIt);
+	delete pArchive;
+}
+
+void CArchiveServer::RemoveCacheEntries(const std::string& archivePath)
+{
+	TCacheEntries::iterator it = m_cacheEntries.begin();
+	while (it != m_cacheEntries.end())
+	{
+		if (it->archivePath == archivePath)
+		{
+			if (it->memoryFd >= 0)
+				::close(it->memoryFd);
+			m_cachedBytes -= it->size;
+			m_cacheIndex.erase(it->key);
+			it = m_cacheEntries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void CArchiveServer::TrimCache()
+{
+	while (m_cachedBytes > m_maxCachedBytes && !m_cacheEntries.empty())
+	{
+		SCacheEntry& cacheEntry = m_cacheEntries.back();
+		if (cacheEntry.memoryFd >= 0)
+			::close(cacheEntry.memoryFd);
+		m_cachedBytes -= cacheEntry.size;
+		m_cacheIndex.erase(cacheEntry.key);
+		m_cacheEntries.pop_back();
+	}
+}
+
+bool CArchiveServer::LoadCacheEntry(SCacheEntry& cacheEntry, SArchive& archive, uint32 fileId)
+{
+	CBIGFile::TConstDataPtr dataPtr;
+	if (!archive.bigFile.ReadFileDataById(fileId, dataPtr))
+		return false;
+
+	cacheEntry.size = static_cast<uint32>(dataPtr->data.size());
+
+	if (cacheEntry.size >= DefaultMemoryFileSize)
+	{
+		cacheEntry.memoryFd = CreateMemoryFile(dataPtr->data);
+	}
+
+	// Memory files hold their own copy of the data
+	if (cacheEntry.memoryFd < 0)
+	{
+		cacheEntry.dataPtr = dataPtr;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "types.h"
+#include "ArchiveProtocol.h"
+#include "BIGFile.h"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+// Keeps .big files open and serves lookups and reads of their files to local
+// clients over a Unix domain socket. Read files are held in a least recently used
+// cache bounded by size, so that a warm read costs one round trip. Open .big files
+// are bounded in number the same way.
+// Large files are held in sealed memory files, whose descriptors are passed to clients
+// instead of sending the data through the socket. Clients are served without blocking,
+// so that a client that stops sending or reading does not hold up the others.
+// Only available on POSIX systems.
+
+class CArchiveServer
+{
+public:
+	enum : uint32
+	{
+		DefaultCacheSize = 256 * 1024 * 1024,
+		DefaultMemoryFileSize = 256 * 1024, // Files from this size on are passed as memory files
+		MaxOpenArchiveCount = 64,
+	};
+
+	CArchiveServer();
+	~CArchiveServer();
+
+	bool Start(const wchar_t* wcsSocketPath, uint64 cacheSize = DefaultCacheSize);
+	// Serves requests until a termination signal arrives
+	bool Run();
+	void Stop();
+
+	static bool IsSupported();
+
+private:
+	struct SArchive
+	{
+		SArchive() : device(0), inode(0), size(0), modifyTime(0) {}
+
+		std::string path;
+		CBIGFile bigFile;
+		uint64 device;
+		uint64 inode;
+		uint64 size;
+		int64 modifyTime;
+	};
+
+	struct SClient
+	{
+		SClient() : socket(-1), receivedSize(0), memoryFd(-1), responseSize(0), sentSize(0) {}
+
+		int socket;
+		std::string request; // Sized to the whole request once its header is received
+		size_t receivedSize;
+		archiveprotocol::SResponseHeader responseHeader;
+		CBIGFile::TConstDataPtr dataPtr; // File data sent inline after the response header
+		int memoryFd;                    // Memory file passed with the response header
+		size_t responseSize;             // Response header and inline data, 0 if no response is pending
+		size_t sentSize;
+	};
+
+	struct SCacheEntry
+	{
+		SCacheEntry() : memoryFd(-1), size(0) {}
+
+		std::string key;
+		std::string archivePath;
+		CBIGFile::TConstDataPtr dataPtr; // Set for files held in process memory
+		int memoryFd;                    // Set for files held in a memory file
+		uint32 size;
+	};
+
+	typedef std::list<SArchive*> TArchives;
+	typedef std::map<std::string, TArchives::iterator> TArchiveIndex;
+	typedef std::list<SCacheEntry> TCacheEntries;
+	typedef std::map<std::string, TCacheEntries::iterator> TCacheIndex;
+	typedef std::vector<SClient> TClients;
+
+	CArchiveServer(const CArchiveServer&);
+	CArchiveServer& operator=(const CArchiveServer&);
+
+	// Return false if the client is gone or misbehaves and must be disconnected
+	bool ReceiveRequest(SClient& client);
+	bool SendResponse(SClient& client);
+	void HandleRequest(SClient& client);
+	static void CloseClient(SClient& client);
+	SArchive* GetArchive(const std::string& archivePath);
+	void RemoveArchive(TArchiveIndex::iterator indexIt);
+	void RemoveCacheEntries(const std::string& archivePath);
+	void TrimCache();
+	bool LoadCacheEntry(SCacheEntry& cacheEntry, SArchive& archive, uint32 fileId);
+
+	std::string m_socketPath;
+	int m_listenSocket;
+	TClients m_clients;
+	TArchives m_archives; // Most recently used first
+	TArchiveIndex m_archiveIndex;
+	TCacheEntries m_cacheEntries; // Most recently used first
+	TCacheIndex m_cacheIndex;
+	uint64 m_cachedBytes;
+	uint64 m_maxCachedBytes;
+};
@@ -0,0 +1,57 @@
+#include "Arena.h"
+#include "Buffer.h"
+#include <algorithm>
+#include <cassert>
+
+
+CArena::CArena(size_t blockSize)
+: m_pCurrent(NULL)
+, m_pEnd(NULL)
+, m_blockSize(blockSize)
+, m_usedBytes(0)
+, m_reservedBytes(0)
+{
+}
+
+CArena::~CArena()
+{
+	Clear();
+}
+
+void* CArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	size_t padding = (alignment - (reinterpret_cast<size_t>(m_pCurrent) & (alignment - 1))) & (alignment - 1);
+
+	if (m_pCurrent == NULL || size + padding > static_cast<size_t>(m_pEnd - m_pCurrent))
+	{
+		// Oversized requests get a block of their own
+		size_t blockSize = std::max(m_blockSize, size + alignment);
+		char* pBlock = CBufferPool::GetInstance().Allocate(blockSize);
+		m_blocks.push_back(TBlock(pBlock, blockSize));
+		m_pCurrent = pBlock;
+		m_pEnd = pBlock + blockSize;
+		m_reservedBytes += blockSize;
+		padding = (alignment - (reinterpret_cast<size_t>(m_pCurrent) & (alignment - 1))) & (alignment - 1);
+	}
+
+	char* pData = m_pCurrent + padding;
+	m_pCurrent = pData + size;
+	m_usedBytes += size + padding;
+	return pData;
+}
+
+void CArena::Clear()
+{
+	const size_t blockCount = m_blocks.size();
+	for (size_t blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+	{
+		CBufferPool::GetInstance().Free(m_blocks[blockIndex].first, m_blocks[blockIndex].second);
+	}
+	m_blocks.clear();
+	m_pCurrent = NULL;
+	m_pEnd = NULL;
+	m_usedBytes = 0;
+	m_reservedBytes = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "types.h"
+#include <stddef.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+// Bump allocator for many small objects that are all released together.
+// Memory blocks come from the buffer pool. Nothing is destructed, so only
+// store plain data in it.
+
+class CArena
+{
+private:
+	enum : uint32
+	{
+		DefaultBlockSize = 64 * 1024,
+	};
+
+	typedef std::pair<char*, size_t> TBlock;
+	typedef std::vector<TBlock> TBlocks;
+
+public:
+	explicit CArena(size_t blockSize = DefaultBlockSize);
+	~CArena();
+
+	void* Allocate(size_t size, size_t alignment = sizeof(void*));
+	void Clear();
+
+	// Returns zero terminated copy of string
+	template <typename CharType>
+	const CharType* CopyString(const CharType* str, size_t length)
+	{
+		CharType* copy = static_cast<CharType*>(Allocate((length + 1) * sizeof(CharType), sizeof(CharType)));
+		::memcpy(copy, str, length * sizeof(CharType));
+		copy[length] = CharType(0);
+		return copy;
+	}
+
+	size_t GetUsedBytes() const { return m_usedBytes; }
+	size_t GetReservedBytes() const { return m_reservedBytes; }
+
+private:
+	CArena(const CArena&);
+	CArena& operator=(const CArena&);
+
+	TBlocks m_blocks;
+	char* m_pCurrent;
+	char* m_pEnd;
+	size_t m_blockSize;
+	size_t m_usedBytes;
+	size_t m_reservedBytes;
+};
@@ -1,6 +1,15 @@
 #include "BIGFile.h"
+#include "FileSystem.h"
+#include "LayoutPolicy.h"
+#include "SequentialWriter.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "platform.h"
 #include "utils.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string.h>
 
 #if _MSC_VER
 #pragma warning(disable: 4996)
@@ -58,8 +67,130 @@ void CBIGFile::SBigFullHeaderEx::Clear()
 }
 
 
+CBIGFile::CEntryReader::CEntryReader(const TSourceFilePtr& sourceFilePtr, uint64 offset, uint32 size, uint32 bufferSize)
+: m_sourceFilePtr(sourceFilePtr)
+, m_dataPtr()
+, m_offset(offset)
+, m_size(size)
+, m_position(0)
+, m_buffer()
+, m_bufferPosition(0)
+, m_bufferSize(bufferSize)
+, m_hasReadError(false)
+{
+}
+
+CBIGFile::CEntryReader::CEntryReader(const TConstDataPtr& dataPtr)
+: m_sourceFilePtr()
+, m_dataPtr(dataPtr)
+, m_offset(0)
+, m_size(static_cast<uint32>(dataPtr->data.size()))
+, m_position(0)
+, m_buffer()
+, m_bufferPosition(0)
+, m_bufferSize(0)
+, m_hasReadError(false)
+{
+}
+
+size_t CBIGFile::CEntryReader::Read(char* data, size_t size)
+{
+	if (m_hasReadError)
+		return 0;
+
+	size = std::min<size_t>(size, m_size - m_position);
+	if (size == 0)
+		return 0;
+
+	if (m_dataPtr.get())
+	{
+		::memcpy(data, m_dataPtr->data.data() + m_position, size);
+		m_position += static_cast<uint32>(size);
+		return size;
+	}
+
+	// Take what the buffer holds at the read position first
+	size_t readSize = 0;
+	if (m_position >= m_bufferPosition && m_position < m_bufferPosition + m_buffer.size())
+	{
+		const size_t bufferOffset = m_position - m_bufferPosition;
+		readSize = std::min(size, m_buffer.size() - bufferOffset);
+		::memcpy(data, m_buffer.data() + bufferOffset, readSize);
+		m_position += static_cast<uint32>(readSize);
+	}
+
+	const size_t missingSize = size - readSize;
+	if (missingSize == 0)
+		return readSize;
+
+	stats::AddCount(stats::eCounter_FileRead);
+
+	if (missingSize >= m_bufferSize)
+	{
+		// Large reads go past the buffer
+		if (!m_sourceFilePtr->file.ReadAt(data + readSize, missingSize, m_offset + m_position))
+		{
+			m_hasReadError = true;
+			return readSize;
+		}
+	}
+	else
+	{
+		// Small reads fill the buffer, so that the next small reads need not go to the file
+		m_buffer.resize(std::min(m_bufferSize, m_size - m_position));
+		if (!m_sourceFilePtr->file.ReadAt(&m_buffer[0], m_buffer.size(), m_offset + m_position))
+		{
+			m_buffer.clear();
+			m_hasReadError = true;
+			return readSize;
+		}
+		m_bufferPosition = m_position;
+		::memcpy(data + readSize, m_buffer.data(), missingSize);
+	}
+
+	m_position += static_cast<uint32>(missingSize);
+	return size;
+}
+
+bool CBIGFile::CEntryReader::Seek(uint32 position)
+{
+	if (position > m_size)
+		return false;
+
+	m_position = position;
+	return true;
+}
+
+uint32 CBIGFile::CEntryReader::GetSize() const
+{
+	return m_size;
+}
+
+uint32 CBIGFile::CEntryReader::GetPosition() const
+{
+	return m_position;
+}
+
+bool CBIGFile::CEntryReader::HasReadError() const
+{
+	return m_hasReadError;
+}
+
+
 CBIGFile::CBIGFile()
-: m_fileId(0)
+: m_pendingFileBytes(0)
+, m_workingFileHeaderIndicesValid(true)
+, m_workingFileHeaderIndicesRemovedOnly(false)
+, m_nameIndexValid(false)
+, m_pLayoutPolicy(NULL)
+, m_payloadAlignment(0)
+, m_minAlignedPayloadSize(0)
+, m_durability(filesystem::eDurability_End)
+, m_syncBatchBytes(filesystem::CReplaceFile::DefaultSyncBatchBytes)
+, m_writeBufferSize(CSequentialWriter::DefaultBufferSize)
+, m_compactionThreshold(DefaultCompactionThreshold)
+, m_headerReserve(0)
+, m_fileId(0)
 , m_flags(0)
 , m_hasPendingFileChanges(false)
 {
@@ -114,7 +245,13 @@ void CBIGFile::CloseFile()
 		m_workingHeader.Clear();
 		m_physicalHeader.Clear();
 		utils::ClearMemory(m_workingFileDataVector);
+		utils::ClearMemory(m_pendingFileIndices);
+		m_pendingFileBytes = 0;
 		utils::ClearMemory(m_workingFileHeaderIndices);
+		m_workingFileHeaderIndicesValid = true;
+		m_workingFileHeaderIndicesRemovedOnly = false;
+		utils::ClearMemory(m_nameIndex);
+		m_nameIndexValid = false;
 		utils::ClearMemory(m_bigFileName);
 		CloseFileStream();
 		m_fileId = 0u;
@@ -129,20 +266,56 @@ bool CBIGFile::IsOpen() const
 
 uint32 CBIGFile::GetFileCount() const
 {
-	return m_workingFileHeaderIndices.size();
+	return GetFileHeaderIndices().size();
+}
+
+uint32 CBIGFile::GetPhysicalFileCount() const
+{
+	return m_physicalHeader.fileHeaders.size();
+}
+
+uint32 CBIGFile::GetUnusedSizeOnDisk() const
+{
+	// Space of removed files and padding of aligned files. Free space after the header is
+	// reserved for the header to grow into and does not count.
+	const SBigHeader& bigHeader = m_physicalHeader.bigHeader;
+	uint64 usedSize = GetHeaderSpaceOnDisk();
+	const uint32 fileCount = m_physicalHeader.fileHeaders.size();
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		usedSize += m_physicalHeader.fileHeaders[fileIndex].size;
+	}
+	return bigHeader.bigFileSize > usedSize ? static_cast<uint32>(bigHeader.bigFileSize - usedSize) : 0;
+}
+
+uint32 CBIGFile::GetHeaderSpaceOnDisk() const
+{
+	// The header can take the space up to the first file data
+	const SBigHeader& bigHeader = m_physicalHeader.bigHeader;
+	uint32 headerSpace = bigHeader.bigFileSize;
+	const uint32 fileCount = m_physicalHeader.fileHeaders.size();
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		headerSpace = std::min(headerSpace, m_physicalHeader.fileHeaders[fileIndex].offset);
+	}
+	return std::max(headerSpace, bigHeader.headerSize);
 }
 
 void CBIGFile::OpenFileStream()
 {
 	std::ios::openmode mode = std::ios::ate | std::ios::binary;
-	mode |= (m_flags & eFlags_Read) ? std::ios::in : 0;
-	mode |= (m_flags & eFlags_Write) ? std::ios::out : 0;
-	m_fstream.open(m_bigFileName.c_str(), mode);
+	mode |= (m_flags & eFlags_Read) ? std::ios::in : std::ios::openmode();
+	mode |= (m_flags & eFlags_Write) ? std::ios::out : std::ios::openmode();
+	// Writing alone would truncate an existing file, which must stay intact until write out replaces it
+	mode |= (mode & std::ios::in) ? std::ios::openmode() : std::ios::app;
+	filesystem::OpenStream(m_fstream, m_bigFileName.c_str(), mode);
+	stats::AddCount(stats::eCounter_FileOpen);
 }
 
 void CBIGFile::CloseFileStream()
 {
 	m_fstream.close();
+	m_inputFilePtr.reset();
 }
 
 bool CBIGFile::BuildFromFileStream()
@@ -171,7 +344,11 @@ bool CBIGFile::BuildFromFileStream()
 					{
 						m_workingFileDataVector.resize(m_workingHeader.fileHeaders.size());
 						BuildFileHeaderIndices(m_workingFileHeaderIndices, m_workingHeader.fileHeaders);
+						m_workingFileHeaderIndicesValid = true;
 						m_physicalHeader.Copy(m_workingHeader);
+						m_nameIndexValid = false;
+						// Keep free space after the header of the .big file on whole write outs
+						m_headerReserve = GetHeaderSpaceOnDisk() - m_workingHeader.bigHeader.headerSize;
 						success = true;
 					}
 				}
@@ -203,6 +380,8 @@ bool CBIGFile::ReadDataFromStream(TData& data, std::istream& istream, uint32 off
 		return true;
 	}
 
+	TRACE_SCOPED_EVENT("stream read");
+
 	try
 	{
 		assert(istream.good());
@@ -218,6 +397,8 @@ bool CBIGFile::ReadDataFromStream(TData& data, std::istream& istream, uint32 off
 			{
 				istream.seekg(offset, std::ios::beg);
 				istream.read(&data[0], data.size());
+				stats::AddCount(stats::eCounter_FileSeek, 2);
+				stats::AddCount(stats::eCounter_FileRead);
 
 				return istream.good();
 			}
@@ -231,43 +412,6 @@ bool CBIGFile::ReadDataFromStream(TData& data, std::istream& istream, uint32 off
 	return false;
 }
 
-bool CBIGFile::WriteDataToStream(const TData& data, std::ostream& ostream, uint32 offset)
-{
-	if (data.empty())
-	{
-		return true;
-	}
-
-	try
-	{
-		assert(ostream.good());
-
-		if (ostream.good())
-		{
-			ostream.seekp(0, std::ios::end);
-			const uint64 fileSize = ostream.tellp();
-			const uint64 maxFileSize = 0xFFFFFFFFull;
-			offset = std::min(offset, (uint32)fileSize);
-
-			assert((uint64)offset + (uint64)data.size() <= maxFileSize);
-
-			if ((uint64)offset + (uint64)data.size() <= maxFileSize)
-			{
-				ostream.seekp(offset, std::ios::beg);
-				ostream.write(&data[0], data.size());
-
-				return ostream.good();
-			}
-		}
-	}
-	catch (std::exception&)
-	{
-		assert(0);
-	}
-
-	return false;
-}
-
 bool CBIGFile::ReadBigHeaderFromData(SBigHeader& bigHeader, const TData& data)
 {
 	assert(data.size() >= bigHeader.SizeOnDisk());
@@ -309,6 +453,10 @@ bool CBIGFile::ReadFileHeadersFromData(TBigFileHeadersEx& fileHeaders, const SBi
 
 	if (data.size() >= fileHeaderSize + offset)
 	{
+		// Index of the last file header of each name so far
+		typedef std::map<std::string, uint32> TLastHeaderIds;
+		TLastHeaderIds lastHeaderIds;
+
 		fileHeaders.clear();
 		fileHeaders.reserve(fileCount);
 
@@ -346,20 +494,19 @@ bool CBIGFile::ReadFileHeadersFromData(TBigFileHeadersEx& fileHeaders, const SBi
 			// Ignore previous duplicates to avoid inconsistent results
 			if (flags & eFlags_IgnoreDuplicates)
 			{
-				const uint32 headerCount = fileHeaders.size() - 1;
-				for (uint32 headerId = 0; headerId < headerCount; ++headerId)
-				{
-					const std::string& otherFileName = fileHeaders[headerId].simplifiedName;
-					const std::string& newFileName = newFileHeader.simplifiedName;
+				// Earlier duplicates were ignored when the previous one was added
+				const uint32 headerId = fileHeaders.size() - 1;
+				std::pair<TLastHeaderIds::iterator, bool> inserted = lastHeaderIds.insert(TLastHeaderIds::value_type(newFileHeader.simplifiedName, headerId));
 
-					if (otherFileName == newFileName)
-					{
-						fileHeaders[headerId].ignore = true;
-					}
+				if (!inserted.second)
+				{
+					fileHeaders[inserted.first->second].ignore = true;
+					inserted.first->second = headerId;
 				}
 			}
 
 			newFileHeader.physical = true;
+			newFileHeader.physicalIndex = fileHeaders.size() - 1;
 		}
 		
 		assert(fileHeaders.size() == fileCount);
@@ -390,6 +537,8 @@ bool CBIGFile::WriteFileHeadersToData(TData& data, const TBigFileHeadersEx& file
 		for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
 		{
 			const SBigFileHeaderEx& fileHeader = fileHeaders[fileIndex];
+			if (fileHeader.removed)
+				continue;
 
 			*reinterpret_cast<uint32*>(&data[dataIndex]) = utils::GetInvert(fileHeader.offset);
 			dataIndex += sizeof(uint32);
@@ -443,32 +592,78 @@ void CBIGFile::BuildFileHeaderIndices(TIntegers& fileHeaderIndices, const TBigFi
 	{
 		// Some file headers might be of no use, if the game will not load them
 		// Build an indices vector to translate an id to the real file index
-		if (!fileHeaders[fileIndex].ignore)
+		if (!fileHeaders[fileIndex].ignore && !fileHeaders[fileIndex].removed)
 		{
 			fileHeaderIndices.push_back(fileIndex);
 		}
 	}
 }
 
-void CBIGFile::BuildBigHeaderAndFileHeaders(SBigHeader& bigHeader, TBigFileHeadersEx& fileHeaders, const TDataPtrVector& fileDataVector)
+void CBIGFile::BuildFileLayout(TIntegers& fileLayout) const
 {
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+	fileLayout.resize(fileCount);
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		fileLayout[fileIndex] = fileIndex;
+	}
+
+	if (m_pLayoutPolicy)
+	{
+		CLayoutPolicy::TNames names;
+		names.resize(fileCount);
+
+		for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+		{
+			names[fileIndex] = m_workingHeader.fileHeaders[fileIndex].name.c_str();
+		}
+
+		m_pLayoutPolicy->SortLayout(fileLayout, names);
+	}
+}
+
+void CBIGFile::BuildBigHeaderAndFileHeaders(SBigHeader& bigHeader, TBigFileHeadersEx& fileHeaders, const TDataPtrVector& fileDataVector, const TIntegers& fileLayout, uint32 alignment, uint32 minAlignedSize, uint32 headerReserve)
+{
+	// File data is laid out in the order of the file layout, if one is given.
+	// Otherwise it is laid out in the order of the file headers.
+	// File data of at least the min aligned size starts at a multiple of the alignment.
+	// File data starts after the header reserve, which is left free for the header to grow into.
+	STATS_SCOPED_PHASE(stats::ePhase_HeaderBuild);
+	TRACE_SCOPED_EVENT("header build");
+
 	assert(fileHeaders.size() == fileDataVector.size());
+	assert(fileLayout.empty() || fileLayout.size() == fileHeaders.size());
 
 	bigHeader.bigFileSize = 0;
 	bigHeader.bigFileSize += bigHeader.SizeOnDisk();
 	bigHeader.bigFileSize += GetSizeOnDisk(fileHeaders);
 	bigHeader.bigFileSize += SBigLastHeader::SizeOnDisk();
 	bigHeader.headerSize = bigHeader.bigFileSize;
-	bigHeader.fileCount = fileHeaders.size();
+	bigHeader.fileCount = GetWrittenFileCount(fileHeaders);
+	bigHeader.bigFileSize += headerReserve;
 
-	for (uint32 fileIndex = 0; fileIndex < bigHeader.fileCount; ++fileIndex)
+	const uint32 fileCount = fileHeaders.size();
+	for (uint32 layoutIndex = 0; layoutIndex < fileCount; ++layoutIndex)
 	{
+		const uint32 fileIndex = fileLayout.empty() ? layoutIndex : fileLayout[layoutIndex];
 		SBigFileHeaderEx& fileHeader = fileHeaders[fileIndex];
-		const TDataPtr& fileDataPtr = fileDataVector[fileIndex];
+		const TConstDataPtr& fileDataPtr = fileDataVector[fileIndex];
+
+		if (fileHeader.removed)
+			continue;
 
-		fileHeader.offset = bigHeader.bigFileSize;
 		if (fileDataPtr.get())
-			fileHeader.size = fileDataPtr->data.size();
+			fileHeader.size = fileDataPtr->GetSize();
+
+		if (alignment > 1 && fileHeader.size >= minAlignedSize)
+		{
+			const uint32 remainder = bigHeader.bigFileSize % alignment;
+			if (remainder != 0)
+				bigHeader.bigFileSize += alignment - remainder;
+		}
+
+		fileHeader.offset = bigHeader.bigFileSize;
 		bigHeader.bigFileSize += fileHeader.size;
 	}
 }
@@ -479,11 +674,24 @@ uint32 CBIGFile::GetSizeOnDisk(const TBigFileHeadersEx& fileHeaders)
 	const uint32 fileCount = fileHeaders.size();
 	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
 	{
-		sizeOnDisk += fileHeaders[fileIndex].SizeOnDisk();
+		if (!fileHeaders[fileIndex].removed)
+			sizeOnDisk += fileHeaders[fileIndex].SizeOnDisk();
 	}
 	return sizeOnDisk;
 }
 
+uint32 CBIGFile::GetWrittenFileCount(const TBigFileHeadersEx& fileHeaders)
+{
+	uint32 writtenFileCount = 0;
+	const uint32 fileCount = fileHeaders.size();
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		if (!fileHeaders[fileIndex].removed)
+			++writtenFileCount;
+	}
+	return writtenFileCount;
+}
+
 uint32 CBIGFile::GetMaxFileSize(const TBigFileHeadersEx& fileHeaders)
 {
 	uint32 maxFileSize = 0;
@@ -497,9 +705,10 @@ uint32 CBIGFile::GetMaxFileSize(const TBigFileHeadersEx& fileHeaders)
 
 CBIGFile::SBigFileHeaderEx* CBIGFile::GetFileHeader(uint32 id)
 {
-	if (id < m_workingFileHeaderIndices.size())
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
+	if (id < fileHeaderIndices.size())
 	{
-		const uint32 index = m_workingFileHeaderIndices[id];
+		const uint32 index = fileHeaderIndices[id];
 		return &m_workingHeader.fileHeaders[index];
 	}
 	return NULL;
@@ -507,14 +716,34 @@ CBIGFile::SBigFileHeaderEx* CBIGFile::GetFileHeader(uint32 id)
 
 const CBIGFile::SBigFileHeaderEx* CBIGFile::GetFileHeader(uint32 id) const
 {
-	if (id < m_workingFileHeaderIndices.size())
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
+	if (id < fileHeaderIndices.size())
 	{
-		const uint32 index = m_workingFileHeaderIndices[id];
+		const uint32 index = fileHeaderIndices[id];
 		return &m_workingHeader.fileHeaders[index];
 	}
 	return NULL;
 }
 
+const CBIGFile::TIntegers& CBIGFile::GetFileHeaderIndices() const
+{
+	if (!m_workingFileHeaderIndicesValid)
+	{
+		BuildFileHeaderIndices(m_workingFileHeaderIndices, m_workingHeader.fileHeaders);
+		m_workingFileHeaderIndicesValid = true;
+		m_workingFileHeaderIndicesRemovedOnly = false;
+	}
+	return m_workingFileHeaderIndices;
+}
+
+uint32 CBIGFile::GetFileIdByIndex(uint32 fileIndex) const
+{
+	// File header indices are in ascending order
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
+	TIntegers::const_iterator it = std::lower_bound(fileHeaderIndices.begin(), fileHeaderIndices.end(), fileIndex);
+	return static_cast<uint32>(it - fileHeaderIndices.begin());
+}
+
 bool CBIGFile::SetFileNameById(uint32 id, const char* szName)
 {
 	if (SBigFileHeaderEx* pFileHeader = GetFileHeader(id))
@@ -526,6 +755,8 @@ bool CBIGFile::SetFileNameById(uint32 id, const char* szName)
 		{
 			ApplySimplifiedCharset(pFileHeader->simplifiedName);
 		}
+		m_nameIndexValid = false;
+		m_hasPendingFileChanges = true;
 		return true;
 	}
 	return false;
@@ -540,6 +771,15 @@ const char* CBIGFile::GetFileNameById(uint32 id) const
 	return NULL;
 }
 
+const char* CBIGFile::GetStoredFileNameById(uint32 id) const
+{
+	if (const SBigFileHeaderEx* pFileHeader = GetFileHeader(id))
+	{
+		return pFileHeader->name.c_str();
+	}
+	return NULL;
+}
+
 void CBIGFile::SetCurrentFileId(uint32 id)
 {
 	m_fileId = (id < GetFileCount()) ? id : GetFileCount();
@@ -568,21 +808,135 @@ const char* CBIGFile::GetFirstFileName()
 
 const char* CBIGFile::GetNextFileName()
 {
-	m_fileId = (m_fileId < GetFileCount()) ? ++m_fileId : m_fileId;
+	if (m_fileId < GetFileCount())
+		++m_fileId;
 	return GetFileNameById(m_fileId);
 }
 
+uint32 CBIGFile::GetFileOffsetById(uint32 id) const
+{
+	if (const SBigFileHeaderEx* pFileHeader = GetFileHeader(id))
+	{
+		return pFileHeader->offset;
+	}
+	return 0;
+}
+
+uint32 CBIGFile::GetFileSizeById(uint32 id) const
+{
+	if (const SBigFileHeaderEx* pFileHeader = GetFileHeader(id))
+	{
+		return pFileHeader->size;
+	}
+	return 0;
+}
+
+struct CBIGFile::SNameIndexLess
+{
+	explicit SNameIndexLess(const TBigFileHeadersEx& fileHeaders) : fileHeaders(fileHeaders) {}
+
+	bool operator()(uint32 leftIndex, uint32 rightIndex) const
+	{
+		return fileHeaders[leftIndex].simplifiedName < fileHeaders[rightIndex].simplifiedName;
+	}
+	bool operator()(uint32 index, const char* szName) const
+	{
+		return ::strcmp(fileHeaders[index].simplifiedName.c_str(), szName) < 0;
+	}
+	bool operator()(const char* szName, uint32 index) const
+	{
+		return ::strcmp(szName, fileHeaders[index].simplifiedName.c_str()) < 0;
+	}
+
+	const TBigFileHeadersEx& fileHeaders;
+};
+
+const CBIGFile::TFileIds& CBIGFile::GetNameIndex() const
+{
+	// The name index holds file indices instead of ids, so that it stays valid
+	// when files are removed. Removed files are skipped on lookup.
+	if (!m_nameIndexValid)
+	{
+		m_nameIndex = GetFileHeaderIndices();
+
+		// Stable sort keeps files with equal names in id order
+		std::stable_sort(m_nameIndex.begin(), m_nameIndex.end(), SNameIndexLess(m_workingHeader.fileHeaders));
+		m_nameIndexValid = true;
+	}
+	return m_nameIndex;
+}
+
+uint32 CBIGFile::FindFileIndexByName(const char* szName) const
+{
+	const TFileIds& nameIndex = GetNameIndex();
+	TFileIds::const_iterator it = std::upper_bound(nameIndex.begin(), nameIndex.end(), szName, SNameIndexLess(m_workingHeader.fileHeaders));
+
+	// The game loads the last file of equal names
+	while (it != nameIndex.begin())
+	{
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[*(--it)];
+		if (fileHeader.simplifiedName != szName)
+			break;
+		if (!fileHeader.removed)
+			return *it;
+	}
+	return m_workingHeader.fileHeaders.size();
+}
+
+uint32 CBIGFile::FindFileIdByName(const char* szName) const
+{
+	const uint32 fileIndex = FindFileIndexByName(szName);
+	if (fileIndex < m_workingHeader.fileHeaders.size())
+	{
+		return GetFileIdByIndex(fileIndex);
+	}
+	return GetFileCount();
+}
+
+void CBIGFile::FindFileIdsByPrefix(TFileIds& fileIds, const char* szPrefix) const
+{
+	const TFileIds& nameIndex = GetNameIndex();
+	const size_t prefixLength = ::strlen(szPrefix);
+	TFileIds::const_iterator it = std::lower_bound(nameIndex.begin(), nameIndex.end(), szPrefix, SNameIndexLess(m_workingHeader.fileHeaders));
+
+	for (; it != nameIndex.end(); ++it)
+	{
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[*it];
+		if (fileHeader.simplifiedName.compare(0, prefixLength, szPrefix) != 0)
+			break;
+		if (!fileHeader.removed)
+			fileIds.push_back(GetFileIdByIndex(*it));
+	}
+}
+
 bool CBIGFile::AddNewFile(const char* szName, const TData& data, bool immediateWriteOut)
 {
-	m_fileId = (m_fileId < GetFileCount()) ? ++m_fileId : m_fileId;
-	return AddNewFile(m_fileId, szName, data, immediateWriteOut);
+	return AddNewFile(szName, TDataPtr(new SDataRef(data)), immediateWriteOut);
 }
 
 bool CBIGFile::AddNewFile(uint32 id, const char* szName, const TData& data, bool immediateWriteOut)
 {
+	return AddNewFile(id, szName, TDataPtr(new SDataRef(data)), immediateWriteOut);
+}
+
+bool CBIGFile::AddNewFile(const char* szName, const TConstDataPtr& dataPtr, bool immediateWriteOut)
+{
+	if (m_fileId < GetFileCount())
+		++m_fileId;
+	return AddNewFile(m_fileId, szName, dataPtr, immediateWriteOut);
+}
+
+bool CBIGFile::AddNewFile(uint32 id, const char* szName, const TConstDataPtr& dataPtr, bool immediateWriteOut)
+{
+	assert(dataPtr.get() != NULL);
+
+	STATS_SCOPED_PHASE(stats::ePhase_AddFile);
+	stats::AddPhaseBytes(stats::ePhase_AddFile, dataPtr->GetSize());
+
 	bool success = false;
 
 	SBigFileHeaderEx newFileHeader;
+	newFileHeader.size = static_cast<uint32>(dataPtr->GetSize());
 	newFileHeader.name = szName;
 	newFileHeader.simplifiedName = szName;
 
@@ -599,7 +953,8 @@ bool CBIGFile::AddNewFile(uint32 id, const char* szName, const TData& data, bool
 		m_fileId = GetFileCount();
 		m_workingFileHeaderIndices.push_back(fileIndex);
 		m_workingHeader.fileHeaders.push_back(newFileHeader);
-		m_workingFileDataVector.push_back(new SDataRef(data));
+		m_workingFileDataVector.push_back(TConstDataPtr());
+		SetPendingFileData(fileIndex, dataPtr);
 	}
 	else
 	{
@@ -607,14 +962,26 @@ bool CBIGFile::AddNewFile(uint32 id, const char* szName, const TData& data, bool
 
 		// Add new file at begin or middle.
 		m_workingHeader.fileHeaders.insert(m_workingHeader.fileHeaders.begin() + fileIndex, newFileHeader);
-		m_workingFileDataVector.insert(m_workingFileDataVector.begin() + fileIndex, new SDataRef(data));
+		m_workingFileDataVector.insert(m_workingFileDataVector.begin() + fileIndex, TConstDataPtr());
+
+		// Pending files behind the new file move by one
+		const uint32 pendingFileCount = m_pendingFileIndices.size();
+		for (uint32 pendingIndex = 0; pendingIndex < pendingFileCount; ++pendingIndex)
+		{
+			if (m_pendingFileIndices[pendingIndex] >= fileIndex)
+				++m_pendingFileIndices[pendingIndex];
+		}
+		SetPendingFileData(fileIndex, dataPtr);
 
 		// Rebuild file header indices.
 		BuildFileHeaderIndices(m_workingFileHeaderIndices, m_workingHeader.fileHeaders);
+		m_workingFileHeaderIndicesValid = true;
 	}
 
-	// Rebuild headers with new data added.
-	BuildBigHeaderAndFileHeaders(m_workingHeader.bigHeader, m_workingHeader.fileHeaders, m_workingFileDataVector);
+	m_nameIndexValid = false;
+
+	// Offsets of new files are laid out once on write out. Laying out all files
+	// on each added file would make adding many files take quadratic time.
 
 	// Write out pending changes if necessary.
 	if (immediateWriteOut)
@@ -632,50 +999,244 @@ bool CBIGFile::AddNewFile(uint32 id, const char* szName, const TData& data, bool
 	return success;
 }
 
+bool CBIGFile::RemoveFileById(uint32 id)
+{
+	// A row of removals keeps the ids from before it, so that each removal takes constant time.
+	// Ids are renumbered once on next other use.
+	const TIntegers& fileHeaderIndices = m_workingFileHeaderIndicesRemovedOnly ? m_workingFileHeaderIndices : GetFileHeaderIndices();
+	if (id < fileHeaderIndices.size())
+	{
+		const uint32 fileIndex = fileHeaderIndices[id];
+		if (m_workingHeader.fileHeaders[fileIndex].removed)
+			return false;
+
+		RemoveFileByIndex(fileIndex);
+		m_workingFileHeaderIndicesValid = false;
+		m_workingFileHeaderIndicesRemovedOnly = true;
+		return true;
+	}
+	return false;
+}
+
+bool CBIGFile::RemoveFileByName(const char* szName)
+{
+	const uint32 fileIndex = FindFileIndexByName(szName);
+	if (fileIndex < m_workingHeader.fileHeaders.size())
+	{
+		RemoveFileByIndex(fileIndex);
+
+		// Ids are renumbered once on next use
+		m_workingFileHeaderIndicesValid = false;
+		return true;
+	}
+	return false;
+}
+
+void CBIGFile::RemoveFileByIndex(uint32 fileIndex)
+{
+	// The file header stays in place until write out, so that file indices
+	// and the mapping to the file headers on disk stay as they are.
+	m_workingHeader.fileHeaders[fileIndex].removed = true;
+	SetPendingFileData(fileIndex, TConstDataPtr());
+	m_hasPendingFileChanges = true;
+}
+
+void CBIGFile::RemoveShadowedDuplicates()
+{
+	// Ignored duplicates of a removed file go too,
+	// otherwise the game would load one of them instead.
+	std::set<std::string> removedNames;
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+		if (fileHeader.removed && !fileHeader.ignore)
+			removedNames.insert(fileHeader.simplifiedName);
+	}
+
+	if (removedNames.empty())
+		return;
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+		if (fileHeader.ignore && !fileHeader.removed && removedNames.count(fileHeader.simplifiedName) != 0)
+			RemoveFileByIndex(fileIndex);
+	}
+}
+
+void CBIGFile::EraseRemovedFiles()
+{
+	// Removed files are gone from disk after write out. Pending file indices would move.
+	assert(m_pendingFileIndices.empty());
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+	uint32 keptFileCount = 0;
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		if (!m_workingHeader.fileHeaders[fileIndex].removed)
+		{
+			if (keptFileCount != fileIndex)
+			{
+				m_workingHeader.fileHeaders[keptFileCount] = m_workingHeader.fileHeaders[fileIndex];
+				m_workingFileDataVector[keptFileCount] = m_workingFileDataVector[fileIndex];
+			}
+			++keptFileCount;
+		}
+	}
+
+	if (keptFileCount != fileCount)
+	{
+		m_workingHeader.fileHeaders.resize(keptFileCount);
+		m_workingFileDataVector.resize(keptFileCount);
+		m_workingFileHeaderIndicesValid = false;
+		m_workingFileHeaderIndicesRemovedOnly = false;
+		m_nameIndexValid = false;
+	}
+}
+
+void CBIGFile::SetAllFilesPhysical()
+{
+	// After write out the file headers on disk are the working file headers
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		m_workingHeader.fileHeaders[fileIndex].physical = true;
+		m_workingHeader.fileHeaders[fileIndex].physicalIndex = fileIndex;
+	}
+	m_physicalHeader.Copy(m_workingHeader);
+}
+
 bool CBIGFile::ReadFileDataById(uint32 id, TData& data)
 {
 	bool success = false;
-	uint32 nonPhysicalFileCount = 0;
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
 
-	if (id < m_workingFileHeaderIndices.size())
+	if (id < fileHeaderIndices.size())
 	{
-		const uint32 workingFileIndex = m_workingFileHeaderIndices[id];
-		const TDataPtr& internalDataPtr = m_workingFileDataVector[workingFileIndex];
+		const uint32 workingFileIndex = fileHeaderIndices[id];
+		const TConstDataPtr& internalDataPtr = m_workingFileDataVector[workingFileIndex];
 
-		if (internalDataPtr.get() && !internalDataPtr->data.empty())
+		if (internalDataPtr.get() && !internalDataPtr->HasSourceFile())
 		{
-			// Get data that is not yet written out to the .big file.
+			// Copy data that is not yet written out to the .big file.
 			data = internalDataPtr->data;
 			success = true;
 		}
 		else
 		{
-			// Get data that is in the .big file on disk.
-			const uint32 physicalFileIndex = workingFileIndex - nonPhysicalFileCount;
-			const SBigFileHeader& fileHeader = m_physicalHeader.fileHeaders[physicalFileIndex];
-			data.resize(fileHeader.size);
-			success = ReadDataFromStream(data, m_fstream, fileHeader.offset);
+			success = ReadUnloadedFileData(workingFileIndex, data);
 		}
+	}
+	return success;
+}
+
+bool CBIGFile::ReadFileDataById(uint32 id, TConstDataPtr& dataPtr)
+{
+	bool success = false;
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
 
-		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[workingFileIndex];
-		if (!fileHeader.physical)
+	if (id < fileHeaderIndices.size())
+	{
+		const uint32 workingFileIndex = fileHeaderIndices[id];
+		const TConstDataPtr& internalDataPtr = m_workingFileDataVector[workingFileIndex];
+
+		if (internalDataPtr.get() && !internalDataPtr->HasSourceFile())
 		{
-			nonPhysicalFileCount++;
+			// Share data that is not yet written out to the .big file. It is const,
+			// so that the pending data cannot change apart from its file header.
+			dataPtr = internalDataPtr;
+			success = true;
+		}
+		else
+		{
+			TDataPtr newDataPtr = new SDataRef();
+			success = ReadUnloadedFileData(workingFileIndex, newDataPtr->data);
+			dataPtr = newDataPtr;
 		}
 	}
 	return success;
 }
 
+bool CBIGFile::ReadUnloadedFileData(uint32 fileIndex, TData& data)
+{
+	const TConstDataPtr& internalDataPtr = m_workingFileDataVector[fileIndex];
+
+	if (internalDataPtr.get())
+	{
+		// Get data that is not yet copied from its source file.
+		assert(internalDataPtr->HasSourceFile());
+		data.resize(internalDataPtr->sourceSize);
+		return data.empty()
+			|| internalDataPtr->sourceFilePtr->file.ReadAt(&data[0], data.size(), internalDataPtr->sourceOffset);
+	}
+
+	// Get data that is in the .big file on disk. Files added or removed
+	// in front of it since the last write out do not move its file header.
+	const SBigFileHeaderEx& workingFileHeader = m_workingHeader.fileHeaders[fileIndex];
+	assert(workingFileHeader.physical);
+	const SBigFileHeader& fileHeader = m_physicalHeader.fileHeaders[workingFileHeader.physicalIndex];
+	data.resize(fileHeader.size);
+	return ReadDataFromStream(data, m_fstream, fileHeader.offset);
+}
+
+CBIGFile::TEntryReaderPtr CBIGFile::OpenEntryReader(uint32 id)
+{
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
+	if (id >= fileHeaderIndices.size())
+		return TEntryReaderPtr();
+
+	const uint32 workingFileIndex = fileHeaderIndices[id];
+	const TConstDataPtr& internalDataPtr = m_workingFileDataVector[workingFileIndex];
+
+	if (internalDataPtr.get() && internalDataPtr->HasSourceFile())
+	{
+		// Read data that is not yet copied from its source file.
+		return new CEntryReader(internalDataPtr->sourceFilePtr, internalDataPtr->sourceOffset, internalDataPtr->sourceSize);
+	}
+	else if (internalDataPtr.get())
+	{
+		// Read data that is not yet written out to the .big file.
+		return new CEntryReader(internalDataPtr);
+	}
+
+	// Read data that is in the .big file on disk.
+	if (!m_inputFilePtr.get())
+	{
+		TSourceFilePtr inputFilePtr = new SSourceFile();
+		stats::AddCount(stats::eCounter_FileOpen);
+		if (!inputFilePtr->file.Open(m_bigFileName.c_str()))
+			return TEntryReaderPtr();
+		m_inputFilePtr = inputFilePtr;
+	}
+
+	const SBigFileHeaderEx& workingFileHeader = m_workingHeader.fileHeaders[workingFileIndex];
+	assert(workingFileHeader.physical);
+	const SBigFileHeader& fileHeader = m_physicalHeader.fileHeaders[workingFileHeader.physicalIndex];
+	return new CEntryReader(m_inputFilePtr, fileHeader.offset, fileHeader.size);
+}
+
 bool CBIGFile::WriteFileDataById(uint32 id, const TData& data, bool immediateWriteOut)
 {
+	return WriteFileDataById(id, TDataPtr(new SDataRef(data)), immediateWriteOut);
+}
+
+bool CBIGFile::WriteFileDataById(uint32 id, const TConstDataPtr& dataPtr, bool immediateWriteOut)
+{
+	assert(dataPtr.get() != NULL);
+
 	bool success = false;
-	if (id < m_workingFileHeaderIndices.size())
+	const TIntegers& fileHeaderIndices = GetFileHeaderIndices();
+
+	if (id < fileHeaderIndices.size())
 	{
-		const uint32 workingFileIndex = m_workingFileHeaderIndices[id];
-		m_workingFileDataVector[workingFileIndex] = new SDataRef(data);
+		const uint32 workingFileIndex = fileHeaderIndices[id];
+		SetPendingFileData(workingFileIndex, dataPtr);
 
-		// Rebuild headers with new data added.
-		BuildBigHeaderAndFileHeaders(m_workingHeader.bigHeader, m_workingHeader.fileHeaders, m_workingFileDataVector);
+		// Offsets are laid out on write out, which writes changed file data over the old
+		// file data or to a new place, depending on durability.
+		m_workingHeader.fileHeaders[workingFileIndex].size = static_cast<uint32>(dataPtr->GetSize());
 
 		if (immediateWriteOut)
 		{
@@ -697,140 +1258,442 @@ bool CBIGFile::ReadDataFromCurrentFile(TData& data)
 	return ReadFileDataById(m_fileId, data);
 }
 
+bool CBIGFile::ReadDataFromCurrentFile(TConstDataPtr& dataPtr)
+{
+	return ReadFileDataById(m_fileId, dataPtr);
+}
+
 bool CBIGFile::WriteDataToCurrentFile(const TData& data, bool immediateWriteOut)
 {
 	return WriteFileDataById(m_fileId, data, immediateWriteOut);
 }
 
+bool CBIGFile::WriteDataToCurrentFile(const TConstDataPtr& dataPtr, bool immediateWriteOut)
+{
+	return WriteFileDataById(m_fileId, dataPtr, immediateWriteOut);
+}
+
 bool CBIGFile::HasPendingFileChanges() const
 {
-	bool hasChanges = false;
-	const uint32 fileCount = m_workingFileDataVector.size();
-	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	return m_hasPendingFileChanges;
+}
+
+uint32 CBIGFile::GetPendingFileCount() const
+{
+	return static_cast<uint32>(m_pendingFileIndices.size());
+}
+
+uint64 CBIGFile::GetPendingFileBytes() const
+{
+	return m_pendingFileBytes;
+}
+
+void CBIGFile::SetPendingFileData(uint32 fileIndex, const TConstDataPtr& dataPtr)
+{
+	// Keeps track of files with pending data, so that neither counting them
+	// nor writing them out in place needs to go over all files.
+	// Each file with pending data is listed once, files without pending data are not listed.
+	// The file header keeps its place in the list, so that it is unlisted without a search.
+	TConstDataPtr& fileDataPtr = m_workingFileDataVector[fileIndex];
+	SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+
+	if (fileDataPtr.get())
 	{
-		if (!m_workingFileDataVector[fileIndex]->data.empty())
+		m_pendingFileBytes -= fileDataPtr->data.capacity();
+
+		if (!dataPtr.get())
 		{
-			hasChanges = true;
-			break;
+			// Order of pending files does not matter, the last one takes the place of this one
+			const uint32 pendingIndex = fileHeader.pendingIndex;
+			assert(m_pendingFileIndices[pendingIndex] == fileIndex);
+			const uint32 lastFileIndex = m_pendingFileIndices.back();
+			m_pendingFileIndices[pendingIndex] = lastFileIndex;
+			m_workingHeader.fileHeaders[lastFileIndex].pendingIndex = pendingIndex;
+			m_pendingFileIndices.pop_back();
 		}
 	}
-	return hasChanges;
+	else if (dataPtr.get())
+	{
+		fileHeader.pendingIndex = static_cast<uint32>(m_pendingFileIndices.size());
+		m_pendingFileIndices.push_back(fileIndex);
+	}
+
+	if (dataPtr.get())
+	{
+		m_pendingFileBytes += dataPtr->data.capacity();
+	}
+
+	fileDataPtr = dataPtr;
 }
 
 bool CBIGFile::WriteOutPendingFileChanges()
+{
+	if (m_hasPendingFileChanges)
+	{
+		RemoveShadowedDuplicates();
+
+		// Changes are written into the .big file on disk where the header has room for them.
+		// The space of removed and moved files stays unused until too much of the .big file is unused.
+		if (!CanWriteOutInPlace() || !WriteOutInPlace())
+		{
+			WriteOutWholeFile();
+		}
+	}
+
+	return !m_hasPendingFileChanges;
+}
+
+bool CBIGFile::CanWriteOutInPlace() const
+{
+	if (!m_physicalHeader.bigHeader.IsGood())
+		return false;
+
+	// Files that are not on disk must have data to write
+	uint64 usedSize = 0;
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+		if (fileHeader.removed)
+			continue;
+		if (!fileHeader.physical && !m_workingFileDataVector[fileIndex].get())
+			return false;
+		usedSize += fileHeader.size;
+	}
+
+	// New file data and changed file data that is not written over the old is appended
+	uint64 appendedSize = 0;
+	const uint32 pendingFileCount = m_pendingFileIndices.size();
+	for (uint32 pendingIndex = 0; pendingIndex < pendingFileCount; ++pendingIndex)
+	{
+		const uint32 fileIndex = m_pendingFileIndices[pendingIndex];
+		const TConstDataPtr& fileDataPtr = m_workingFileDataVector[fileIndex];
+		assert(fileDataPtr.get());
+
+		if (!CanOverwriteFileData(fileIndex))
+			appendedSize += fileDataPtr->GetSize() + m_payloadAlignment;
+	}
+
+	// The new header must fit in place of the header on disk and its free space after
+	const uint32 headerSpace = GetHeaderSpaceOnDisk();
+	const uint32 headerSize = SBigHeader::SizeOnDisk() + GetSizeOnDisk(m_workingHeader.fileHeaders) + SBigLastHeader::SizeOnDisk();
+	if (headerSize > headerSpace)
+		return false;
+
+	const uint64 bigFileSize = m_physicalHeader.bigHeader.bigFileSize + appendedSize;
+	if (bigFileSize > 0xFFFFFFFFu)
+		return false;
+
+	usedSize += headerSpace;
+	const uint64 unusedSize = bigFileSize > usedSize ? bigFileSize - usedSize : 0;
+	return unusedSize * 100 <= bigFileSize * m_compactionThreshold;
+}
+
+bool CBIGFile::CanOverwriteFileData(uint32 fileIndex) const
+{
+	// Changed file data is written over the old file data if it fits there and the .big file
+	// is not asked to survive interruptions. Otherwise it is appended and the old file data is
+	// left alone, because the header on disk refers to it until the new header is written.
+	const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+	const TConstDataPtr& fileDataPtr = m_workingFileDataVector[fileIndex];
+	return m_durability == filesystem::eDurability_None
+		&& fileHeader.physical
+		&& fileDataPtr.get() != NULL
+		&& fileDataPtr->GetSize() <= m_physicalHeader.fileHeaders[fileHeader.physicalIndex].size;
+}
+
+bool CBIGFile::WriteOutInPlace()
+{
+	// New file data and changed file data that cannot be overwritten is written after
+	// the end of the file data on disk. Then the header is written over the old header.
+	// Unless file data was overwritten, the header on disk refers to untouched file data
+	// until then, so an interrupted write of file data leaves the .big file as it was.
+	// Only the write of the header itself is not done in one step.
+	STATS_SCOPED_PHASE(stats::ePhase_WriteOut);
+	TRACE_SCOPED_EVENT("in place write");
+
+	CloseFileStream();
+
+	filesystem::CUpdateFile updateFile;
+	bool ok = updateFile.Open(m_bigFileName.c_str());
+	stats::AddCount(stats::eCounter_FileOpen);
+
+	// Unchanged and overwritten file data stays where it is on disk
+	uint64 writtenSize = 0;
+	uint32 appendPosition = m_physicalHeader.bigHeader.bigFileSize;
+	uint32 fileEnd = appendPosition;
+	TData fileData;
+	const uint32 fileCount = m_workingHeader.fileHeaders.size();
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	{
+		SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+		if (fileHeader.removed)
+			continue;
+
+		if (fileHeader.physical && (!m_workingFileDataVector[fileIndex].get() || CanOverwriteFileData(fileIndex)))
+		{
+			fileHeader.offset = m_physicalHeader.fileHeaders[fileHeader.physicalIndex].offset;
+		}
+		else
+		{
+			if (m_payloadAlignment > 1 && fileHeader.size >= m_minAlignedPayloadSize)
+			{
+				const uint32 remainder = appendPosition % m_payloadAlignment;
+				if (remainder != 0)
+					appendPosition += m_payloadAlignment - remainder;
+			}
+			fileHeader.offset = appendPosition;
+			appendPosition += fileHeader.size;
+		}
+	}
+
+	// Only pending file data is written
+	const uint32 pendingFileCount = m_pendingFileIndices.size();
+	for (uint32 pendingIndex = 0; ok && pendingIndex < pendingFileCount; ++pendingIndex)
+	{
+		const uint32 fileIndex = m_pendingFileIndices[pendingIndex];
+		const TConstDataPtr& fileDataPtr = m_workingFileDataVector[fileIndex];
+		assert(fileDataPtr.get());
+
+		const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[fileIndex];
+		TRACE_SCOPED_EVENT("entry write", fileHeader.name.c_str());
+		assert(fileHeader.size == fileDataPtr->GetSize());
+
+		if (fileDataPtr->HasSourceFile())
+		{
+			fileData.resize(fileDataPtr->sourceSize);
+			ok = fileData.empty() || fileDataPtr->sourceFilePtr->file.ReadAt(&fileData[0], fileData.size(), fileDataPtr->sourceOffset);
+			ok = ok && updateFile.WriteAt(fileData.data(), fileData.size(), fileHeader.offset);
+		}
+		else
+		{
+			ok = updateFile.WriteAt(fileDataPtr->data.data(), fileDataPtr->data.size(), fileHeader.offset);
+		}
+		stats::AddCount(stats::eCounter_FileWrite);
+		writtenSize += fileHeader.size;
+		fileEnd = std::max(fileEnd, fileHeader.offset + fileHeader.size);
+	}
+
+	if (ok && appendPosition > fileEnd)
+	{
+		// Fill gap in front of aligned empty file data at the end with zeros
+		fileData.assign(appendPosition - fileEnd, 0);
+		ok = updateFile.WriteAt(fileData.data(), fileData.size(), fileEnd);
+		stats::AddCount(stats::eCounter_FileWrite);
+	}
+
+	// File data must be on disk before the header refers to it
+	ok = ok && (writtenSize == 0 || m_durability == filesystem::eDurability_None || updateFile.Sync());
+
+	SBigHeader bigHeader = m_physicalHeader.bigHeader;
+	const uint32 bigHeaderSize = bigHeader.SizeOnDisk();
+	const uint32 fileHeadersSize = GetSizeOnDisk(m_workingHeader.fileHeaders);
+	bigHeader.bigFileSize = appendPosition;
+	bigHeader.fileCount = GetWrittenFileCount(m_workingHeader.fileHeaders);
+	bigHeader.headerSize = bigHeaderSize + fileHeadersSize + m_workingHeader.lastHeader.SizeOnDisk();
+
+	TData newHeaderData;
+	newHeaderData.resize(bigHeader.headerSize);
+
+	ok = ok && WriteBigHeaderToData(newHeaderData, bigHeader);
+	ok = ok && WriteFileHeadersToData(newHeaderData, m_workingHeader.fileHeaders, bigHeaderSize);
+	ok = ok && WriteLastHeaderToData(newHeaderData, m_workingHeader.lastHeader, bigHeaderSize + fileHeadersSize);
+	ok = ok && updateFile.WriteAt(newHeaderData.data(), newHeaderData.size(), 0);
+	stats::AddCount(stats::eCounter_FileWrite);
+	ok = ok && (m_durability == filesystem::eDurability_None || updateFile.Sync());
+	updateFile.Close();
+
+	if (ok)
+	{
+		stats::AddPhaseBytes(stats::ePhase_WriteOut, writtenSize + newHeaderData.size());
+		m_workingHeader.bigHeader = bigHeader;
+		ClearPendingFileChanges();
+		EraseRemovedFiles();
+		SetAllFilesPhysical();
+		m_hasPendingFileChanges = false;
+	}
+
+	OpenFileStream();
+	return ok;
+}
+
+void CBIGFile::WriteOutWholeFile()
 {
 	// Writing out a change to a .big file is not that straight forward.
 	// To change a file, the big header and file header must be updated and
 	// the whole .big file data needs to be written out to a new temporary file.
+	STATS_SCOPED_PHASE(stats::ePhase_WriteOut);
+	TRACE_SCOPED_EVENT("flush");
 
-	if (m_hasPendingFileChanges)
+	// The original file stays untouched until the new file replaces it on commit
+	filesystem::CReplaceFile replaceFile;
+	const bool newFileCreated = replaceFile.Create(m_bigFileName.c_str(), m_durability, m_syncBatchBytes);
+	stats::AddCount(stats::eCounter_FileOpen);
+
+	if (newFileCreated)
 	{
-		bool newFileCreated = false;
-		const std::wstring newFilename = utils::AppendRandomNumbers(m_bigFileName, 8);
+		CSequentialWriter writer(replaceFile, m_writeBufferSize);
+		TIntegers fileLayout;
+		BuildFileLayout(fileLayout);
+		BuildBigHeaderAndFileHeaders(m_workingHeader.bigHeader, m_workingHeader.fileHeaders, m_workingFileDataVector, fileLayout, m_payloadAlignment, m_minAlignedPayloadSize, m_headerReserve);
 
-		std::ios::openmode mode = std::ios::out | std::ios::binary;
-		std::ofstream ofstream;
-		ofstream.open(newFilename.c_str(), mode);
-		newFileCreated = ofstream.is_open();
+		const uint32 bigHeaderSize = m_workingHeader.bigHeader.SizeOnDisk();
+		const uint32 fileHeadersSize = GetSizeOnDisk(m_workingHeader.fileHeaders);
+		const uint32 lastHeaderSize = m_workingHeader.lastHeader.SizeOnDisk();
 
-		if (newFileCreated)
+		TData newHeaderData;
+		newHeaderData.resize(bigHeaderSize + fileHeadersSize + lastHeaderSize);
+
+		bool ok = true;
+		ok = ok && WriteBigHeaderToData(newHeaderData, m_workingHeader.bigHeader);
+		ok = ok && WriteFileHeadersToData(newHeaderData, m_workingHeader.fileHeaders, bigHeaderSize);
+		ok = ok && WriteLastHeaderToData(newHeaderData, m_workingHeader.lastHeader, bigHeaderSize + fileHeadersSize);
+
+		if (ok)
 		{
-			const uint32 bigHeaderSize = m_workingHeader.bigHeader.SizeOnDisk();
-			const uint32 fileHeadersSize = GetSizeOnDisk(m_workingHeader.fileHeaders);
-			const uint32 lastHeaderSize = m_workingHeader.lastHeader.SizeOnDisk();
+			ok = ok && writer.Write(newHeaderData.data(), newHeaderData.size());
+			const uint32 workingFileCount = static_cast<uint32>(m_workingHeader.fileHeaders.size());
+			const uint32 maxFileSize = GetMaxFileSize(m_workingHeader.fileHeaders);
+			TData fileData;
+			fileData.reserve(maxFileSize);
+			uint32 writePosition = static_cast<uint32>(newHeaderData.size());
+
+			for (uint32 layoutIndex = 0; layoutIndex < workingFileCount; ++layoutIndex)
+			{
+				const uint32 workingFileIndex = fileLayout[layoutIndex];
+				const TConstDataPtr& newFileDataPtr = m_workingFileDataVector[workingFileIndex];
+				const SBigFileHeaderEx& workingFileHeader = m_workingHeader.fileHeaders[workingFileIndex];
 
-			TData newHeaderData;
-			newHeaderData.resize(bigHeaderSize + fileHeadersSize + lastHeaderSize);
+				if (workingFileHeader.removed)
+					continue;
 
-			bool ok = true;
-			ok = ok && WriteBigHeaderToData(newHeaderData, m_workingHeader.bigHeader);
-			ok = ok && WriteFileHeadersToData(newHeaderData, m_workingHeader.fileHeaders, bigHeaderSize);
-			ok = ok && WriteLastHeaderToData(newHeaderData, m_workingHeader.lastHeader, bigHeaderSize + fileHeadersSize);
+				TRACE_SCOPED_EVENT("entry write", workingFileHeader.name.c_str());
 
-			if (ok)
-			{
-				ok = ok && WriteDataToStream(newHeaderData, ofstream);
-				const uint32 workingFileCount = static_cast<uint32>(m_workingHeader.fileHeaders.size());
-				const uint32 maxFileSize = GetMaxFileSize(m_workingHeader.fileHeaders);
-				TData fileData;
-				fileData.reserve(maxFileSize);
-				uint32 workingFileIndex = 0;
-				uint32 physicalFileIndex = 0;
-
-				for (; workingFileIndex < workingFileCount; ++workingFileIndex)
+				if (workingFileHeader.offset > writePosition)
 				{
-					const TDataPtr& newFileDataPtr = m_workingFileDataVector[workingFileIndex];
-
-					if (!newFileDataPtr.get())
-					{
-						if (m_fstream.is_open() && m_fstream.good())
-						{
-							// Transfer file data from original .big file to new .big file
-							assert(physicalFileIndex < static_cast<uint32>(m_physicalHeader.fileHeaders.size()));
-							const SBigFileHeader& fileHeader = m_physicalHeader.fileHeaders[physicalFileIndex];
-							fileData.resize(fileHeader.size);
-							ok = ok && ReadDataFromStream(fileData, m_fstream, fileHeader.offset);
-							ok = ok && WriteDataToStream(fileData, ofstream);
-						}
-					}
-					else
-					{
-						// Save new file data to new .big file
-						ok = ok && WriteDataToStream(newFileDataPtr->data, ofstream);
-					}
+					// Fill gap in front of aligned file data with zeros
+					ok = ok && writer.WriteZeros(workingFileHeader.offset - writePosition);
+				}
+				writePosition = workingFileHeader.offset + workingFileHeader.size;
 
-					const SBigFileHeaderEx& fileHeader = m_workingHeader.fileHeaders[workingFileIndex];
-					if (fileHeader.physical)
+				if (!newFileDataPtr.get())
+				{
+					// File data that cannot be read would move all file data after it away
+					// from the offsets in the header, so the new file must not replace the original
+					ok = ok && m_fstream.is_open() && m_fstream.good();
+					if (ok)
 					{
-						++physicalFileIndex;
+						// Transfer file data from original .big file to new .big file
+						assert(workingFileHeader.physical);
+						assert(workingFileHeader.physicalIndex < static_cast<uint32>(m_physicalHeader.fileHeaders.size()));
+						const SBigFileHeader& fileHeader = m_physicalHeader.fileHeaders[workingFileHeader.physicalIndex];
+						fileData.resize(fileHeader.size);
+						ok = ok && ReadDataFromStream(fileData, m_fstream, fileHeader.offset);
+						ok = ok && writer.Write(fileData.data(), fileData.size());
 					}
 				}
-
-				if (ok)
+				else if (newFileDataPtr->HasSourceFile())
 				{
-					ofstream.close();
-					CloseFileStream();
+					// Copy file data from its source file to new .big file
+					ok = ok && writer.CopyFrom(newFileDataPtr->sourceFilePtr->file, newFileDataPtr->sourceOffset, newFileDataPtr->sourceSize);
+				}
+				else
+				{
+					// Save new file data to new .big file
+					ok = ok && writer.Write(newFileDataPtr->data.data(), newFileDataPtr->data.size());
+				}
+			}
 
-					// Replace the new written file with the original file
-					if (::DeleteFileW(m_bigFileName.c_str()) != FALSE)
-					{
-						if (::MoveFileW(newFilename.c_str(), m_bigFileName.c_str()) != FALSE)
-						{
-							for (uint32 fileIndex = 0; fileIndex < workingFileCount; ++fileIndex)
-							{
-								m_workingHeader.fileHeaders[fileIndex].physical = true;
-							}
-							m_physicalHeader.Copy(m_workingHeader);
-							ClearPendingFileChanges();
-							BuildFileHeaderIndices(m_workingFileHeaderIndices, m_workingHeader.fileHeaders);
-
-							newFileCreated = false;
-							m_hasPendingFileChanges = false;
-						}
-					}
+			if (m_workingHeader.bigHeader.bigFileSize > writePosition)
+			{
+				// Fill header reserve of .big file without file data
+				ok = ok && writer.WriteZeros(m_workingHeader.bigHeader.bigFileSize - writePosition);
+			}
+
+			ok = ok && writer.Flush();
+			assert(!ok || writer.GetPosition() == m_workingHeader.bigHeader.bigFileSize);
+
+			if (ok)
+			{
+				stats::AddPhaseBytes(stats::ePhase_WriteOut, m_workingHeader.bigHeader.bigFileSize);
+				CloseFileStream();
+
+				// Replace the original file with the new written file
+				if (replaceFile.Commit())
+				{
+					ClearPendingFileChanges();
+					EraseRemovedFiles();
+					SetAllFilesPhysical();
+					BuildFileHeaderIndices(m_workingFileHeaderIndices, m_workingHeader.fileHeaders);
+					m_workingFileHeaderIndicesValid = true;
 
-					OpenFileStream();
+					m_hasPendingFileChanges = false;
 				}
-			}
-		}
 
-		if (newFileCreated)
-		{
-			::DeleteFileW(newFilename.c_str());
+				OpenFileStream();
+			}
 		}
 	}
+}
 
-	return !m_hasPendingFileChanges;
+void CBIGFile::SetLayoutPolicy(const CLayoutPolicy* pLayoutPolicy)
+{
+	// Policy is not owned and must outlive the write out
+	m_pLayoutPolicy = pLayoutPolicy;
+}
+
+void CBIGFile::SetDurability(filesystem::EDurability durability, uint64 syncBatchBytes)
+{
+	// How hard write out pushes new .big files to the storage device
+	m_durability = durability;
+	m_syncBatchBytes = syncBatchBytes;
+}
+
+void CBIGFile::SetWriteBufferSize(size_t bufferSize)
+{
+	// Write out collects data in a buffer of this size before passing it to the file
+	m_writeBufferSize = bufferSize;
+}
+
+void CBIGFile::SetCompactionThreshold(uint32 percent)
+{
+	// Removed and changed files leave unused space behind when only the header is written out.
+	// Once more than this percent of the .big file is unused, the whole file is written out.
+	m_compactionThreshold = percent;
+}
+
+void CBIGFile::SetHeaderReserve(uint32 reserveSize)
+{
+	// Whole write outs leave this many bytes free after the header. The header can grow into
+	// them with renames and new files, without moving file data. Opening a .big file keeps
+	// the free space that it has.
+	m_headerReserve = reserveSize;
+}
+
+uint32 CBIGFile::GetHeaderReserve() const
+{
+	return m_headerReserve;
+}
+
+void CBIGFile::SetPayloadAlignment(uint32 alignment, uint32 minAlignedSize)
+{
+	// Aligned file data can be memory mapped or read with unbuffered I/O without
+	// straddling pages. Small files are not worth the padding and stay packed.
+	m_payloadAlignment = alignment;
+	m_minAlignedPayloadSize = minAlignedSize;
 }
 
 void CBIGFile::ClearPendingFileChanges()
 {
-	// Clears the data at each index in the data vector and keeps its size
-	const uint32 fileCount = m_workingFileDataVector.size();
-	for (uint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+	// Clears the data at each pending index in the data vector and keeps its size
+	const uint32 pendingFileCount = m_pendingFileIndices.size();
+	for (uint32 pendingIndex = 0; pendingIndex < pendingFileCount; ++pendingIndex)
 	{
-		m_workingFileDataVector[fileIndex].reset();
+		m_workingFileDataVector[m_pendingFileIndices[pendingIndex]].reset();
 	}
+	m_pendingFileIndices.clear();
+	m_pendingFileBytes = 0;
 }
 
 bool CBIGFile::HasBigFileExtension(const wchar_t* wcsBigFileName)
@@ -864,6 +1727,6 @@ void CBIGFile::ApplySimplifiedCharset(std::string& str)
 	const size_t len = str.size();
 	for (size_t i = 0; i < len; ++i)
 	{
-		str[i] = s_simplified_charset[static_cast<size_t>(str[i])];
+		str[i] = s_simplified_charset[static_cast<uint8>(str[i])];
 	}
 }
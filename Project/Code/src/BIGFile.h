@@ -6,6 +6,10 @@
 #include "types.h"
 #include "utildef.h"
 #include "smartptr.h"
+#include "Buffer.h"
+#include "FileSystem.h"
+
+class CLayoutPolicy;
 
 // --- BIG HEADER
 // .BIG signature (4 bytes) - it must be 0x46474942 - 'BIGF'
@@ -25,17 +29,79 @@
 class CBIGFile
 {
 public:
-	typedef std::vector<char> TData;
+	typedef CBuffer TData;
+
+	// Reference counted file that file data can be copied from
+	struct SSourceFile : public _reference_target_t
+	{
+		filesystem::CInputFile file;
+	};
 
+	typedef _smart_ptr<SSourceFile> TSourceFilePtr;
+
+	// Reference counted file data. Pass data around by TDataPtr to share it without copies.
+	// Data once handed over is shared as TConstDataPtr, so that it cannot change under its holders.
+	// Data can also stay in a range of a source file, which write out copies without reading it.
 	struct SDataRef : public _reference_target_t
 	{
-		explicit SDataRef(const TData& data) : data(data) {}
+		SDataRef() : data(), sourceFilePtr(), sourceOffset(0), sourceSize(0) {}
+		explicit SDataRef(const TData& data) : data(data), sourceFilePtr(), sourceOffset(0), sourceSize(0) {}
+		SDataRef(const TSourceFilePtr& sourceFilePtr, uint64 sourceOffset, uint32 sourceSize)
+			: data(), sourceFilePtr(sourceFilePtr), sourceOffset(sourceOffset), sourceSize(sourceSize) {}
+
+		bool HasSourceFile() const { return sourceFilePtr.get() != NULL; }
+		size_t GetSize() const { return HasSourceFile() ? sourceSize : data.size(); }
 
 		TData data;
+		TSourceFilePtr sourceFilePtr;
+		uint64 sourceOffset;
+		uint32 sourceSize;
 	};
 	
 	typedef _smart_ptr<SDataRef> TDataPtr;
-	typedef std::vector<TDataPtr> TDataPtrVector;
+	typedef _smart_ptr<const SDataRef> TConstDataPtr;
+	typedef std::vector<TConstDataPtr> TDataPtrVector;
+
+	// Reads the data of one file piece by piece, so that large files need not fit in memory.
+	// Data in a file is read at its position through a buffer of bounded size.
+	// Readers of the .big file itself are to be released before its next write out.
+	class CEntryReader : public _reference_target_t
+	{
+	public:
+		enum : uint32
+		{
+			DefaultBufferSize = 64 * 1024,
+		};
+
+		CEntryReader(const TSourceFilePtr& sourceFilePtr, uint64 offset, uint32 size, uint32 bufferSize = DefaultBufferSize);
+		explicit CEntryReader(const TConstDataPtr& dataPtr);
+
+		// Returns the bytes read, which are fewer than requested at the end or on a read error
+		size_t Read(char* data, size_t size);
+		// Moves the read position, which cannot go past the end
+		bool Seek(uint32 position);
+
+		uint32 GetSize() const;
+		uint32 GetPosition() const;
+		bool HasReadError() const;
+
+	private:
+		CEntryReader(const CEntryReader&);
+		CEntryReader& operator=(const CEntryReader&);
+
+		TSourceFilePtr m_sourceFilePtr;
+		TConstDataPtr m_dataPtr;
+		uint64 m_offset;
+		uint32 m_size;
+		uint32 m_position;
+		TData m_buffer;
+		uint32 m_bufferPosition; // Read position of the first byte in the buffer
+		uint32 m_bufferSize;
+		bool m_hasReadError;
+	};
+
+	typedef _smart_ptr<CEntryReader> TEntryReaderPtr;
+	typedef std::vector<uint32> TFileIds;
 	typedef uint32 TFlags;
 
 	enum EFlags : uint32
@@ -48,6 +114,11 @@ public:
 		eFlags_WriteOutOnDestruct = BIT(5),
 	};
 
+	enum : uint32
+	{
+		DefaultCompactionThreshold = 25,
+	};
+
 private:
 	struct SBigHeader
 	{
@@ -119,11 +190,17 @@ private:
 			, simplifiedName()
 			, ignore(false)
 			, physical(false)
+			, removed(false)
+			, physicalIndex(0)
+			, pendingIndex(0)
 		{}
 
 		std::string simplifiedName; // File name that this header refers to and is reflected to the user of this class
 		bool ignore;                // Whether or not this header is ignored for access
 		bool physical;              // Whether ot not this file already exists on disk
+		bool removed;               // Whether or not this file is dropped on write out
+		uint32 physicalIndex;       // Index of the file header on disk, if physical
+		uint32 pendingIndex;        // Index in the list of files with pending data, if data is pending
 	};
 
 	struct SBigLastHeader
@@ -183,9 +260,15 @@ public:
 
 	bool IsOpen() const;
 	uint32 GetFileCount() const;
+	// Count of files in the .big file on disk, including ignored duplicates
+	uint32 GetPhysicalFileCount() const;
+	// Bytes of the .big file on disk that no file refers to
+	uint32 GetUnusedSizeOnDisk() const;
 
 	bool        SetFileNameById(uint32 id, const char* szName);
 	const char* GetFileNameById(uint32 id) const;
+	// Name as written in the .big file, also when names are simplified
+	const char* GetStoredFileNameById(uint32 id) const;
 	void        SetCurrentFileId(uint32 id);
 	uint32      GetCurrentFileId() const;
 
@@ -194,19 +277,55 @@ public:
 	const char* GetFirstFileName();
 	const char* GetNextFileName();
 
+	uint32 GetFileOffsetById(uint32 id) const;
+	uint32 GetFileSizeById(uint32 id) const;
+
+	// Name lookups use a sorted name index that is built on first use after a change.
+	// Returns the id of the last file with the name, or GetFileCount() if there is none.
+	uint32 FindFileIdByName(const char* szName) const;
+	// Adds the ids of all files whose name starts with the prefix, in name order
+	void FindFileIdsByPrefix(TFileIds& fileIds, const char* szPrefix) const;
+
+	// Functions taking TData copy it. Functions taking a data pointer share it and
+	// expect the caller to not modify the data afterwards. Shared data is read as const.
 	bool AddNewFile(const char* szName, const TData& data, bool immediateWriteOut = false);
 	bool AddNewFile(uint32 id, const char* szName, const TData& data, bool immediateWriteOut = false);
+	bool AddNewFile(const char* szName, const TConstDataPtr& dataPtr, bool immediateWriteOut = false);
+	bool AddNewFile(uint32 id, const char* szName, const TConstDataPtr& dataPtr, bool immediateWriteOut = false);
+
+	// Removes a file on write out. Ids of the files after it move down by one on next use of ids
+	// other than for removing, so removing many files by id or name does not renumber each time.
+	// Until then ids of a row of removals by id refer to the files they did before the first.
+	bool RemoveFileById(uint32 id);
+	bool RemoveFileByName(const char* szName);
 
 	bool ReadFileDataById(uint32 id, TData& data);
+	bool ReadFileDataById(uint32 id, TConstDataPtr& dataPtr);
+	// Returns a reader of the file data, or NULL if there is no such file or it cannot be read
+	TEntryReaderPtr OpenEntryReader(uint32 id);
 	bool WriteFileDataById(uint32 id, const TData& data, bool immediateWriteOut = false);
+	bool WriteFileDataById(uint32 id, const TConstDataPtr& dataPtr, bool immediateWriteOut = false);
 
 	bool ReadDataFromCurrentFile(TData& data);
+	bool ReadDataFromCurrentFile(TConstDataPtr& dataPtr);
 	bool WriteDataToCurrentFile(const TData& data, bool immediateWriteOut = false);
+	bool WriteDataToCurrentFile(const TConstDataPtr& dataPtr, bool immediateWriteOut = false);
 
 	bool HasPendingFileChanges() const;
+	// Count of files with data held in memory until write out, and the memory that data takes
+	uint32 GetPendingFileCount() const;
+	uint64 GetPendingFileBytes() const;
 	bool WriteOutPendingFileChanges();
 	void ClearPendingFileChanges();
 
+	void SetLayoutPolicy(const CLayoutPolicy* pLayoutPolicy);
+	void SetPayloadAlignment(uint32 alignment, uint32 minAlignedSize);
+	void SetDurability(filesystem::EDurability durability, uint64 syncBatchBytes = filesystem::CReplaceFile::DefaultSyncBatchBytes);
+	void SetWriteBufferSize(size_t bufferSize);
+	void SetCompactionThreshold(uint32 percent);
+	void SetHeaderReserve(uint32 reserveSize);
+	uint32 GetHeaderReserve() const;
+
 	static bool HasBigFileExtension(const wchar_t* wcsBigFileName);
 
 	static const char* GetSimplifiedCharset();
@@ -222,8 +341,30 @@ private:
 	SBigFileHeaderEx* GetFileHeader(uint32 id);
 	const SBigFileHeaderEx* GetFileHeader(uint32 id) const;
 
+	const TIntegers& GetFileHeaderIndices() const;
+	uint32 GetFileIdByIndex(uint32 fileIndex) const;
+
+	struct SNameIndexLess;
+	const TFileIds& GetNameIndex() const;
+	uint32 FindFileIndexByName(const char* szName) const;
+
+	uint32 GetHeaderSpaceOnDisk() const;
+
+	// Reads file data that is not held in memory, from its source file or the .big file
+	bool ReadUnloadedFileData(uint32 fileIndex, TData& data);
+	void SetPendingFileData(uint32 fileIndex, const TConstDataPtr& dataPtr);
+
+	void RemoveFileByIndex(uint32 fileIndex);
+	void RemoveShadowedDuplicates();
+	void EraseRemovedFiles();
+	void SetAllFilesPhysical();
+
+	bool CanWriteOutInPlace() const;
+	bool CanOverwriteFileData(uint32 fileIndex) const;
+	bool WriteOutInPlace();
+	void WriteOutWholeFile();
+
 	static bool ReadDataFromStream(TData& data, std::istream& istream, uint32 offset = 0u);
-	static bool WriteDataToStream(const TData& data, std::ostream& ostream, uint32 offset = 0xFFFFFFFFu);
 
 	static bool ReadBigHeaderFromData(SBigHeader& bigHeader, const TData& data);
 	static bool WriteBigHeaderToData(TData& data, const SBigHeader& bigHeader);
@@ -234,10 +375,13 @@ private:
 	static bool ReadLastHeaderFromData(SBigLastHeader& lastHeader, const TData& data, uint32 offset = 0u);
 	static bool WriteLastHeaderToData(TData& data, const SBigLastHeader& lastHeader, uint32 offset = 0u);
 
+	void BuildFileLayout(TIntegers& fileLayout) const;
+
 	static void BuildFileHeaderIndices(TIntegers& fileHeaderIndices, const TBigFileHeadersEx& fileHeaders);
-	static void BuildBigHeaderAndFileHeaders(SBigHeader& bigHeader, TBigFileHeadersEx& fileHeaders, const TDataPtrVector& fileDataVector);
+	static void BuildBigHeaderAndFileHeaders(SBigHeader& bigHeader, TBigFileHeadersEx& fileHeaders, const TDataPtrVector& fileDataVector, const TIntegers& fileLayout = TIntegers(), uint32 alignment = 0, uint32 minAlignedSize = 0, uint32 headerReserve = 0);
 
 	static uint32 GetSizeOnDisk(const TBigFileHeadersEx& fileHeaders);
+	static uint32 GetWrittenFileCount(const TBigFileHeadersEx& fileHeaders);
 	static uint32 GetMaxFileSize(const TBigFileHeadersEx& fileHeaders);
 
 private:
@@ -249,11 +393,42 @@ private:
 	// File data that exists in memory only and can be written to .big file
 	TDataPtrVector m_workingFileDataVector;
 
-	// Contains indexes to all usable files inside .big file
-	TIntegers m_workingFileHeaderIndices;
+	// Indexes of files with data in the data vector, and memory of that data
+	TIntegers m_pendingFileIndices;
+	uint64 m_pendingFileBytes;
+
+	// Contains indexes to all usable files inside .big file, if valid
+	mutable TIntegers m_workingFileHeaderIndices;
+	mutable bool m_workingFileHeaderIndicesValid;
+	// Set while the indices are out of date only by removed files, which removing by id still uses
+	mutable bool m_workingFileHeaderIndicesRemovedOnly;
+
+	// Contains indexes of all usable files sorted by name, if valid
+	mutable TFileIds m_nameIndex;
+	mutable bool m_nameIndexValid;
 
 	std::wstring m_bigFileName;
 	std::fstream m_fstream;
+	// The .big file opened for positional reads on first use, until the file stream closes
+	TSourceFilePtr m_inputFilePtr;
+
+	// Optional order in which file data is laid out on write out
+	const CLayoutPolicy* m_pLayoutPolicy;
+
+	// Optional alignment of file data on write out
+	uint32 m_payloadAlignment;
+	uint32 m_minAlignedPayloadSize;
+
+	// Flushing of new .big file on write out
+	filesystem::EDurability m_durability;
+	uint64 m_syncBatchBytes;
+	size_t m_writeBufferSize;
+
+	// Percent of the .big file that may be unused before write out rewrites the whole file
+	uint32 m_compactionThreshold;
+
+	// Bytes left free after the header on write out
+	uint32 m_headerReserve;
 
 	uint32 m_fileId;
 	TFlags m_flags;
@@ -0,0 +1,204 @@
+#include "Buffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+
+CBufferPool::CBufferPool()
+: m_cachedBytes(0)
+, m_maxCachedBytes(64u * 1024u * 1024u)
+{
+	for (uint32 classIndex = 0; classIndex < ClassCount; ++classIndex)
+	{
+		m_freeBlocks[classIndex] = NULL;
+	}
+}
+
+CBufferPool::~CBufferPool()
+{
+	Trim();
+}
+
+CBufferPool& CBufferPool::GetInstance()
+{
+	// Intentionally never destroyed, because static buffers may be freed after static destruction
+	static CBufferPool* s_pBufferPool = new CBufferPool();
+	return *s_pBufferPool;
+}
+
+bool CBufferPool::GetClassIndex(uint32& classIndex, size_t& classSize, size_t size)
+{
+	classIndex = 0;
+	classSize = size_t(1) << MinClassShift;
+	if (size <= classSize)
+		return true;
+
+	// Find the power of 2 below the size, then the quarter step above it
+	uint32 shift = MinClassShift;
+	while ((size_t(2) << shift) < size)
+	{
+		if (++shift >= MaxClassShift)
+			return false;
+	}
+
+	const size_t powerSize = size_t(1) << shift;
+	const size_t stepSize = powerSize >> SubClassShift;
+	const size_t stepCount = (size - powerSize + stepSize - 1) / stepSize;
+	classIndex = ((shift - MinClassShift) << SubClassShift) + static_cast<uint32>(stepCount);
+	classSize = powerSize + stepCount * stepSize;
+	return true;
+}
+
+char* CBufferPool::Allocate(size_t& size)
+{
+	uint32 classIndex = 0;
+	size_t classSize = 0;
+	if (!GetClassIndex(classIndex, classSize, size))
+	{
+		// Too large to pool
+		return static_cast<char*>(::operator new(size));
+	}
+
+	size = classSize;
+
+	{
+		CScopedLock lock(m_mutex);
+		if (SFreeBlock* pBlock = m_freeBlocks[classIndex])
+		{
+			m_freeBlocks[classIndex] = pBlock->pNext;
+			m_cachedBytes -= size;
+			return reinterpret_cast<char*>(pBlock);
+		}
+	}
+
+	return static_cast<char*>(::operator new(size));
+}
+
+void CBufferPool::Free(char* pBlock, size_t size)
+{
+	if (pBlock == NULL)
+		return;
+
+	uint32 classIndex = 0;
+	size_t classSize = 0;
+	if (GetClassIndex(classIndex, classSize, size) && size == classSize)
+	{
+		CScopedLock lock(m_mutex);
+		if (m_cachedBytes + size <= m_maxCachedBytes)
+		{
+			SFreeBlock* pFreeBlock = reinterpret_cast<SFreeBlock*>(pBlock);
+			pFreeBlock->pNext = m_freeBlocks[classIndex];
+			m_freeBlocks[classIndex] = pFreeBlock;
+			m_cachedBytes += size;
+			return;
+		}
+	}
+
+	::operator delete(pBlock);
+}
+
+void CBufferPool::Trim()
+{
+	CScopedLock lock(m_mutex);
+	for (uint32 classIndex = 0; classIndex < ClassCount; ++classIndex)
+	{
+		while (SFreeBlock* pBlock = m_freeBlocks[classIndex])
+		{
+			m_freeBlocks[classIndex] = pBlock->pNext;
+			::operator delete(pBlock);
+		}
+	}
+	m_cachedBytes = 0;
+}
+
+
+CBuffer::CBuffer()
+: m_pData(NULL)
+, m_size(0)
+, m_capacity(0)
+{
+}
+
+CBuffer::CBuffer(size_t size)
+: m_pData(NULL)
+, m_size(0)
+, m_capacity(0)
+{
+	resize(size);
+}
+
+CBuffer::CBuffer(const CBuffer& other)
+: m_pData(NULL)
+, m_size(0)
+, m_capacity(0)
+{
+	assign(other.begin(), other.end());
+}
+
+CBuffer::~CBuffer()
+{
+	CBufferPool::GetInstance().Free(m_pData, m_capacity);
+}
+
+CBuffer& CBuffer::operator=(const CBuffer& other)
+{
+	if (this != &other)
+	{
+		assign(other.begin(), other.end());
+	}
+	return *this;
+}
+
+void CBuffer::resize(size_t size)
+{
+	reserve(size);
+	m_size = size;
+}
+
+void CBuffer::reserve(size_t capacity)
+{
+	if (capacity > m_capacity)
+	{
+		char* pData = CBufferPool::GetInstance().Allocate(capacity);
+		if (m_size != 0)
+		{
+			::memcpy(pData, m_pData, m_size);
+		}
+		CBufferPool::GetInstance().Free(m_pData, m_capacity);
+		m_pData = pData;
+		m_capacity = capacity;
+	}
+}
+
+void CBuffer::assign(size_t size, char value)
+{
+	clear();
+	resize(size);
+	if (size != 0)
+	{
+		::memset(m_pData, value, size);
+	}
+}
+
+void CBuffer::assign(const char* pBegin, const char* pEnd)
+{
+	const size_t size = static_cast<size_t>(pEnd - pBegin);
+	clear();
+	resize(size);
+	if (size != 0)
+	{
+		::memcpy(m_pData, pBegin, size);
+	}
+}
+
+void CBuffer::clear()
+{
+	m_size = 0;
+}
+
+void CBuffer::swap(CBuffer& other)
+{
+	std::swap(m_pData, other.m_pData);
+	std::swap(m_size, other.m_size);
+	std::swap(m_capacity, other.m_capacity);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "types.h"
+#include "mutex.h"
+
+// Keeps freed memory blocks in size classes, so that repeated buffers of
+// similar size reuse memory instead of going to the heap. Each power of 2 is
+// split into quarter steps, so that a block is at most a quarter larger than
+// requested. File data can stay in blocks for long until write out.
+
+class CBufferPool
+{
+private:
+	enum : uint32
+	{
+		MinClassShift = 8,  // 256 bytes
+		MaxClassShift = 24, // 16 MB, larger blocks are not pooled
+		SubClassShift = 2,  // 4 size classes per power of 2
+		ClassCount = ((MaxClassShift - MinClassShift) << SubClassShift) + 1,
+	};
+
+	struct SFreeBlock
+	{
+		SFreeBlock* pNext;
+	};
+
+public:
+	CBufferPool();
+	~CBufferPool();
+
+	// Returns block with at least the requested size and sets size to the actual block size
+	char* Allocate(size_t& size);
+	void Free(char* pBlock, size_t size);
+	void Trim();
+
+	static CBufferPool& GetInstance();
+
+private:
+	CBufferPool(const CBufferPool&);
+	CBufferPool& operator=(const CBufferPool&);
+
+	// Finds the smallest size class that holds size and sets classSize to its block size
+	static bool GetClassIndex(uint32& classIndex, size_t& classSize, size_t size);
+
+	SFreeBlock* m_freeBlocks[ClassCount];
+	size_t m_cachedBytes;
+	size_t m_maxCachedBytes;
+	CMutex m_mutex;
+};
+
+// Byte buffer with the interface of std::vector<char> used by this project.
+// Unlike std::vector, resize does not initialize new bytes, because the
+// buffer is usually filled by a file read right after. Memory comes from the buffer pool.
+
+class CBuffer
+{
+public:
+	typedef char value_type;
+	typedef char* iterator;
+	typedef const char* const_iterator;
+
+	CBuffer();
+	explicit CBuffer(size_t size);
+	CBuffer(const CBuffer& other);
+	~CBuffer();
+
+	CBuffer& operator=(const CBuffer& other);
+
+	char& operator[](size_t i) { return m_pData[i]; }
+	const char& operator[](size_t i) const { return m_pData[i]; }
+
+	char* data() { return m_pData; }
+	const char* data() const { return m_pData; }
+	iterator begin() { return m_pData; }
+	iterator end() { return m_pData + m_size; }
+	const_iterator begin() const { return m_pData; }
+	const_iterator end() const { return m_pData + m_size; }
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+	bool empty() const { return m_size == 0; }
+
+	// New bytes are left uninitialized
+	void resize(size_t size);
+	void reserve(size_t capacity);
+	void assign(size_t size, char value);
+	void assign(const char* pBegin, const char* pEnd);
+	void clear();
+	void swap(CBuffer& other);
+
+private:
+	char* m_pData;
+	size_t m_size;
+	size_t m_capacity;
+};
@@ -0,0 +1,101 @@
+#include "EntryStream.h"
+#include "Tar.h"
+#include "platform.h"
+#include <string.h>
+
+
+namespace {
+
+void AppendLittleEndian(std::string& str, uint32 value)
+{
+	str.push_back(static_cast<char>(value & 0xFF));
+	str.push_back(static_cast<char>((value >> 8) & 0xFF));
+	str.push_back(static_cast<char>((value >> 16) & 0xFF));
+	str.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+} // namespace
+
+
+CEntryStreamWriter::CEntryStreamWriter(FILE* pFile, EFormat format)
+: m_pFile(pFile)
+, m_format(format)
+, m_entryDataSize(0)
+{
+}
+
+bool CEntryStreamWriter::WriteEntry(const char* szName, const CBuffer& data)
+{
+	return BeginEntry(szName, static_cast<uint32>(data.size()))
+		&& WriteEntryData(data.data(), data.size())
+		&& EndEntry();
+}
+
+bool CEntryStreamWriter::BeginEntry(const char* szName, uint32 dataSize)
+{
+	m_entryDataSize = dataSize;
+	m_header.clear();
+
+	switch (m_format)
+	{
+	case eFormat_Frame:
+	{
+		const uint32 nameSize = static_cast<uint32>(::strlen(szName));
+		AppendLittleEndian(m_header, nameSize);
+		m_header.append(szName, nameSize);
+		AppendLittleEndian(m_header, dataSize);
+		return Write(m_header.data(), m_header.size());
+	}
+	case eFormat_Tar:
+	{
+		tar::AppendFileHeader(m_header, szName, dataSize);
+		return Write(m_header.data(), m_header.size());
+	}
+	}
+	return false;
+}
+
+bool CEntryStreamWriter::WriteEntryData(const char* data, size_t size)
+{
+	return Write(data, size);
+}
+
+bool CEntryStreamWriter::EndEntry()
+{
+	if (m_format == eFormat_Tar)
+	{
+		m_header.assign(tar::GetPaddingSize(m_entryDataSize), '\0');
+		return Write(m_header.data(), m_header.size());
+	}
+	return true;
+}
+
+bool CEntryStreamWriter::Finish()
+{
+	if (m_format == eFormat_Tar)
+	{
+		m_header.assign(tar::EndSize, '\0');
+		if (!Write(m_header.data(), m_header.size()))
+			return false;
+	}
+	return ::fflush(m_pFile) == 0;
+}
+
+bool CEntryStreamWriter::ParseFormat(EFormat& format, const wchar_t* wcsFormat)
+{
+	if (::_wcsicmp(wcsFormat, L"frame") == 0)
+		format = eFormat_Frame;
+	else if (::_wcsicmp(wcsFormat, L"tar") == 0)
+		format = eFormat_Tar;
+	else
+		return false;
+	return true;
+}
+
+bool CEntryStreamWriter::Write(const char* data, size_t size)
+{
+	if (size == 0)
+		return true;
+
+	return ::fwrite(data, 1, size, m_pFile) == size;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+#include "Buffer.h"
+#include <stdio.h>
+#include <string>
+
+// Writes files one after another to a stream, such as the standard output,
+// so that other processes can consume the contents of a .big file through a pipe.
+//
+// --- FRAME FORMAT
+// Name size (4 bytes, little endian)
+// Name (name size bytes, not null terminated)
+// Data size (4 bytes, little endian)
+// Data (data size bytes)
+//
+// --- TAR FORMAT
+// POSIX ustar stream of regular files, ended by two zero blocks
+
+class CEntryStreamWriter
+{
+public:
+	enum EFormat
+	{
+		eFormat_Frame = 0,
+		eFormat_Tar,
+	};
+
+	CEntryStreamWriter(FILE* pFile, EFormat format);
+
+	bool WriteEntry(const char* szName, const CBuffer& data);
+	// Writes an entry in pieces. The pieces must add up to the data size.
+	bool BeginEntry(const char* szName, uint32 dataSize);
+	bool WriteEntryData(const char* data, size_t size);
+	bool EndEntry();
+	// Writes the end of the stream and flushes it
+	bool Finish();
+
+	static bool ParseFormat(EFormat& format, const wchar_t* wcsFormat);
+
+private:
+	CEntryStreamWriter(const CEntryStreamWriter&);
+	CEntryStreamWriter& operator=(const CEntryStreamWriter&);
+
+	bool Write(const char* data, size_t size);
+
+	FILE* m_pFile;
+	EFormat m_format;
+	std::string m_header;
+	uint32 m_entryDataSize;
+};
@@ -1,4 +1,7 @@
 #include "FileAccess.h"
+#include "FileSystem.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "utils.h"
 #include <fstream>
 #include <errno.h>
@@ -10,18 +13,26 @@ namespace {
 template <typename TData>
 EError ReadDataFromFileInternal(const wchar_t* fileName, TData& data)
 {
+	STATS_SCOPED_PHASE(stats::ePhase_SourceRead);
+	TRACE_SCOPED_EVENT("file read", fileName);
+
 	try
 	{
-		std::ifstream file(fileName, std::ios::in | std::ios::ate | std::ios::binary);
+		std::ifstream file;
+		filesystem::OpenStream(file, fileName, std::ios::in | std::ios::ate | std::ios::binary);
+		stats::AddCount(stats::eCounter_FileOpen);
 
 		if (file.is_open() && file.good())
 		{
 			const size_t fileSize = file.tellg();
+			data.resize(fileSize);
 			if (fileSize != 0)
 			{
-				data.resize(fileSize);
 				file.seekg(0, std::ios::beg);
 				file.read(&data[0], data.size());
+				stats::AddCount(stats::eCounter_FileSeek);
+				stats::AddCount(stats::eCounter_FileRead);
+				stats::AddPhaseBytes(stats::ePhase_SourceRead, fileSize);
 			}
 			return file.good() ? eError_Success : eError_ReadError;
 		}
@@ -39,7 +50,8 @@ EError WriteDataToFileInternal(const wchar_t* fileName, const TData& data)
 {
 	try
 	{
-		std::ofstream file(fileName, std::ios::out | std::ios::ate | std::ios::binary);
+		std::ofstream file;
+		filesystem::OpenStream(file, fileName, std::ios::out | std::ios::ate | std::ios::binary);
 
 		if (file.is_open() && file.good())
 		{
@@ -122,6 +134,11 @@ EError ReadDataFromFile(const wchar_t* fileName, TVectorData& data)
 	return ReadDataFromFileInternal(fileName, data);
 }
 
+EError ReadDataFromFile(const wchar_t* fileName, TBufferData& data)
+{
+	return ReadDataFromFileInternal(fileName, data);
+}
+
 EError WriteDataToFile(const wchar_t* fileName, const TStringData& data)
 {
 	return WriteDataToFileInternal(fileName, data);
@@ -132,6 +149,11 @@ EError WriteDataToFile(const wchar_t* fileName, const TVectorData& data)
 	return WriteDataToFileInternal(fileName, data);
 }
 
+EError WriteDataToFile(const wchar_t* fileName, const TBufferData& data)
+{
+	return WriteDataToFileInternal(fileName, data);
+}
+
 EError ReadDataFromStream(std::istream& stream, TStringData& data, size_t offset)
 {
 	return ReadDataFromStreamInternal(stream, data, offset);
@@ -142,6 +164,11 @@ EError ReadDataFromStream(std::istream& stream, TVectorData& data, size_t offset
 	return ReadDataFromStreamInternal(stream, data, offset);
 }
 
+EError ReadDataFromStream(std::istream& stream, TBufferData& data, size_t offset)
+{
+	return ReadDataFromStreamInternal(stream, data, offset);
+}
+
 EError WriteDataToStream(std::ostream& stream, const TStringData& data, size_t offset)
 {
 	return WriteDataToStreamInternal(stream, data, offset);
@@ -152,6 +179,11 @@ EError WriteDataToStream(std::ostream& stream, const TVectorData& data, size_t o
 	return WriteDataToStreamInternal(stream, data, offset);
 }
 
+EError WriteDataToStream(std::ostream& stream, const TBufferData& data, size_t offset)
+{
+	return WriteDataToStreamInternal(stream, data, offset);
+}
+
 bool FileExists(const wchar_t* fileName)
 {
 	return GetFileAccess(fileName, eAccessMode_Existence) == eAccess_Success;
@@ -169,7 +201,7 @@ bool FileReadable(const wchar_t* fileName)
 
 EAccess GetFileAccess(const wchar_t* fileName, int accessMode)
 {
-	const errno_t err = ::_waccess_s(fileName, accessMode);
+	const int err = filesystem::GetAccess(fileName, accessMode);
 	switch (err)
 	{
 	case 0:      return eAccess_Success;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "Buffer.h"
 #include <string>
 #include <vector>
 #include <iostream>
@@ -35,18 +36,23 @@ namespace fileaccess
 
 	typedef std::string TStringData;
 	typedef std::vector<char> TVectorData;
+	typedef CBuffer TBufferData;
 
 	EError ReadDataFromFile(const wchar_t* fileName, TStringData& data);
 	EError ReadDataFromFile(const wchar_t* fileName, TVectorData& data);
+	EError ReadDataFromFile(const wchar_t* fileName, TBufferData& data);
 
 	EError WriteDataToFile(const wchar_t* fileName, const TStringData& data);
 	EError WriteDataToFile(const wchar_t* fileName, const TVectorData& data);
+	EError WriteDataToFile(const wchar_t* fileName, const TBufferData& data);
 
 	EError ReadDataFromStream(std::istream& stream, TStringData& data, size_t offset = 0u);
 	EError ReadDataFromStream(std::istream& stream, TVectorData& data, size_t offset = 0u);
+	EError ReadDataFromStream(std::istream& stream, TBufferData& data, size_t offset = 0u);
 
 	EError WriteDataToStream(std::ostream& stream, const TStringData& data, size_t offset = 0xFFFFFFFFu);
 	EError WriteDataToStream(std::ostream& stream, const TVectorData& data, size_t offset = 0xFFFFFFFFu);
+	EError WriteDataToStream(std::ostream& stream, const TBufferData& data, size_t offset = 0xFFFFFFFFu);
 
 	bool FileExists(const wchar_t* fileName);
 	bool FileWritable(const wchar_t* fileName);
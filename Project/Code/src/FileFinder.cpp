@@ -1,12 +1,30 @@
 #include "FileFinder.h"
+#include "Stats.h"
 #include "utils.h"
-#include <Shlwapi.h>
+#include "FileSystem.h"
 #include <stdlib.h>
 #include <string>
 #include <fstream>
 #include <algorithm>
 
 
+namespace {
+
+inline bool OpenDirectoryCounted(filesystem::CDirectoryIterator& iterator, const wchar_t* wcsDirectory, const wchar_t* wcsWildcard)
+{
+	stats::AddCount(stats::eCounter_DirectoryRead);
+	return iterator.Open(wcsDirectory, wcsWildcard);
+}
+
+inline bool NextDirectoryEntryCounted(filesystem::CDirectoryIterator& iterator)
+{
+	stats::AddCount(stats::eCounter_DirectoryRead);
+	return iterator.Next();
+}
+
+} // namespace
+
+
 CFileFinder::CFileFinder()
 : m_bigFlags(CBIGFile::eFlags_None)
 , m_bigFileId(InvalidFileId)
@@ -42,7 +60,14 @@ void CFileFinder::InitializeInternal(const wchar_t* wcsRootdir, const wchar_t* w
 	TFiles loseFiles;
 	TFiles bigFiles;
 
-	PopulateFilesFromRoot(loseFiles, bigFiles, rootdir.c_str(), wcsSubdir, wcsWildcard, m_bigFlags, maxDepth);
+	// Previous file descriptions point into the arena
+	utils::ClearMemory(m_files);
+	m_arena.Clear();
+
+	{
+		STATS_SCOPED_PHASE(stats::ePhase_DirectoryWalk);
+		PopulateFilesFromRoot(loseFiles, bigFiles, m_arena, rootdir.c_str(), wcsSubdir, wcsWildcard, m_bigFlags, maxDepth);
+	}
 
 	std::sort(bigFiles.begin(), bigFiles.end(), SortFilepathAlphabetical);
 
@@ -55,7 +80,7 @@ void CFileFinder::InitializeInternal(const wchar_t* wcsRootdir, const wchar_t* w
 
 bool CFileFinder::SortFilepathAlphabetical(SFileDescription& left, SFileDescription& right)
 {
-	return ::StrCmpW(left.path.c_str(), right.path.c_str()) < 0;
+	return filesystem::ComparePaths(left.directory, left.fileName, right.directory, right.fileName) < 0;
 }
 
 void CFileFinder::Clean()
@@ -66,12 +91,15 @@ void CFileFinder::Clean()
 	m_bigFlags = CBIGFile::eFlags_None;
 	m_bigFileId = InvalidFileId;
 	utils::ClearMemory(m_files);
+	m_arena.Clear();
+	utils::ClearMemory(m_path);
 	m_fileId = 0;
 	m_subFileId = InvalidFileId;
 }
 
 void CFileFinder::PopulateFilesFromRoot(TFiles& loseFiles,
 										TFiles& bigFiles,
+										CArena& arena,
 										const wchar_t* wcsRootdir,
 										const wchar_t* wcsSubdir,
 										const wchar_t* wcsWildcard,
@@ -79,60 +107,64 @@ void CFileFinder::PopulateFilesFromRoot(TFiles& loseFiles,
 										const uint32 maxDepth,
 										uint32 depth)
 {
-	std::wstring searchDir;
-	searchDir.reserve(MAX_PATH);
-	searchDir.assign(wcsRootdir).append(wcsSubdir).append(wcsWildcard);
+	std::wstring directory;
+	directory.reserve(MAX_PATH);
+	directory.assign(wcsRootdir).append(wcsSubdir);
 
-	WIN32_FIND_DATAW win32fd;
-	HANDLE hFile = ::FindFirstFileW(searchDir.c_str(), &win32fd);
+	filesystem::CDirectoryIterator iterator;
 
-	if (hFile != INVALID_HANDLE_VALUE)
+	if (OpenDirectoryCounted(iterator, directory.c_str(), wcsWildcard))
 	{
 		std::wstring newSubdir;
 		newSubdir.reserve(MAX_PATH);
 
+		// Directory path and name prefix are built once and shared by all files in this directory
+		const wchar_t* wcsDirectory = arena.CopyString(directory.c_str(), directory.size());
+
+		// Names in .big files use backslashes on all platforms
+		std::string name;
+		const bool subdirOk = utils::AppendWideString(name, wcsSubdir);
+		std::replace(name.begin(), name.end(), '/', '\\');
+		const size_t subdirNameLength = name.size();
+
 		if (depth == 0)
 		{
 			// When in root directory, look here into files first before going into sub folders
 
 			do
 			{
-				if (!(win32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				if (!iterator.IsDirectory())
 				{
 					SFileDescription fileDesc;
-					if (BuildFileDescription(fileDesc, win32fd.cFileName, wcsRootdir, wcsSubdir, bigFlags, depth))
+					if (subdirOk && BuildFileDescription(fileDesc, arena, name, subdirNameLength, iterator.GetName(), wcsDirectory, bigFlags, depth))
 					{
 						TFiles& files = fileDesc.isBigFile ? bigFiles : loseFiles;
-						files.push_back(SFileDescription());
-						files.back().Swap(fileDesc);
+						files.push_back(fileDesc);
 					}
 				}
 			}
-			while (::FindNextFile(hFile, &win32fd));
+			while (NextDirectoryEntryCounted(iterator));
 
-			::FindClose(hFile);
-			hFile = ::FindFirstFileW(searchDir.c_str(), &win32fd);
+			OpenDirectoryCounted(iterator, directory.c_str(), wcsWildcard);
 
 			do
 			{
-				if (win32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				if (iterator.IsDirectory())
 				{
 					if (depth < maxDepth)
 					{
-						if (::wcscmp(win32fd.cFileName, L".") == 0)
+						if (::wcscmp(iterator.GetName(), L".") == 0)
 							continue;
-						if (::wcscmp(win32fd.cFileName, L"..") == 0)
+						if (::wcscmp(iterator.GetName(), L"..") == 0)
 							continue;
 
-						newSubdir.assign(wcsSubdir).append(win32fd.cFileName);
+						newSubdir.assign(wcsSubdir).append(iterator.GetName());
 						AddTrailingPathSeparator(newSubdir);
-						PopulateFilesFromRoot(loseFiles, bigFiles, wcsRootdir, newSubdir.c_str(), wcsWildcard, bigFlags, maxDepth, depth + 1);
+						PopulateFilesFromRoot(loseFiles, bigFiles, arena, wcsRootdir, newSubdir.c_str(), wcsWildcard, bigFlags, maxDepth, depth + 1);
 					}
 				}
 			}
-			while (::FindNextFile(hFile, &win32fd));
-
-			::FindClose(hFile);
+			while (NextDirectoryEntryCounted(iterator));
 		}
 		else
 		{
@@ -140,70 +172,65 @@ void CFileFinder::PopulateFilesFromRoot(TFiles& loseFiles,
 
 			do
 			{
-				if (win32fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				if (iterator.IsDirectory())
 				{
 					if (depth < maxDepth)
 					{
-						if (::wcscmp(win32fd.cFileName, L".") == 0)
+						if (::wcscmp(iterator.GetName(), L".") == 0)
 							continue;
-						if (::wcscmp(win32fd.cFileName, L"..") == 0)
+						if (::wcscmp(iterator.GetName(), L"..") == 0)
 							continue;
 
-						newSubdir.assign(wcsSubdir).append(win32fd.cFileName);
+						newSubdir.assign(wcsSubdir).append(iterator.GetName());
 						AddTrailingPathSeparator(newSubdir);
-						PopulateFilesFromRoot(loseFiles, bigFiles, wcsRootdir, newSubdir.c_str(), wcsWildcard, bigFlags, maxDepth, depth + 1);
+						PopulateFilesFromRoot(loseFiles, bigFiles, arena, wcsRootdir, newSubdir.c_str(), wcsWildcard, bigFlags, maxDepth, depth + 1);
 					}
 				}
 				else
 				{
 					SFileDescription fileDesc;
-					if (BuildFileDescription(fileDesc, win32fd.cFileName, wcsRootdir, wcsSubdir, bigFlags, depth))
+					if (subdirOk && BuildFileDescription(fileDesc, arena, name, subdirNameLength, iterator.GetName(), wcsDirectory, bigFlags, depth))
 					{
 						TFiles& files = fileDesc.isBigFile ? bigFiles : loseFiles;
-						files.push_back(SFileDescription());
-						files.back().Swap(fileDesc);
+						files.push_back(fileDesc);
 					}
 				}
 			}
-			while (::FindNextFile(hFile, &win32fd));
-
-			::FindClose(hFile);
+			while (NextDirectoryEntryCounted(iterator));
 		}
 	}
 }
 
 bool CFileFinder::BuildFileDescription(SFileDescription& fileDesc,
+									   CArena& arena,
+									   std::string& name,
+									   size_t subdirNameLength,
 									   const wchar_t* fileName,
-									   const wchar_t* wcsRootdir,
-									   const wchar_t* wcsSubdir,
+									   const wchar_t* wcsDirectory,
 									   CBIGFile::TFlags bigFlags,
 									   uint32 depth)
 {
 	// File names can be converted to ANSI, because the game does not use Unicode file names
 	// For simplicity convert name to lower case by using simplified char set
-	std::string name;
-	name.reserve(120);
-	bool ok = true;
-	ok = ok && AppendWideString(name, wcsSubdir);
-	ok = ok && AppendWideString(name, fileName);
+	// The name buffer starts with the sub directory name and is reused for all files of the directory
+	name.resize(subdirNameLength);
 	
-	if (ok)
+	if (utils::AppendWideString(name, fileName))
 	{
-		std::string simplifiedName = name;
-		assert(simplifiedName.size() == name.size());
+		fileDesc.name = arena.CopyString(name.c_str(), name.size());
 
 		if (bigFlags & CBIGFile::eFlags_UseSimplifiedName)
 		{
-			CBIGFile::ApplySimplifiedCharset(simplifiedName);
+			CBIGFile::ApplySimplifiedCharset(name);
+			fileDesc.simplifiedName = arena.CopyString(name.c_str(), name.size());
+		}
+		else
+		{
+			fileDesc.simplifiedName = fileDesc.name;
 		}
 
-		std::wstring path;
-		path.reserve(MAX_PATH);
-		path.assign(wcsRootdir).append(wcsSubdir).append(fileName);
-
-		fileDesc.path.swap(path);
-		fileDesc.name.swap(name);
-		fileDesc.simplifiedName.swap(simplifiedName);
+		fileDesc.directory = wcsDirectory;
+		fileDesc.fileName = arena.CopyString(fileName, ::wcslen(fileName));
 		fileDesc.depth = depth;
 
 		if (CBIGFile::HasBigFileExtension(fileName))
@@ -232,7 +259,7 @@ const char* CFileFinder::GetFileNameById(uint32 fileId, uint32 subFileId)
 
 		if (subFileId == InvalidFileId)
 		{
-			return fileDesc.simplifiedName.c_str();
+			return fileDesc.simplifiedName;
 		}
 		else if (fileDesc.isBigFile)
 		{
@@ -244,7 +271,8 @@ const char* CFileFinder::GetFileNameById(uint32 fileId, uint32 subFileId)
 
 			if (!m_bigFile.IsOpen())
 			{
-				if (m_bigFile.OpenFile(fileDesc.path.c_str(), m_bigFlags))
+				fileDesc.GetPath(m_path);
+				if (m_bigFile.OpenFile(m_path.c_str(), m_bigFlags))
 				{
 					m_bigFileId = fileId;
 				}
@@ -302,7 +330,8 @@ fileaccess::EError CFileFinder::ReadDataFromCurrentFile(TData& data)
 
 		if (m_subFileId == InvalidFileId)
 		{
-			return fileaccess::ReadDataFromFile(fileDesc.path.c_str(), data);
+			fileDesc.GetPath(m_path);
+			return fileaccess::ReadDataFromFile(m_path.c_str(), data);
 		}
 		else if (fileDesc.isBigFile)
 		{
@@ -314,6 +343,30 @@ fileaccess::EError CFileFinder::ReadDataFromCurrentFile(TData& data)
 	return fileaccess::eError_FileAccessError;
 }
 
+fileaccess::EError CFileFinder::ReadDataFromCurrentFile(TConstDataPtr& dataPtr)
+{
+	if (m_fileId < GetFileCount())
+	{
+		const SFileDescription& fileDesc = m_files[m_fileId];
+
+		if (m_subFileId == InvalidFileId)
+		{
+			// Read into new data that can be handed on without copies
+			TDataPtr newDataPtr = new CBIGFile::SDataRef();
+			dataPtr = newDataPtr;
+			fileDesc.GetPath(m_path);
+			return fileaccess::ReadDataFromFile(m_path.c_str(), newDataPtr->data);
+		}
+		else if (fileDesc.isBigFile)
+		{
+			return m_bigFile.ReadFileDataById(m_subFileId, dataPtr)
+				? fileaccess::eError_Success
+				: fileaccess::eError_ReadError;
+		}
+	}
+	return fileaccess::eError_FileAccessError;
+}
+
 fileaccess::EError CFileFinder::WriteDataToCurrentFile(const TData& data, bool immediateWriteOut)
 {
 	if (m_fileId < GetFileCount())
@@ -322,7 +375,8 @@ fileaccess::EError CFileFinder::WriteDataToCurrentFile(const TData& data, bool i
 
 		if (m_subFileId == InvalidFileId)
 		{
-			return fileaccess::WriteDataToFile(fileDesc.path.c_str(), data);
+			fileDesc.GetPath(m_path);
+			return fileaccess::WriteDataToFile(m_path.c_str(), data);
 		}
 		else if (fileDesc.isBigFile)
 		{
@@ -334,6 +388,27 @@ fileaccess::EError CFileFinder::WriteDataToCurrentFile(const TData& data, bool i
 	return fileaccess::eError_FileAccessError;
 }
 
+fileaccess::EError CFileFinder::WriteDataToCurrentFile(const TConstDataPtr& dataPtr, bool immediateWriteOut)
+{
+	if (m_fileId < GetFileCount())
+	{
+		const SFileDescription& fileDesc = m_files[m_fileId];
+
+		if (m_subFileId == InvalidFileId)
+		{
+			fileDesc.GetPath(m_path);
+			return fileaccess::WriteDataToFile(m_path.c_str(), dataPtr->data);
+		}
+		else if (fileDesc.isBigFile)
+		{
+			return m_bigFile.WriteFileDataById(m_subFileId, dataPtr, immediateWriteOut)
+				? fileaccess::eError_Success
+				: fileaccess::eError_WriteError;
+		}
+	}
+	return fileaccess::eError_FileAccessError;
+}
+
 bool CFileFinder::HasPendingFileChanges() const
 {
 	return m_bigFile.HasPendingFileChanges();
@@ -355,31 +430,7 @@ void CFileFinder::AddTrailingPathSeparator(std::wstring& str)
 	{
 		if (str[i-1] != L'\\' && str[i-1] != L'/')
 		{
-			str.push_back(L'\\');
-		}
-	}
-}
-
-bool CFileFinder::AppendWideString(std::string& str, const wchar_t* wideStr)
-{
-	bool success = true;
-
-	if (wideStr)
-	{
-		const std::locale locale = std::locale();
-
-		while (*wideStr)
-		{
-			char c = std::use_facet<std::ctype<wchar_t>>(locale).narrow(*wideStr, '\0');
-			if (c == '\0')
-			{
-				success = false;
-				break;
-			}
-			str.push_back(c);
-			wideStr++;
+			str.push_back(filesystem::PathSeparator);
 		}
 	}
-
-	return success;
 }
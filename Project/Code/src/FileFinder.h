@@ -4,30 +4,31 @@
 #include "platform.h"
 #include "FileAccess.h"
 #include "BIGFile.h"
+#include "Arena.h"
 
 
+// Strings point into the arena of the owning CFileFinder.
+// The directory is shared by all files of the same directory.
 struct SFileDescription
 {
 	SFileDescription()
-		: path()
-		, name()
-		, simplifiedName()
+		: directory(L"")
+		, fileName(L"")
+		, name("")
+		, simplifiedName("")
 		, depth(0)
 		, isBigFile(false)
 	{}
 
-	void Swap(SFileDescription& other)
+	void GetPath(std::wstring& path) const
 	{
-		std::swap(path, other.path);
-		std::swap(name, other.name);
-		std::swap(simplifiedName, other.simplifiedName);
-		std::swap(depth, other.depth);
-		std::swap(isBigFile, other.isBigFile);
+		path.assign(directory).append(fileName);
 	}
 
-	std::wstring path;
-	std::string name;
-	std::string simplifiedName;
+	const wchar_t* directory;
+	const wchar_t* fileName;
+	const char* name;
+	const char* simplifiedName;
 	uint32 depth;
 	bool isBigFile;
 };
@@ -43,7 +44,9 @@ private:
 	typedef std::vector<SFileDescription> TFiles;
 
 public:
-	typedef std::vector<char> TData;
+	typedef CBIGFile::TData TData;
+	typedef CBIGFile::TDataPtr TDataPtr;
+	typedef CBIGFile::TConstDataPtr TConstDataPtr;
 	typedef CBIGFile::TFlags TFlags;
 
 public:
@@ -64,7 +67,9 @@ public:
 	const char* GetNextFileName();
 
 	fileaccess::EError ReadDataFromCurrentFile(TData& data);
+	fileaccess::EError ReadDataFromCurrentFile(TConstDataPtr& dataPtr);
 	fileaccess::EError WriteDataToCurrentFile(const TData& data, bool immediateWriteOut = false);
+	fileaccess::EError WriteDataToCurrentFile(const TConstDataPtr& dataPtr, bool immediateWriteOut = false);
 
 	bool HasPendingFileChanges() const;
 	bool WriteOutPendingFileChanges();
@@ -73,18 +78,19 @@ public:
 private:
 	void InitializeInternal(const wchar_t* wcsRootdir, const wchar_t* wcsWildcard, uint32 maxDepth);
 
-	static void PopulateFilesFromRoot(TFiles& loseFiles, TFiles& bigFiles, const wchar_t* wcsRootdir, const wchar_t* wcsSubdir, const wchar_t* wcsWildcard, CBIGFile::TFlags bigFlags, const uint32 maxDepth, uint32 depth = 0);
-	static bool BuildFileDescription(SFileDescription& fileDesc, const wchar_t* fileName, const wchar_t* wcsRootdir, const wchar_t* wcsSubdir, CBIGFile::TFlags bigFlags, uint32 depth);
+	static void PopulateFilesFromRoot(TFiles& loseFiles, TFiles& bigFiles, CArena& arena, const wchar_t* wcsRootdir, const wchar_t* wcsSubdir, const wchar_t* wcsWildcard, CBIGFile::TFlags bigFlags, const uint32 maxDepth, uint32 depth = 0);
+	static bool BuildFileDescription(SFileDescription& fileDesc, CArena& arena, std::string& name, size_t subdirNameLength, const wchar_t* fileName, const wchar_t* wcsDirectory, CBIGFile::TFlags bigFlags, uint32 depth);
 	
 	static bool SortFilepathAlphabetical(SFileDescription& left, SFileDescription& right);
 	static void AddTrailingPathSeparator(std::wstring& str);
-	static bool AppendWideString(std::string& str, const wchar_t* wideStr);
 
 	CBIGFile m_bigFile;
 	TFlags m_bigFlags;
 	uint32 m_bigFileId;
 
 	TFiles m_files;
+	CArena m_arena;
+	std::wstring m_path;
 	uint32 m_fileId;
 	uint32 m_subFileId;
 };
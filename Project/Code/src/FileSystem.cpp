@@ -0,0 +1,1047 @@
+#include "FileSystem.h"
+#include "Buffer.h"
+#include "atomic.h"
+#include "timer.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Shlwapi.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#endif
+
+
+namespace filesystem {
+namespace {
+
+enum
+{
+	MaxCreateAttempts = 16,
+	CopyBufferSize = 1024 * 1024,
+};
+
+void AppendHex(std::wstring& str, uint64 value)
+{
+	static const wchar_t digits[] = L"0123456789abcdef";
+	wchar_t buffer[16];
+	size_t count = 0;
+	do
+	{
+		buffer[count++] = digits[value & 0xF];
+		value >>= 4;
+	}
+	while (value != 0);
+
+	while (count != 0)
+	{
+		str.push_back(buffer[--count]);
+	}
+}
+
+uint32 GetProcessId()
+{
+#ifdef _WIN32
+	return static_cast<uint32>(::GetCurrentProcessId());
+#else
+	return static_cast<uint32>(::getpid());
+#endif
+}
+
+} // namespace
+
+
+void MakeTemporaryFileName(std::wstring& fileName, const wchar_t* targetFileName)
+{
+	// Process id and counter make the name unique on this machine,
+	// the time makes collisions with other machines on a network share unlikely.
+	static volatile int64 s_counter = 0;
+	const int64 counter = atomic::Add(&s_counter, 1);
+
+	fileName.assign(targetFileName).append(L".tmp");
+	AppendHex(fileName, GetProcessId());
+	fileName.push_back(L'_');
+	AppendHex(fileName, static_cast<uint64>(counter));
+	fileName.push_back(L'_');
+	AppendHex(fileName, timer::GetTicks() & 0xFFFFFFFFull);
+}
+
+bool ParseDurability(EDurability& durability, const wchar_t* wcsDurability)
+{
+	if (::_wcsicmp(wcsDurability, L"none") == 0)
+		durability = eDurability_None;
+	else if (::_wcsicmp(wcsDurability, L"end") == 0)
+		durability = eDurability_End;
+	else if (::_wcsicmp(wcsDurability, L"batch") == 0)
+		durability = eDurability_Batch;
+	else
+		return false;
+	return true;
+}
+
+
+CReplaceFile::~CReplaceFile()
+{
+	Discard();
+}
+
+bool CReplaceFile::Write(const char* data, size_t size)
+{
+	if (!IsOpen())
+		return false;
+
+	while (size != 0)
+	{
+		// Write in chunks to stay within the limits of the system calls
+		const size_t chunkSize = size < 0x40000000u ? size : 0x40000000u;
+#ifdef _WIN32
+		DWORD written = 0;
+		if (::WriteFile(m_hFile, data, static_cast<DWORD>(chunkSize), &written, NULL) == FALSE || written == 0)
+			return false;
+#else
+		const ssize_t written = ::write(m_fd, data, chunkSize);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+#endif
+		data += written;
+		size -= written;
+		m_unsyncedBytes += written;
+	}
+
+	if (m_durability == eDurability_Batch && m_unsyncedBytes >= m_syncBatchBytes)
+	{
+		return Sync();
+	}
+	return true;
+}
+
+bool CReplaceFile::CopyFrom(const CInputFile& source, uint64 offset, uint64 size)
+{
+	if (!IsOpen() || !source.IsOpen())
+		return false;
+
+	const uint64 copiedSize = CopyRangeInKernel(source, offset, size);
+	offset += copiedSize;
+	size -= copiedSize;
+	m_unsyncedBytes += copiedSize;
+
+	if (size == 0)
+	{
+		if (m_durability == eDurability_Batch && m_unsyncedBytes >= m_syncBatchBytes)
+		{
+			return Sync();
+		}
+		return true;
+	}
+
+	// What the kernel cannot copy goes through a buffer
+	CBuffer buffer;
+	buffer.resize(static_cast<size_t>(std::min<uint64>(size, CopyBufferSize)));
+
+	while (size != 0)
+	{
+		const size_t chunkSize = static_cast<size_t>(std::min<uint64>(size, buffer.size()));
+		if (!source.ReadAt(&buffer[0], chunkSize, offset) || !Write(&buffer[0], chunkSize))
+			return false;
+		offset += chunkSize;
+		size -= chunkSize;
+	}
+	return true;
+}
+
+
+CInputFile::~CInputFile()
+{
+	Close();
+}
+
+CUpdateFile::~CUpdateFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool ToNativePath(std::string& nativePath, const wchar_t* path)
+{
+	// Windows uses wide paths natively, this is for display only
+	const int size = ::WideCharToMultiByte(CP_UTF8, 0, path, -1, NULL, 0, NULL, NULL);
+	if (size <= 0)
+		return false;
+	nativePath.resize(size);
+	::WideCharToMultiByte(CP_UTF8, 0, path, -1, &nativePath[0], size, NULL, NULL);
+	nativePath.resize(size - 1);
+	return true;
+}
+
+void FromNativePath(std::wstring& path, const char* nativePath)
+{
+	path.clear();
+	const int size = ::MultiByteToWideChar(CP_UTF8, 0, nativePath, -1, NULL, 0);
+	if (size > 0)
+	{
+		path.resize(size);
+		::MultiByteToWideChar(CP_UTF8, 0, nativePath, -1, &path[0], size);
+		path.resize(size - 1);
+	}
+}
+
+bool RemoveFile(const wchar_t* fileName)
+{
+	return ::DeleteFileW(fileName) != FALSE;
+}
+
+bool RenameFile(const wchar_t* fromFileName, const wchar_t* toFileName)
+{
+	return ::MoveFileExW(fromFileName, toFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
+
+bool MakeDirectory(const wchar_t* directory)
+{
+	return ::CreateDirectoryW(directory, NULL) != FALSE;
+}
+
+int GetAccess(const wchar_t* fileName, int accessMode)
+{
+	return static_cast<int>(::_waccess_s(fileName, accessMode));
+}
+
+int ComparePaths(const wchar_t* left, const wchar_t* right)
+{
+	return ::StrCmpW(left, right);
+}
+
+int ComparePaths(const wchar_t* leftDirectory, const wchar_t* leftFileName, const wchar_t* rightDirectory, const wchar_t* rightFileName)
+{
+	// StrCmpW cannot compare in pieces, so the paths are joined on the stack unless they are very long
+	const size_t leftDirectoryLength = ::wcslen(leftDirectory);
+	const size_t leftFileNameLength = ::wcslen(leftFileName);
+	const size_t rightDirectoryLength = ::wcslen(rightDirectory);
+	const size_t rightFileNameLength = ::wcslen(rightFileName);
+	wchar_t left[MAX_PATH * 2];
+	wchar_t right[MAX_PATH * 2];
+
+	if (leftDirectoryLength + leftFileNameLength >= MAX_PATH * 2 || rightDirectoryLength + rightFileNameLength >= MAX_PATH * 2)
+	{
+		std::wstring leftPath(leftDirectory);
+		std::wstring rightPath(rightDirectory);
+		leftPath.append(leftFileName);
+		rightPath.append(rightFileName);
+		return ::StrCmpW(leftPath.c_str(), rightPath.c_str());
+	}
+
+	::memcpy(left, leftDirectory, leftDirectoryLength * sizeof(wchar_t));
+	::memcpy(left + leftDirectoryLength, leftFileName, (leftFileNameLength + 1) * sizeof(wchar_t));
+	::memcpy(right, rightDirectory, rightDirectoryLength * sizeof(wchar_t));
+	::memcpy(right + rightDirectoryLength, rightFileName, (rightFileNameLength + 1) * sizeof(wchar_t));
+	return ::StrCmpW(left, right);
+}
+
+bool SetBinaryMode(FILE* pFile)
+{
+	return ::_setmode(::_fileno(pFile), _O_BINARY) != -1;
+}
+
+
+CReplaceFile::CReplaceFile()
+: m_durability(eDurability_End)
+, m_syncBatchBytes(DefaultSyncBatchBytes)
+, m_unsyncedBytes(0)
+, m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+bool CReplaceFile::Create(const wchar_t* targetFileName, EDurability durability, uint64 syncBatchBytes)
+{
+	Discard();
+	m_targetFileName = targetFileName;
+	m_durability = durability;
+	m_syncBatchBytes = syncBatchBytes;
+	m_unsyncedBytes = 0;
+
+	for (uint32 attempt = 0; attempt < MaxCreateAttempts && m_hFile == INVALID_HANDLE_VALUE; ++attempt)
+	{
+		MakeTemporaryFileName(m_temporaryFileName, targetFileName);
+		m_hFile = ::CreateFileW(m_temporaryFileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (m_hFile == INVALID_HANDLE_VALUE && ::GetLastError() != ERROR_FILE_EXISTS)
+			break;
+	}
+
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		m_temporaryFileName.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CReplaceFile::Sync()
+{
+	m_unsyncedBytes = 0;
+	return ::FlushFileBuffers(m_hFile) != FALSE;
+}
+
+bool CReplaceFile::Commit()
+{
+	if (!IsOpen())
+		return false;
+
+	bool ok = true;
+	if (m_durability != eDurability_None)
+	{
+		ok = Sync();
+	}
+
+	::CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	// Move is written through, so no separate flush of the directory is needed
+	ok = ok && RenameFile(m_temporaryFileName.c_str(), m_targetFileName.c_str());
+
+	if (!ok)
+	{
+		RemoveFile(m_temporaryFileName.c_str());
+	}
+	m_temporaryFileName.clear();
+	return ok;
+}
+
+void CReplaceFile::Discard()
+{
+	if (IsOpen())
+	{
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		RemoveFile(m_temporaryFileName.c_str());
+		m_temporaryFileName.clear();
+	}
+}
+
+bool CReplaceFile::IsOpen() const
+{
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+uint64 CReplaceFile::CopyRangeInKernel(const CInputFile&, uint64, uint64)
+{
+	// Windows has no copy of a file range to the end of another file
+	return 0;
+}
+
+
+CInputFile::CInputFile()
+: m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+bool CInputFile::Open(const wchar_t* fileName)
+{
+	// Sharing deletes allows to replace the file while it is read. Sharing writes allows
+	// to open it for writing too, as writing a .big file over its own source does.
+	Close();
+	m_hFile = ::CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+void CInputFile::Close()
+{
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool CInputFile::ReadAt(char* data, size_t size, uint64 offset) const
+{
+	while (size != 0)
+	{
+		const size_t chunkSize = size < 0x40000000u ? size : 0x40000000u;
+		OVERLAPPED overlapped = {0};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD readSize = 0;
+		if (::ReadFile(m_hFile, data, static_cast<DWORD>(chunkSize), &readSize, &overlapped) == FALSE || readSize == 0)
+			return false;
+		data += readSize;
+		size -= readSize;
+		offset += readSize;
+	}
+	return true;
+}
+
+bool CInputFile::IsOpen() const
+{
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+uint64 CInputFile::GetSize() const
+{
+	LARGE_INTEGER size;
+	if (::GetFileSizeEx(m_hFile, &size) == FALSE)
+		return 0;
+	return static_cast<uint64>(size.QuadPart);
+}
+
+
+
+CUpdateFile::CUpdateFile()
+: m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+bool CUpdateFile::Open(const wchar_t* fileName)
+{
+	Close();
+	m_hFile = ::CreateFileW(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+void CUpdateFile::Close()
+{
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool CUpdateFile::WriteAt(const char* data, size_t size, uint64 offset)
+{
+	while (size != 0)
+	{
+		const size_t chunkSize = size < 0x40000000u ? size : 0x40000000u;
+		OVERLAPPED overlapped = {0};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD written = 0;
+		if (::WriteFile(m_hFile, data, static_cast<DWORD>(chunkSize), &written, &overlapped) == FALSE || written == 0)
+			return false;
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+bool CUpdateFile::Sync()
+{
+	return ::FlushFileBuffers(m_hFile) != FALSE;
+}
+
+bool CUpdateFile::IsOpen() const
+{
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+CDirectoryIterator::CDirectoryIterator()
+: m_hFind(INVALID_HANDLE_VALUE)
+{
+}
+
+CDirectoryIterator::~CDirectoryIterator()
+{
+	Close();
+}
+
+bool CDirectoryIterator::Open(const wchar_t* directory, const wchar_t* wildcard)
+{
+	Close();
+	std::wstring search;
+	search.reserve(MAX_PATH);
+	search.assign(directory).append(wildcard);
+	m_hFind = ::FindFirstFileW(search.c_str(), &m_findData);
+	return m_hFind != INVALID_HANDLE_VALUE;
+}
+
+bool CDirectoryIterator::Next()
+{
+	return m_hFind != INVALID_HANDLE_VALUE && ::FindNextFileW(m_hFind, &m_findData) != FALSE;
+}
+
+void CDirectoryIterator::Close()
+{
+	if (m_hFind != INVALID_HANDLE_VALUE)
+	{
+		::FindClose(m_hFind);
+		m_hFind = INVALID_HANDLE_VALUE;
+	}
+}
+
+const wchar_t* CDirectoryIterator::GetName() const
+{
+	return m_findData.cFileName;
+}
+
+bool CDirectoryIterator::IsDirectory() const
+{
+	return (m_findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+#else // POSIX
+
+bool ToNativePath(std::string& nativePath, const wchar_t* path)
+{
+	// Encode as UTF-8, which is what file names on POSIX systems are expected to be
+	nativePath.clear();
+	for (; *path; ++path)
+	{
+		const uint32 c = static_cast<uint32>(*path);
+		if (c < 0x80)
+		{
+			nativePath.push_back(static_cast<char>(c));
+		}
+		else if (c < 0x800)
+		{
+			nativePath.push_back(static_cast<char>(0xC0 | (c >> 6)));
+			nativePath.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000)
+		{
+			nativePath.push_back(static_cast<char>(0xE0 | (c >> 12)));
+			nativePath.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			nativePath.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x110000)
+		{
+			nativePath.push_back(static_cast<char>(0xF0 | (c >> 18)));
+			nativePath.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+			nativePath.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			nativePath.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FromNativePath(std::wstring& path, const char* nativePath)
+{
+	// Decode UTF-8. Bytes that are no valid UTF-8 are taken as Latin-1 characters.
+	path.clear();
+	const uint8* p = reinterpret_cast<const uint8*>(nativePath);
+	while (*p)
+	{
+		const uint8 lead = *p;
+		uint32 c = lead;
+		uint32 count = 0;
+
+		if      ((lead & 0xE0) == 0xC0) { c = lead & 0x1F; count = 1; }
+		else if ((lead & 0xF0) == 0xE0) { c = lead & 0x0F; count = 2; }
+		else if ((lead & 0xF8) == 0xF0) { c = lead & 0x07; count = 3; }
+
+		uint32 i = 1;
+		for (; i <= count; ++i)
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				break;
+			c = (c << 6) | (p[i] & 0x3F);
+		}
+
+		if (i <= count)
+		{
+			path.push_back(static_cast<wchar_t>(lead));
+			p += 1;
+		}
+		else
+		{
+			path.push_back(static_cast<wchar_t>(c));
+			p += count + 1;
+		}
+	}
+}
+
+bool RemoveFile(const wchar_t* fileName)
+{
+	std::string nativeFileName;
+	return ToNativePath(nativeFileName, fileName) && ::unlink(nativeFileName.c_str()) == 0;
+}
+
+bool RenameFile(const wchar_t* fromFileName, const wchar_t* toFileName)
+{
+	std::string nativeFromFileName;
+	std::string nativeToFileName;
+	return ToNativePath(nativeFromFileName, fromFileName)
+		&& ToNativePath(nativeToFileName, toFileName)
+		&& ::rename(nativeFromFileName.c_str(), nativeToFileName.c_str()) == 0;
+}
+
+bool MakeDirectory(const wchar_t* directory)
+{
+	std::string nativeDirectory;
+	return ToNativePath(nativeDirectory, directory) && ::mkdir(nativeDirectory.c_str(), 0777) == 0;
+}
+
+int GetAccess(const wchar_t* fileName, int accessMode)
+{
+	// Access modes of the Microsoft CRT have the same values as F_OK, W_OK and R_OK
+	std::string nativeFileName;
+	if (!ToNativePath(nativeFileName, fileName))
+		return EINVAL;
+	return ::access(nativeFileName.c_str(), accessMode) == 0 ? 0 : errno;
+}
+
+int ComparePaths(const wchar_t* left, const wchar_t* right)
+{
+	return ::wcscmp(left, right);
+}
+
+int ComparePaths(const wchar_t* leftDirectory, const wchar_t* leftFileName, const wchar_t* rightDirectory, const wchar_t* rightFileName)
+{
+	// Files of one directory share the directory string
+	if (leftDirectory == rightDirectory)
+		return ::wcscmp(leftFileName, rightFileName);
+
+	// Same as wcscmp of the joined paths, going on with the file name at the end of the directory
+	const wchar_t* left = leftDirectory;
+	const wchar_t* right = rightDirectory;
+	for (;;)
+	{
+		if (*left == L'\0' && leftFileName)
+		{
+			left = leftFileName;
+			leftFileName = NULL;
+			continue;
+		}
+		if (*right == L'\0' && rightFileName)
+		{
+			right = rightFileName;
+			rightFileName = NULL;
+			continue;
+		}
+		if (*left != *right)
+			return *left < *right ? -1 : 1;
+		if (*left == L'\0')
+			return 0;
+		++left;
+		++right;
+	}
+}
+
+bool SetBinaryMode(FILE*)
+{
+	// No distinction between text and binary streams
+	return true;
+}
+
+
+namespace {
+
+void GetNativeDirectory(std::string& directory, const std::string& nativeFileName)
+{
+	const size_t separator = nativeFileName.rfind('/');
+	if (separator == std::string::npos)
+		directory.assign(".");
+	else if (separator == 0)
+		directory.assign("/");
+	else
+		directory.assign(nativeFileName, 0, separator);
+}
+
+bool SyncDirectory(const std::string& directory)
+{
+	// Makes a rename in the directory durable
+	const int fd = ::open(directory.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	const bool ok = ::fsync(fd) == 0;
+	::close(fd);
+	return ok;
+}
+
+} // namespace
+
+
+CReplaceFile::CReplaceFile()
+: m_durability(eDurability_End)
+, m_syncBatchBytes(DefaultSyncBatchBytes)
+, m_unsyncedBytes(0)
+, m_fd(-1)
+{
+}
+
+bool CReplaceFile::Create(const wchar_t* targetFileName, EDurability durability, uint64 syncBatchBytes)
+{
+	Discard();
+	m_targetFileName = targetFileName;
+	m_durability = durability;
+	m_syncBatchBytes = syncBatchBytes;
+	m_unsyncedBytes = 0;
+
+	std::string nativeTargetFileName;
+	if (!ToNativePath(nativeTargetFileName, targetFileName))
+		return false;
+
+#ifdef O_TMPFILE
+	// An unnamed file in the target directory leaves nothing behind on a crash.
+	// It gets a name on commit, which needs /proc to refer to it.
+	if (::access("/proc/self/fd", F_OK) == 0)
+	{
+		std::string directory;
+		GetNativeDirectory(directory, nativeTargetFileName);
+		m_fd = ::open(directory.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+		if (m_fd >= 0)
+			return true;
+	}
+#endif
+
+	for (uint32 attempt = 0; attempt < MaxCreateAttempts && m_fd < 0; ++attempt)
+	{
+		std::string nativeTemporaryFileName;
+		MakeTemporaryFileName(m_temporaryFileName, targetFileName);
+		if (!ToNativePath(nativeTemporaryFileName, m_temporaryFileName.c_str()))
+			break;
+
+		m_fd = ::open(nativeTemporaryFileName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+		if (m_fd < 0 && errno != EEXIST)
+			break;
+	}
+
+	if (m_fd < 0)
+	{
+		m_temporaryFileName.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CReplaceFile::Sync()
+{
+	m_unsyncedBytes = 0;
+#if defined(__linux__)
+	return ::fdatasync(m_fd) == 0;
+#else
+	return ::fsync(m_fd) == 0;
+#endif
+}
+
+bool CReplaceFile::Commit()
+{
+	if (!IsOpen())
+		return false;
+
+	bool ok = true;
+	if (m_durability != eDurability_None)
+	{
+		ok = Sync();
+	}
+
+	std::string nativeTemporaryFileName;
+	std::string nativeTargetFileName;
+	ok = ok && ToNativePath(nativeTargetFileName, m_targetFileName.c_str());
+
+	if (ok && m_temporaryFileName.empty())
+	{
+		// Give the unnamed file a temporary name, because linkat cannot replace the target
+		char procPath[64];
+		::snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", m_fd);
+		ok = false;
+
+		for (uint32 attempt = 0; attempt < MaxCreateAttempts && !ok; ++attempt)
+		{
+			MakeTemporaryFileName(m_temporaryFileName, m_targetFileName.c_str());
+			if (!ToNativePath(nativeTemporaryFileName, m_temporaryFileName.c_str()))
+				break;
+
+			ok = ::linkat(AT_FDCWD, procPath, AT_FDCWD, nativeTemporaryFileName.c_str(), AT_SYMLINK_FOLLOW) == 0;
+
+			if (!ok && errno != EEXIST)
+				break;
+		}
+
+		if (!ok)
+			m_temporaryFileName.clear();
+	}
+	else
+	{
+		ok = ok && ToNativePath(nativeTemporaryFileName, m_temporaryFileName.c_str());
+	}
+
+	ok = (::close(m_fd) == 0) && ok;
+	m_fd = -1;
+
+	ok = ok && ::rename(nativeTemporaryFileName.c_str(), nativeTargetFileName.c_str()) == 0;
+
+	if (ok && m_durability != eDurability_None)
+	{
+		std::string directory;
+		GetNativeDirectory(directory, nativeTargetFileName);
+		ok = SyncDirectory(directory);
+	}
+	else if (!ok && !m_temporaryFileName.empty())
+	{
+		RemoveFile(m_temporaryFileName.c_str());
+	}
+
+	m_temporaryFileName.clear();
+	return ok;
+}
+
+void CReplaceFile::Discard()
+{
+	if (IsOpen())
+	{
+		::close(m_fd);
+		m_fd = -1;
+
+		// Unnamed files have no name to remove and vanish with the close
+		if (!m_temporaryFileName.empty())
+		{
+			RemoveFile(m_temporaryFileName.c_str());
+			m_temporaryFileName.clear();
+		}
+	}
+}
+
+bool CReplaceFile::IsOpen() const
+{
+	return m_fd >= 0;
+}
+
+uint64 CReplaceFile::CopyRangeInKernel(const CInputFile& source, uint64 offset, uint64 size)
+{
+	uint64 copiedSize = 0;
+#ifdef SYS_copy_file_range
+	// Called through syscall, because some C libraries emulate it with plain reads and writes.
+	// File systems with reflinks share the data instead of copying it.
+	loff_t sourceOffset = static_cast<loff_t>(offset);
+	while (copiedSize < size)
+	{
+		const size_t chunkSize = static_cast<size_t>(std::min<uint64>(size - copiedSize, 0x40000000u));
+		const long result = ::syscall(SYS_copy_file_range, source.m_fd, &sourceOffset, m_fd, NULL, chunkSize, 0u);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			break;
+		copiedSize += static_cast<uint64>(result);
+	}
+#else
+	(void)source;
+	(void)offset;
+	(void)size;
+#endif
+	return copiedSize;
+}
+
+
+CInputFile::CInputFile()
+: m_fd(-1)
+{
+}
+
+bool CInputFile::Open(const wchar_t* fileName)
+{
+	Close();
+	std::string nativeFileName;
+	if (!ToNativePath(nativeFileName, fileName))
+		return false;
+	m_fd = ::open(nativeFileName.c_str(), O_RDONLY | O_CLOEXEC);
+	return m_fd >= 0;
+}
+
+void CInputFile::Close()
+{
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+bool CInputFile::ReadAt(char* data, size_t size, uint64 offset) const
+{
+	while (size != 0)
+	{
+		const size_t chunkSize = size < 0x40000000u ? size : 0x40000000u;
+		const ssize_t readSize = ::pread(m_fd, data, chunkSize, static_cast<off_t>(offset));
+		if (readSize < 0 && errno == EINTR)
+			continue;
+		if (readSize <= 0)
+			return false;
+		data += readSize;
+		size -= readSize;
+		offset += readSize;
+	}
+	return true;
+}
+
+bool CInputFile::IsOpen() const
+{
+	return m_fd >= 0;
+}
+
+uint64 CInputFile::GetSize() const
+{
+	struct stat status;
+	if (::fstat(m_fd, &status) != 0)
+		return 0;
+	return static_cast<uint64>(status.st_size);
+}
+
+
+
+CUpdateFile::CUpdateFile()
+: m_fd(-1)
+{
+}
+
+bool CUpdateFile::Open(const wchar_t* fileName)
+{
+	Close();
+	std::string nativeFileName;
+	if (!ToNativePath(nativeFileName, fileName))
+		return false;
+	m_fd = ::open(nativeFileName.c_str(), O_RDWR | O_CLOEXEC);
+	return m_fd >= 0;
+}
+
+void CUpdateFile::Close()
+{
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+bool CUpdateFile::WriteAt(const char* data, size_t size, uint64 offset)
+{
+	while (size != 0)
+	{
+		const size_t chunkSize = size < 0x40000000u ? size : 0x40000000u;
+		const ssize_t written = ::pwrite(m_fd, data, chunkSize, static_cast<off_t>(offset));
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+bool CUpdateFile::Sync()
+{
+#if defined(__linux__)
+	return ::fdatasync(m_fd) == 0;
+#else
+	return ::fsync(m_fd) == 0;
+#endif
+}
+
+bool CUpdateFile::IsOpen() const
+{
+	return m_fd >= 0;
+}
+
+CDirectoryIterator::CDirectoryIterator()
+: m_pDir(NULL)
+, m_isDirectory(false)
+{
+}
+
+CDirectoryIterator::~CDirectoryIterator()
+{
+	Close();
+}
+
+bool CDirectoryIterator::Open(const wchar_t* directory, const wchar_t* wildcard)
+{
+	Close();
+
+	if (!ToNativePath(m_directory, directory) || !ToNativePath(m_wildcard, wildcard))
+		return false;
+
+	// Windows matches all names with *.*, also those without a dot
+	if (m_wildcard == "*.*")
+		m_wildcard = "*";
+
+	m_pDir = ::opendir(m_directory.c_str());
+	if (m_pDir == NULL)
+		return false;
+
+	if (!ReadEntry())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool CDirectoryIterator::Next()
+{
+	return m_pDir != NULL && ReadEntry();
+}
+
+void CDirectoryIterator::Close()
+{
+	if (m_pDir != NULL)
+	{
+		::closedir(m_pDir);
+		m_pDir = NULL;
+	}
+}
+
+bool CDirectoryIterator::ReadEntry()
+{
+#ifdef FNM_CASEFOLD
+	const int matchFlags = FNM_CASEFOLD;
+#else
+	const int matchFlags = 0;
+#endif
+
+	while (const struct dirent* pEntry = ::readdir(m_pDir))
+	{
+		if (::fnmatch(m_wildcard.c_str(), pEntry->d_name, matchFlags) != 0)
+			continue;
+
+		bool isDirectory = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (pEntry->d_type == DT_DIR)
+		{
+			isDirectory = true;
+		}
+		else if (pEntry->d_type == DT_UNKNOWN || pEntry->d_type == DT_LNK)
+#endif
+		{
+			// Follow links like Windows does
+			std::string path = m_directory;
+			path.append(pEntry->d_name);
+			struct stat status;
+			isDirectory = ::stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+		}
+
+		FromNativePath(m_name, pEntry->d_name);
+		m_isDirectory = isDirectory;
+		return true;
+	}
+	return false;
+}
+
+const wchar_t* CDirectoryIterator::GetName() const
+{
+	return m_name.c_str();
+}
+
+bool CDirectoryIterator::IsDirectory() const
+{
+	return m_isDirectory;
+}
+
+#endif
+
+} // namespace filesystem
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <ios>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+// File system functions of the operating system.
+// Paths are wide strings on all platforms. On POSIX they are converted to UTF-8.
+
+namespace filesystem
+{
+#ifdef _WIN32
+	const wchar_t PathSeparator = L'\\';
+#else
+	const wchar_t PathSeparator = L'/';
+#endif
+
+	inline bool IsPathSeparator(wchar_t c)
+	{
+		return c == L'\\' || c == L'/';
+	}
+
+	bool ToNativePath(std::string& nativePath, const wchar_t* path);
+	void FromNativePath(std::wstring& path, const char* nativePath);
+
+	template <typename StreamType>
+	void OpenStream(StreamType& stream, const wchar_t* fileName, std::ios::openmode mode)
+	{
+#ifdef _WIN32
+		stream.open(fileName, mode);
+#else
+		std::string nativeFileName;
+		if (ToNativePath(nativeFileName, fileName))
+			stream.open(nativeFileName.c_str(), mode);
+		else
+			stream.setstate(std::ios::failbit);
+#endif
+	}
+
+	bool RemoveFile(const wchar_t* fileName);
+	// Replaces an existing file in one step
+	bool RenameFile(const wchar_t* fromFileName, const wchar_t* toFileName);
+	bool MakeDirectory(const wchar_t* directory);
+
+	// Returns 0 on success, otherwise the errno value
+	int GetAccess(const wchar_t* fileName, int accessMode);
+
+	int ComparePaths(const wchar_t* left, const wchar_t* right);
+	// Compares paths given as directory and file name as if each pair was joined, without joining them
+	int ComparePaths(const wchar_t* leftDirectory, const wchar_t* leftFileName, const wchar_t* rightDirectory, const wchar_t* rightFileName);
+
+	// Stops text conversion of line endings, so that binary data passes unchanged
+	bool SetBinaryMode(FILE* pFile);
+
+	// Builds a file name next to the target file that is unique for this process and moment
+	void MakeTemporaryFileName(std::wstring& fileName, const wchar_t* targetFileName);
+
+	enum EDurability
+	{
+		eDurability_None = 0, // Leave flushing to the operating system
+		eDurability_End,      // Flush once before the new file replaces the target
+		eDurability_Batch,    // Flush each time a batch of bytes is written and before the replace
+	};
+
+	bool ParseDurability(EDurability& durability, const wchar_t* wcsDurability);
+
+	// Reads a file at given offsets. Reads do not move a shared file position,
+	// so concurrent readers of one file do not get in the way of each other.
+	class CInputFile
+	{
+	public:
+		CInputFile();
+		~CInputFile();
+
+		bool Open(const wchar_t* fileName);
+		void Close();
+
+		// Reads the whole range or fails
+		bool ReadAt(char* data, size_t size, uint64 offset) const;
+
+		bool IsOpen() const;
+		uint64 GetSize() const;
+
+	private:
+		friend class CReplaceFile;
+
+		CInputFile(const CInputFile&);
+		CInputFile& operator=(const CInputFile&);
+
+#ifdef _WIN32
+		HANDLE m_hFile;
+#else
+		int m_fd;
+#endif
+	};
+
+	// Writes into an existing file at given offsets without replacing it.
+	// Unlike CReplaceFile, a write that is cut short leaves the file partly changed.
+	class CUpdateFile
+	{
+	public:
+		CUpdateFile();
+		~CUpdateFile();
+
+		bool Open(const wchar_t* fileName);
+		void Close();
+
+		// Writes the whole range or fails
+		bool WriteAt(const char* data, size_t size, uint64 offset);
+		// Flushes written data to the storage device
+		bool Sync();
+
+		bool IsOpen() const;
+
+	private:
+		CUpdateFile(const CUpdateFile&);
+		CUpdateFile& operator=(const CUpdateFile&);
+
+#ifdef _WIN32
+		HANDLE m_hFile;
+#else
+		int m_fd;
+#endif
+	};
+
+	// Writes a new file and then replaces the target file with it in one step.
+	// Until Commit the target stays untouched. If the process or system dies before,
+	// no file or only a temporary file is left behind, where available an unnamed one.
+	class CReplaceFile
+	{
+	public:
+		enum : uint32
+		{
+			DefaultSyncBatchBytes = 64 * 1024 * 1024,
+		};
+
+		CReplaceFile();
+		~CReplaceFile();
+
+		bool Create(const wchar_t* targetFileName, EDurability durability = eDurability_End, uint64 syncBatchBytes = DefaultSyncBatchBytes);
+		bool Write(const char* data, size_t size);
+		// Appends a range of another file. Where the system can, the data is copied
+		// in the kernel or shared by reference without passing through this process.
+		bool CopyFrom(const CInputFile& source, uint64 offset, uint64 size);
+		bool Commit();
+		void Discard();
+
+		bool IsOpen() const;
+
+	private:
+		CReplaceFile(const CReplaceFile&);
+		CReplaceFile& operator=(const CReplaceFile&);
+
+		bool Sync();
+		// Returns the bytes the kernel copied, which can be less than the size
+		uint64 CopyRangeInKernel(const CInputFile& source, uint64 offset, uint64 size);
+
+		std::wstring m_targetFileName;
+		std::wstring m_temporaryFileName;
+		EDurability m_durability;
+		uint64 m_syncBatchBytes;
+		uint64 m_unsyncedBytes;
+#ifdef _WIN32
+		HANDLE m_hFile;
+#else
+		int m_fd;
+#endif
+	};
+
+	// Iterates entries of one directory that match a wildcard.
+	// The directory must end with a path separator.
+	class CDirectoryIterator
+	{
+	public:
+		CDirectoryIterator();
+		~CDirectoryIterator();
+
+		// Positions on first matching entry, returns false if there is none
+		bool Open(const wchar_t* directory, const wchar_t* wildcard);
+		bool Next();
+		void Close();
+
+		const wchar_t* GetName() const;
+		bool IsDirectory() const;
+
+	private:
+		CDirectoryIterator(const CDirectoryIterator&);
+		CDirectoryIterator& operator=(const CDirectoryIterator&);
+
+#ifdef _WIN32
+		HANDLE m_hFind;
+		WIN32_FIND_DATAW m_findData;
+#else
+		bool ReadEntry();
+
+		DIR* m_pDir;
+		std::string m_directory;
+		std::string m_wildcard;
+		std::wstring m_name;
+		bool m_isDirectory;
+#endif
+	};
+}
@@ -0,0 +1,215 @@
+#include "LayoutPolicy.h"
+#include "BIGFile.h"
+#include "FileAccess.h"
+#include <algorithm>
+#include <string.h>
+
+
+namespace {
+
+struct SExtensionRank
+{
+	const char* extension;
+	uint32 rank;
+};
+
+// Rough order in which the game touches file types during startup.
+// Text data is parsed first, then the shell and models, textures and sounds.
+const SExtensionRank s_extensionRanks[] =
+{
+	{ "ini", 0 },
+	{ "str", 0 },
+	{ "csf", 0 },
+	{ "txt", 0 },
+	{ "wnd", 1 },
+	{ "w3d", 2 },
+	{ "wak", 2 },
+	{ "dds", 3 },
+	{ "tga", 3 },
+	{ "wav", 4 },
+	{ "mp3", 4 },
+	{ "bik", 7 },
+};
+
+const uint32 s_unknownExtensionRank = 6;
+
+// Map specific files are only loaded when a map is started
+const char s_mapDirectory[] = "maps\\";
+const uint32 s_mapDirectoryRank = 5;
+
+struct SLayoutKey
+{
+	uint32 rank;
+	std::string group;
+	uint32 fileIndex;
+};
+
+struct SLayoutKeyLess
+{
+	bool operator()(const SLayoutKey& left, const SLayoutKey& right) const
+	{
+		if (left.rank != right.rank)
+			return left.rank < right.rank;
+		return left.group < right.group;
+	}
+};
+
+} // namespace
+
+
+CLayoutPolicy::CLayoutPolicy()
+: m_order(eOrder_Header)
+, m_traceRanks()
+{
+}
+
+bool CLayoutPolicy::LoadAccessTrace(const wchar_t* wcsTraceFileName)
+{
+	TStrings names;
+	if (ReadAccessTrace(names, wcsTraceFileName))
+	{
+		m_traceRanks.clear();
+		const uint32 nameCount = static_cast<uint32>(names.size());
+		for (uint32 nameIndex = 0; nameIndex < nameCount; ++nameIndex)
+		{
+			// Only the first access of a file matters for the layout. Ranks are dense,
+			// so that files that were never accessed can rank behind all accessed files.
+			const uint32 rank = static_cast<uint32>(m_traceRanks.size());
+			m_traceRanks.insert(TRankMap::value_type(names[nameIndex], rank));
+		}
+		return true;
+	}
+	return false;
+}
+
+void CLayoutPolicy::SortLayout(TIntegers& layout, const TNames& names) const
+{
+	if (m_order == eOrder_Header)
+		return;
+
+	const uint32 fileCount = static_cast<uint32>(layout.size());
+	std::vector<SLayoutKey> keys;
+	keys.resize(fileCount);
+
+	for (uint32 i = 0; i < fileCount; ++i)
+	{
+		const uint32 fileIndex = layout[i];
+		assert(fileIndex < names.size());
+		std::string simplifiedName = names[fileIndex];
+		CBIGFile::ApplySimplifiedCharset(simplifiedName);
+
+		SLayoutKey& key = keys[i];
+		key.rank = 0;
+		key.fileIndex = fileIndex;
+
+		switch (m_order)
+		{
+		case eOrder_Extension:
+			if (simplifiedName.compare(0, ARRAY_SIZE(s_mapDirectory) - 1, s_mapDirectory) == 0)
+			{
+				key.rank = s_mapDirectoryRank;
+				GetDirectory(key.group, simplifiedName);
+			}
+			else
+			{
+				key.rank = GetExtensionRank(simplifiedName);
+			}
+			break;
+
+		case eOrder_Directory:
+			GetDirectory(key.group, simplifiedName);
+			break;
+
+		case eOrder_Trace:
+			{
+				// Files that were never accessed go behind all accessed files
+				TRankMap::const_iterator it = m_traceRanks.find(simplifiedName);
+				key.rank = (it != m_traceRanks.end()) ? it->second : static_cast<uint32>(m_traceRanks.size());
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// Stable sort keeps the header order within each group
+	std::stable_sort(keys.begin(), keys.end(), SLayoutKeyLess());
+
+	for (uint32 i = 0; i < fileCount; ++i)
+	{
+		layout[i] = keys[i].fileIndex;
+	}
+}
+
+bool CLayoutPolicy::ParseOrder(EOrder& order, const char* szOrder)
+{
+	if (::strcmp(szOrder, "header") == 0)
+		order = eOrder_Header;
+	else if (::strcmp(szOrder, "extension") == 0)
+		order = eOrder_Extension;
+	else if (::strcmp(szOrder, "directory") == 0)
+		order = eOrder_Directory;
+	else if (::strcmp(szOrder, "trace") == 0)
+		order = eOrder_Trace;
+	else
+		return false;
+	return true;
+}
+
+bool CLayoutPolicy::ReadAccessTrace(TStrings& names, const wchar_t* wcsTraceFileName)
+{
+	// An access trace is a text file with one file name per line,
+	// in the order the game opened the files
+	fileaccess::TStringData data;
+	if (fileaccess::ReadDataFromFile(wcsTraceFileName, data) != fileaccess::eError_Success)
+		return false;
+
+	names.clear();
+	size_t begin = 0;
+
+	while (begin < data.size())
+	{
+		size_t end = data.find('\n', begin);
+		if (end == std::string::npos)
+			end = data.size();
+
+		size_t last = end;
+		while (last > begin && (data[last-1] == '\r' || data[last-1] == ' ' || data[last-1] == '\t'))
+			--last;
+
+		if (last > begin)
+		{
+			names.push_back(data.substr(begin, last - begin));
+			CBIGFile::ApplySimplifiedCharset(names.back());
+		}
+		begin = end + 1;
+	}
+	return true;
+}
+
+uint32 CLayoutPolicy::GetExtensionRank(const std::string& simplifiedName)
+{
+	const size_t dot = simplifiedName.rfind('.');
+	if (dot != std::string::npos)
+	{
+		const char* extension = simplifiedName.c_str() + dot + 1;
+		for (size_t i = 0; i < ARRAY_SIZE(s_extensionRanks); ++i)
+		{
+			if (::strcmp(extension, s_extensionRanks[i].extension) == 0)
+			{
+				return s_extensionRanks[i].rank;
+			}
+		}
+	}
+	return s_unknownExtensionRank;
+}
+
+void CLayoutPolicy::GetDirectory(std::string& directory, const std::string& simplifiedName)
+{
+	const size_t separator = simplifiedName.rfind('\\');
+	if (separator != std::string::npos)
+		directory.assign(simplifiedName, 0, separator + 1);
+	else
+		directory.clear();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "types.h"
+
+// Decides in which order file payloads are laid out inside a .big file.
+// The order of the file headers is not touched, because the game resolves
+// duplicate names by header order. Only the payload offsets are rearranged,
+// so that files the game loads together are stored next to each other.
+
+class CLayoutPolicy
+{
+public:
+	enum EOrder
+	{
+		eOrder_Header = 0, // Payloads in file header order
+		eOrder_Extension,  // Payloads grouped by file type in game load order
+		eOrder_Directory,  // Payloads grouped by directory
+		eOrder_Trace,      // Payloads in order of a recorded access trace
+	};
+
+	typedef std::vector<uint32> TIntegers;
+	typedef std::vector<const char*> TNames;
+	typedef std::vector<std::string> TStrings;
+
+private:
+	typedef std::map<std::string, uint32> TRankMap;
+
+public:
+	CLayoutPolicy();
+
+	void SetOrder(EOrder order) { m_order = order; }
+	EOrder GetOrder() const { return m_order; }
+
+	bool LoadAccessTrace(const wchar_t* wcsTraceFileName);
+
+	// Sorts the file indices in layout by the order this policy wants their payloads to be written in.
+	void SortLayout(TIntegers& layout, const TNames& names) const;
+
+	static bool ParseOrder(EOrder& order, const char* szOrder);
+	static bool ReadAccessTrace(TStrings& names, const wchar_t* wcsTraceFileName);
+
+private:
+	static uint32 GetExtensionRank(const std::string& simplifiedName);
+	static void GetDirectory(std::string& directory, const std::string& simplifiedName);
+
+	EOrder m_order;
+	TRankMap m_traceRanks;
+};
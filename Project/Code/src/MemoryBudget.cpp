@@ -0,0 +1,58 @@
+#include "MemoryBudget.h"
+#include "Trace.h"
+#include <cassert>
+
+
+CMemoryBudget::CMemoryBudget(uint64 limit)
+: m_limit(limit)
+, m_heldBytes(0)
+{
+}
+
+CMemoryBudget::~CMemoryBudget()
+{
+	assert(m_heldBytes == 0);
+}
+
+bool CMemoryBudget::Fits(uint64 bytes) const
+{
+	return m_heldBytes == 0 || m_heldBytes + bytes <= m_limit;
+}
+
+bool CMemoryBudget::TryAcquire(uint64 bytes)
+{
+	CScopedLock lock(m_mutex);
+	if (!Fits(bytes))
+		return false;
+
+	m_heldBytes += bytes;
+	return true;
+}
+
+void CMemoryBudget::Acquire(uint64 bytes)
+{
+	CScopedLock lock(m_mutex);
+	if (!Fits(bytes))
+	{
+		TRACE_SCOPED_EVENT("memory wait");
+		do
+		{
+			m_released.Wait(m_mutex);
+		}
+		while (!Fits(bytes));
+	}
+	m_heldBytes += bytes;
+}
+
+void CMemoryBudget::Release(uint64 bytes)
+{
+	CScopedLock lock(m_mutex);
+	assert(bytes <= m_heldBytes);
+	m_heldBytes -= bytes;
+	m_released.NotifyAll();
+}
+
+uint64 CMemoryBudget::GetLimit() const
+{
+	return m_limit;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "types.h"
+#include "mutex.h"
+
+// Limits the bytes that concurrent users hold together. A request larger than the
+// whole limit is granted once nothing else is held, so that it cannot wait forever.
+// Users that wait must not hold bytes themselves, otherwise they can block each other.
+
+class CMemoryBudget
+{
+public:
+	enum : uint32
+	{
+		DefaultLimit = 1024 * 1024 * 1024,
+	};
+
+	explicit CMemoryBudget(uint64 limit = DefaultLimit);
+	~CMemoryBudget();
+
+	// Takes the bytes if they fit, never waits
+	bool TryAcquire(uint64 bytes);
+	// Waits until the bytes fit and takes them
+	void Acquire(uint64 bytes);
+	void Release(uint64 bytes);
+
+	uint64 GetLimit() const;
+
+private:
+	CMemoryBudget(const CMemoryBudget&);
+	CMemoryBudget& operator=(const CMemoryBudget&);
+
+	bool Fits(uint64 bytes) const;
+
+	CMutex m_mutex;
+	CConditionVariable m_released;
+	const uint64 m_limit;
+	uint64 m_heldBytes;
+};
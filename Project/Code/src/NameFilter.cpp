@@ -0,0 +1,121 @@
+#include "NameFilter.h"
+#include <algorithm>
+
+
+namespace {
+
+inline bool IsSeparator(char c)
+{
+	return c == '\\' || c == '/';
+}
+
+inline bool IsWildcard(char c)
+{
+	return c == '*' || c == '?';
+}
+
+inline bool IsWildcardOrSeparator(char c)
+{
+	return IsWildcard(c) || IsSeparator(c);
+}
+
+} // namespace
+
+
+void CNameFilter::AddPattern(const char* szPattern, bool simplify)
+{
+	m_patterns.push_back(SPattern());
+	SPattern& newPattern = m_patterns.back();
+	newPattern.pattern = szPattern;
+
+	if (simplify)
+	{
+		CBIGFile::ApplySimplifiedCharset(newPattern.pattern);
+	}
+
+	const std::string& pattern = newPattern.pattern;
+	newPattern.prefixLength = std::find_if(pattern.begin(), pattern.end(), simplify ? IsWildcard : IsWildcardOrSeparator) - pattern.begin();
+}
+
+bool CNameFilter::IsEmpty() const
+{
+	return m_patterns.empty();
+}
+
+bool CNameFilter::Matches(const char* szName) const
+{
+	const size_t patternCount = m_patterns.size();
+	for (size_t patternIndex = 0; patternIndex < patternCount; ++patternIndex)
+	{
+		if (MatchGlob(m_patterns[patternIndex].pattern.c_str(), szName))
+			return true;
+	}
+	return false;
+}
+
+void CNameFilter::FindFileIds(CBIGFile::TFileIds& fileIds, const CBIGFile& bigFile) const
+{
+	const size_t firstNewId = fileIds.size();
+	CBIGFile::TFileIds candidateIds;
+	std::string prefix;
+
+	const size_t patternCount = m_patterns.size();
+	for (size_t patternIndex = 0; patternIndex < patternCount; ++patternIndex)
+	{
+		const std::string& pattern = m_patterns[patternIndex].pattern;
+		const size_t prefixLength = m_patterns[patternIndex].prefixLength;
+		prefix.assign(pattern, 0, prefixLength);
+
+		candidateIds.clear();
+		bigFile.FindFileIdsByPrefix(candidateIds, prefix.c_str());
+
+		const size_t candidateCount = candidateIds.size();
+		for (size_t candidateIndex = 0; candidateIndex < candidateCount; ++candidateIndex)
+		{
+			const uint32 fileId = candidateIds[candidateIndex];
+			if (MatchGlob(pattern.c_str() + prefixLength, bigFile.GetFileNameById(fileId) + prefixLength))
+			{
+				fileIds.push_back(fileId);
+			}
+		}
+	}
+
+	// Patterns can overlap
+	std::sort(fileIds.begin() + firstNewId, fileIds.end());
+	fileIds.erase(std::unique(fileIds.begin() + firstNewId, fileIds.end()), fileIds.end());
+}
+
+bool CNameFilter::MatchGlob(const char* szPattern, const char* szName)
+{
+	for (; *szPattern; ++szPattern, ++szName)
+	{
+		if (*szPattern == '*')
+		{
+			const bool crossSeparators = (szPattern[1] == '*');
+			szPattern += crossSeparators ? 2 : 1;
+
+			// Try every possible length for the star, shortest first
+			for (;; ++szName)
+			{
+				if (MatchGlob(szPattern, szName))
+					return true;
+				if (*szName == '\0' || (!crossSeparators && IsSeparator(*szName)))
+					return false;
+			}
+		}
+
+		if (*szName == '\0')
+			return false;
+
+		if (*szPattern == '?')
+		{
+			if (IsSeparator(*szName))
+				return false;
+		}
+		else if (*szPattern != *szName && !(IsSeparator(*szPattern) && IsSeparator(*szName)))
+		{
+			return false;
+		}
+	}
+	return *szName == '\0';
+}
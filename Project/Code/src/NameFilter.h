@@ -0,0 +1,39 @@
+#pragma once
+
+#include "types.h"
+#include "BIGFile.h"
+#include <string>
+#include <vector>
+
+// Selects files of a .big file by glob patterns on their names.
+// '?' matches one character, '*' any characters within one directory
+// and '**' any characters across directories. A file is selected if any pattern matches.
+// Slashes and backslashes match each other. The literal part in front of the first
+// wildcard is looked up in the name index, so only names with that prefix are matched
+// against the pattern. Without simplified names the prefix ends at the first slash,
+// because names can use either kind.
+
+class CNameFilter
+{
+public:
+	struct SPattern
+	{
+		std::string pattern;
+		size_t prefixLength;
+	};
+	typedef std::vector<SPattern> TPatterns;
+
+	// Simplify must be set if the names of the .big file are simplified
+	void AddPattern(const char* szPattern, bool simplify);
+	bool IsEmpty() const;
+
+	bool Matches(const char* szName) const;
+
+	// Adds ids of matching files in id order
+	void FindFileIds(CBIGFile::TFileIds& fileIds, const CBIGFile& bigFile) const;
+
+	static bool MatchGlob(const char* szPattern, const char* szName);
+
+private:
+	TPatterns m_patterns;
+};
@@ -0,0 +1,102 @@
+#include "SequentialWriter.h"
+#include "FileSystem.h"
+#include "Stats.h"
+#include "Trace.h"
+#include <algorithm>
+#include <string.h>
+
+
+CSequentialWriter::CSequentialWriter(filesystem::CReplaceFile& file, size_t bufferSize)
+: m_file(file)
+, m_bufferSize(std::max(bufferSize, static_cast<size_t>(4096)))
+, m_position(0)
+, m_failed(false)
+{
+	m_buffer.reserve(m_bufferSize);
+}
+
+CSequentialWriter::~CSequentialWriter()
+{
+	// Unflushed data is dropped, the file is expected to be discarded then
+}
+
+bool CSequentialWriter::Write(const char* data, size_t size)
+{
+	if (m_failed)
+		return false;
+
+	m_position += size;
+
+	if (m_buffer.size() + size > m_bufferSize)
+	{
+		if (!Flush())
+			return false;
+
+		if (size >= m_bufferSize)
+		{
+			return WriteToFile(data, size);
+		}
+	}
+
+	const size_t offset = m_buffer.size();
+	m_buffer.resize(offset + size);
+	::memcpy(m_buffer.data() + offset, data, size);
+	return true;
+}
+
+bool CSequentialWriter::WriteZeros(size_t count)
+{
+	if (m_failed)
+		return false;
+
+	m_position += count;
+
+	while (count != 0)
+	{
+		if (m_buffer.size() == m_bufferSize && !Flush())
+			return false;
+
+		const size_t offset = m_buffer.size();
+		const size_t chunkSize = std::min(count, m_bufferSize - offset);
+		m_buffer.resize(offset + chunkSize);
+		::memset(m_buffer.data() + offset, 0, chunkSize);
+		count -= chunkSize;
+	}
+	return true;
+}
+
+bool CSequentialWriter::CopyFrom(const filesystem::CInputFile& source, uint64 offset, uint64 size)
+{
+	if (!Flush())
+		return false;
+
+	TRACE_SCOPED_EVENT("range copy");
+
+	m_position += size;
+	stats::AddCount(stats::eCounter_FileWrite);
+	m_failed = !m_file.CopyFrom(source, offset, size);
+	return !m_failed;
+}
+
+bool CSequentialWriter::Flush()
+{
+	if (m_failed)
+		return false;
+
+	if (!m_buffer.empty())
+	{
+		const bool ok = WriteToFile(m_buffer.data(), m_buffer.size());
+		m_buffer.clear();
+		return ok;
+	}
+	return true;
+}
+
+bool CSequentialWriter::WriteToFile(const char* data, size_t size)
+{
+	TRACE_SCOPED_EVENT("sequential write");
+
+	stats::AddCount(stats::eCounter_FileWrite);
+	m_failed = !m_file.Write(data, size);
+	return !m_failed;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+#include "Buffer.h"
+#include <stddef.h>
+
+namespace filesystem
+{
+	class CInputFile;
+	class CReplaceFile;
+}
+
+// Collects writes to a file in a large buffer and passes them on in big
+// sequential chunks. There is no seeking, data is appended in call order.
+// Writes larger than the buffer go to the file directly without a copy.
+
+class CSequentialWriter
+{
+public:
+	enum : uint32
+	{
+		DefaultBufferSize = 8 * 1024 * 1024,
+	};
+
+	explicit CSequentialWriter(filesystem::CReplaceFile& file, size_t bufferSize = DefaultBufferSize);
+	~CSequentialWriter();
+
+	bool Write(const char* data, size_t size);
+	bool WriteZeros(size_t count);
+	// Appends a range of another file behind the buffered data without reading it into the buffer
+	bool CopyFrom(const filesystem::CInputFile& source, uint64 offset, uint64 size);
+
+	// Passes buffered data on to the file, must be called before the file is committed
+	bool Flush();
+
+	uint64 GetPosition() const { return m_position; }
+
+private:
+	CSequentialWriter(const CSequentialWriter&);
+	CSequentialWriter& operator=(const CSequentialWriter&);
+
+	bool WriteToFile(const char* data, size_t size);
+
+	filesystem::CReplaceFile& m_file;
+	CBuffer m_buffer;
+	size_t m_bufferSize;
+	uint64 m_position;
+	bool m_failed;
+};
@@ -0,0 +1,153 @@
+#include "Stats.h"
+#include "atomic.h"
+#include "timer.h"
+#include "utildef.h"
+#include <iomanip>
+#include <new>
+#include <stdlib.h>
+
+
+namespace stats {
+namespace {
+
+struct SPhaseStats
+{
+	volatile int64 calls;
+	volatile int64 ticks;
+	volatile int64 bytes;
+};
+
+bool s_enabled = false;
+SPhaseStats s_phases[ePhase_Count];
+volatile int64 s_counters[eCounter_Count];
+
+const char* const s_phaseNames[ePhase_Count] =
+{
+	"directory walk",
+	"source read",
+	"add file",
+	"header build",
+	"write out",
+};
+
+} // namespace
+
+
+void Enable(bool enable)
+{
+	s_enabled = enable;
+}
+
+bool IsEnabled()
+{
+	return s_enabled;
+}
+
+void AddPhaseTicks(EPhase phase, uint64 ticks)
+{
+	if (s_enabled)
+	{
+		atomic::Add(&s_phases[phase].calls, 1);
+		atomic::Add(&s_phases[phase].ticks, static_cast<int64>(ticks));
+	}
+}
+
+void AddPhaseBytes(EPhase phase, uint64 bytes)
+{
+	if (s_enabled)
+	{
+		atomic::Add(&s_phases[phase].bytes, static_cast<int64>(bytes));
+	}
+}
+
+void AddCount(ECounter counter, uint64 count)
+{
+	if (s_enabled)
+	{
+		atomic::Add(&s_counters[counter], static_cast<int64>(count));
+	}
+}
+
+uint64 GetCount(ECounter counter)
+{
+	return static_cast<uint64>(atomic::Load(&s_counters[counter]));
+}
+
+void Print(std::ostream& stream)
+{
+	// Phase times are inclusive. Header builds happen inside file adds and write outs.
+	const std::ios::fmtflags flags = stream.flags();
+	stream << "Stats:" << std::endl;
+	stream << "  " << std::left << std::setw(16) << "PHASE" << std::right
+	       << std::setw(10) << "CALLS" << std::setw(14) << "SECONDS" << std::setw(16) << "BYTES" << std::endl;
+
+	for (int phase = 0; phase < ePhase_Count; ++phase)
+	{
+		SPhaseStats& phaseStats = s_phases[phase];
+		stream << "  " << std::left << std::setw(16) << s_phaseNames[phase] << std::right
+		       << std::setw(10) << atomic::Load(&phaseStats.calls)
+		       << std::setw(14) << std::fixed << std::setprecision(6) << timer::TicksToSeconds(atomic::Load(&phaseStats.ticks))
+		       << std::setw(16) << atomic::Load(&phaseStats.bytes) << std::endl;
+	}
+
+	const int64 fileOpens = atomic::Load(&s_counters[eCounter_FileOpen]);
+	const int64 fileReads = atomic::Load(&s_counters[eCounter_FileRead]);
+	const int64 fileWrites = atomic::Load(&s_counters[eCounter_FileWrite]);
+	const int64 fileSeeks = atomic::Load(&s_counters[eCounter_FileSeek]);
+	const int64 directoryReads = atomic::Load(&s_counters[eCounter_DirectoryRead]);
+
+	stream << "  file operations: " << (fileOpens + fileReads + fileWrites + fileSeeks + directoryReads)
+	       << " (open " << fileOpens << ", read " << fileReads << ", write " << fileWrites
+	       << ", seek " << fileSeeks << ", directory " << directoryReads << ")" << std::endl;
+	stream << "  allocations:     " << atomic::Load(&s_counters[eCounter_Allocation])
+	       << " (" << atomic::Load(&s_counters[eCounter_AllocationBytes]) << " bytes)" << std::endl;
+	stream.flags(flags);
+}
+
+CScopedPhase::CScopedPhase(EPhase phase)
+	: m_phase(phase)
+	, m_startTicks(s_enabled ? timer::GetTicks() : 0)
+{
+}
+
+CScopedPhase::~CScopedPhase()
+{
+	if (m_startTicks != 0)
+	{
+		AddPhaseTicks(m_phase, timer::GetTicks() - m_startTicks);
+	}
+}
+
+} // namespace stats
+
+
+// Global allocation hooks to count allocations while stats are enabled
+
+void* operator new(size_t size)
+{
+	if (stats::s_enabled)
+	{
+		stats::AddCount(stats::eCounter_Allocation);
+		stats::AddCount(stats::eCounter_AllocationBytes, size);
+	}
+
+	void* p = ::malloc(size != 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p)
+{
+	::free(p);
+}
+
+void operator delete[](void* p)
+{
+	::free(p);
+}
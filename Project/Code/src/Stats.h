@@ -0,0 +1,71 @@
+#pragma once
+
+#include "types.h"
+#include <iostream>
+
+// Lightweight instrumentation of the hot paths.
+// Collection is switched off by default and then costs one branch per scope.
+
+namespace stats
+{
+	enum EPhase
+	{
+		ePhase_DirectoryWalk = 0, // Search for source files
+		ePhase_SourceRead,        // Read of source files
+		ePhase_AddFile,           // Add of files to .big file
+		ePhase_HeaderBuild,       // Build of .big file headers
+		ePhase_WriteOut,          // Write out of .big file
+
+		ePhase_Count
+	};
+
+	enum ECounter
+	{
+		eCounter_FileOpen = 0,
+		eCounter_FileRead,
+		eCounter_FileWrite,
+		eCounter_FileSeek,
+		eCounter_DirectoryRead,
+		eCounter_Allocation,
+		eCounter_AllocationBytes,
+
+		eCounter_Count
+	};
+
+	void Enable(bool enable);
+	bool IsEnabled();
+
+	void AddPhaseTicks(EPhase phase, uint64 ticks);
+	void AddPhaseBytes(EPhase phase, uint64 bytes);
+	void AddCount(ECounter counter, uint64 count = 1);
+	uint64 GetCount(ECounter counter);
+
+	void Print(std::ostream& stream);
+
+	class CScopedPhase
+	{
+	public:
+		explicit CScopedPhase(EPhase phase);
+		~CScopedPhase();
+
+	private:
+		EPhase m_phase;
+		uint64 m_startTicks;
+	};
+
+	// Prints collected stats when leaving scope
+	class CPrintOnExit
+	{
+	public:
+		explicit CPrintOnExit(std::ostream& stream) : m_stream(stream) {}
+		~CPrintOnExit() { if (IsEnabled()) Print(m_stream); }
+
+	private:
+		CPrintOnExit& operator=(const CPrintOnExit&);
+		std::ostream& m_stream;
+	};
+}
+
+#define STATS_SCOPED_PHASE_0(phase, line) stats::CScopedPhase statsScopedPhase##line(phase)
+#define STATS_SCOPED_PHASE_1(phase, line) STATS_SCOPED_PHASE_0(phase, line)
+#define STATS_SCOPED_PHASE(phase)         STATS_SCOPED_PHASE_1(phase, __LINE__)
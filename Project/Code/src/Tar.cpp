@@ -0,0 +1,325 @@
+#include "Tar.h"
+#include <algorithm>
+#include <stddef.h>
+#include <string.h>
+
+
+namespace tar {
+namespace {
+
+enum : uint32
+{
+	NameSize = 100,
+	PrefixSize = 155,
+};
+
+// Field layout of a ustar header block
+struct SHeader
+{
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char padding[12];
+};
+
+uint32 GetChecksum(const SHeader& header)
+{
+	// Checksum is calculated with the checksum field set to spaces
+	const uint8* pBytes = reinterpret_cast<const uint8*>(&header);
+	uint32 checksum = 0;
+	for (size_t i = 0; i < sizeof(header); ++i)
+	{
+		const bool inChecksumField = i >= offsetof(SHeader, checksum) && i < offsetof(SHeader, checksum) + sizeof(header.checksum);
+		checksum += inChecksumField ? ' ' : pBytes[i];
+	}
+	return checksum;
+}
+
+uint64 ReadNumber(const char* field, size_t fieldSize)
+{
+	// Octal digits, or big endian binary if the high bit of the first byte is set
+	uint64 value = 0;
+	if (static_cast<uint8>(field[0]) & 0x80)
+	{
+		value = static_cast<uint8>(field[0]) & 0x7F;
+		for (size_t i = 1; i < fieldSize; ++i)
+		{
+			value = (value << 8) | static_cast<uint8>(field[i]);
+		}
+		return value;
+	}
+
+	size_t i = 0;
+	while (i < fieldSize && field[i] == ' ')
+		++i;
+	for (; i < fieldSize && field[i] >= '0' && field[i] <= '7'; ++i)
+	{
+		value = (value << 3) | static_cast<uint64>(field[i] - '0');
+	}
+	return value;
+}
+
+void AssignField(std::string& str, const char* field, size_t fieldSize)
+{
+	const char* pEnd = static_cast<const char*>(::memchr(field, '\0', fieldSize));
+	str.assign(field, pEnd ? pEnd : field + fieldSize);
+}
+
+bool FindPaxPath(std::string& path, const CBuffer& records)
+{
+	// Records are "<length> <key>=<value>\n", where length counts the whole record
+	size_t offset = 0;
+	bool found = false;
+	while (offset < records.size())
+	{
+		size_t length = 0;
+		size_t i = offset;
+		for (; i < records.size() && records[i] >= '0' && records[i] <= '9'; ++i)
+		{
+			length = length * 10 + static_cast<size_t>(records[i] - '0');
+		}
+		if (length == 0 || offset + length > records.size() || i >= records.size() || records[i] != ' ')
+			break;
+
+		const char* pKey = records.data() + i + 1;
+		const char* pEnd = records.data() + offset + length - 1;
+		if (pEnd - pKey > 5 && ::memcmp(pKey, "path=", 5) == 0)
+		{
+			path.assign(pKey + 5, pEnd);
+			found = true;
+		}
+		offset += length;
+	}
+	return found;
+}
+
+void WriteOctal(char* field, size_t fieldSize, uint64 value)
+{
+	// Zero padded octal digits followed by a null
+	field[fieldSize - 1] = '\0';
+	for (size_t i = fieldSize - 1; i != 0; --i)
+	{
+		field[i - 1] = static_cast<char>('0' + (value & 7));
+		value >>= 3;
+	}
+}
+
+void AppendHeader(std::string& blocks, const char* szName, size_t nameLength, const char* szPrefix, size_t prefixLength, uint64 size, char typeflag)
+{
+	SHeader header;
+	::memset(&header, 0, sizeof(header));
+
+	::memcpy(header.name, szName, nameLength);
+	::memcpy(header.prefix, szPrefix, prefixLength);
+	WriteOctal(header.mode, sizeof(header.mode), 0644);
+	WriteOctal(header.uid, sizeof(header.uid), 0);
+	WriteOctal(header.gid, sizeof(header.gid), 0);
+	WriteOctal(header.size, sizeof(header.size), size);
+	WriteOctal(header.mtime, sizeof(header.mtime), 0);
+	header.typeflag = typeflag;
+	::memcpy(header.magic, "ustar", 6);
+	::memcpy(header.version, "00", 2);
+
+	WriteOctal(header.checksum, 7, GetChecksum(header));
+	header.checksum[7] = ' ';
+
+	blocks.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+} // namespace
+
+
+void AppendFileHeader(std::string& blocks, const char* szName, uint64 size)
+{
+	std::string name(szName);
+	std::replace(name.begin(), name.end(), '\\', '/');
+	const size_t length = name.size();
+
+	if (length <= NameSize)
+	{
+		AppendHeader(blocks, name.c_str(), length, "", 0, size, '0');
+		return;
+	}
+
+	// Split at a slash into prefix and name, where both fit their fields
+	for (size_t split = std::min(length - 1, static_cast<size_t>(PrefixSize)); split != 0; --split)
+	{
+		if (name[split] == '/' && length - split - 1 <= NameSize)
+		{
+			AppendHeader(blocks, name.c_str() + split + 1, length - split - 1, name.c_str(), split, size, '0');
+			return;
+		}
+	}
+
+	// GNU long name record holds the full name as data of a pseudo file
+	AppendHeader(blocks, "././@LongLink", 13, "", 0, length + 1, 'L');
+	blocks.append(name.c_str(), length + 1);
+	blocks.append(GetPaddingSize(length + 1), '\0');
+	AppendHeader(blocks, name.c_str(), NameSize, "", 0, size, '0');
+}
+
+bool IsHeader(const char* block)
+{
+	const SHeader& header = *reinterpret_cast<const SHeader*>(block);
+	if (header.name[0] == '\0')
+		return false;
+
+	return ReadNumber(header.checksum, sizeof(header.checksum)) == GetChecksum(header);
+}
+
+
+CReader::CReader(FILE* pFile, const char* pFirstBlock)
+: m_pFile(pFile)
+, m_hasFirstBlock(pFirstBlock != NULL)
+, m_failed(false)
+{
+	if (pFirstBlock)
+	{
+		::memcpy(m_firstBlock, pFirstBlock, BlockSize);
+	}
+}
+
+bool CReader::ReadNextFile(std::string& name, CBuffer& data)
+{
+	char block[BlockSize];
+	std::string longName;
+	bool hasLongName = false;
+
+	while (ReadBlock(block))
+	{
+		const SHeader& header = *reinterpret_cast<const SHeader*>(block);
+
+		if (header.name[0] == '\0')
+		{
+			// Zero block ends the stream
+			return false;
+		}
+
+		if (!IsHeader(block))
+		{
+			m_failed = true;
+			return false;
+		}
+
+		const uint64 size = ReadNumber(header.size, sizeof(header.size));
+
+		switch (header.typeflag)
+		{
+		case '0':
+		case '\0':
+		case '7':
+		{
+			if (hasLongName)
+			{
+				name.swap(longName);
+			}
+			else
+			{
+				AssignField(name, header.name, sizeof(header.name));
+				if (header.prefix[0] != '\0' && ::memcmp(header.magic, "ustar", 5) == 0)
+				{
+					std::string prefix;
+					AssignField(prefix, header.prefix, sizeof(header.prefix));
+					name.insert(0, prefix.append("/"));
+				}
+			}
+
+			if (size > 0xFFFFFFFFull)
+			{
+				// Does not fit into a .big file
+				m_failed = true;
+				return false;
+			}
+
+			data.resize(static_cast<size_t>(size));
+			if (!Read(data.data(), data.size()) || !Skip(GetPaddingSize(size)))
+				return false;
+			return true;
+		}
+		case 'L':
+		case 'x':
+		{
+			// Name of the next entry
+			CBuffer record;
+			record.resize(static_cast<size_t>(size));
+			if (!Read(record.data(), record.size()) || !Skip(GetPaddingSize(size)))
+				return false;
+
+			if (header.typeflag == 'L')
+			{
+				longName.assign(record.begin(), std::find(record.begin(), record.end(), '\0'));
+				hasLongName = true;
+			}
+			else if (FindPaxPath(longName, record))
+			{
+				hasLongName = true;
+			}
+			break;
+		}
+		default:
+			// Directories, links and others have no file data of interest
+			if (!Skip(size + GetPaddingSize(size)))
+				return false;
+			hasLongName = false;
+			break;
+		}
+	}
+	return false;
+}
+
+bool CReader::ReadBlock(char* block)
+{
+	if (m_hasFirstBlock)
+	{
+		::memcpy(block, m_firstBlock, BlockSize);
+		m_hasFirstBlock = false;
+		return true;
+	}
+
+	// A stream without end blocks ends cleanly at a block boundary
+	const size_t readSize = ::fread(block, 1, BlockSize, m_pFile);
+	if (readSize == 0 && !::ferror(m_pFile))
+		return false;
+	if (readSize != BlockSize)
+		m_failed = true;
+	return readSize == BlockSize;
+}
+
+bool CReader::Read(char* data, size_t size)
+{
+	if (size != 0 && ::fread(data, 1, size, m_pFile) != size)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+bool CReader::Skip(uint64 size)
+{
+	// Streams cannot seek, so data is read and dropped
+	char buffer[BlockSize * 8];
+	while (size != 0)
+	{
+		const size_t chunkSize = static_cast<size_t>(std::min(size, static_cast<uint64>(sizeof(buffer))));
+		if (!Read(buffer, chunkSize))
+			return false;
+		size -= chunkSize;
+	}
+	return true;
+}
+
+} // namespace tar
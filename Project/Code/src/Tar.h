@@ -0,0 +1,57 @@
+#pragma once
+
+#include "types.h"
+#include "Buffer.h"
+#include <stdio.h>
+#include <string>
+
+// Headers of the POSIX ustar format, so that .big file contents can be
+// exchanged with tar streams. Only regular files are of interest.
+// Names longer than the ustar fields are written as GNU long name records
+// and read from GNU long name or pax path records.
+
+namespace tar
+{
+	enum : uint32
+	{
+		BlockSize = 512,
+		EndSize = BlockSize * 2, // Two zero blocks end a tar stream
+	};
+
+	// Appends header blocks of a regular file. Backslashes in the name are written as slashes.
+	void AppendFileHeader(std::string& blocks, const char* szName, uint64 size);
+
+	// Returns count of zero bytes that fill file data up to the next block
+	inline uint32 GetPaddingSize(uint64 size)
+	{
+		return static_cast<uint32>((BlockSize - (size % BlockSize)) % BlockSize);
+	}
+
+	// Returns whether the block is a header with valid checksum
+	bool IsHeader(const char* block);
+
+	// Reads regular files from a tar stream one by one. Other entries are skipped.
+	class CReader
+	{
+	public:
+		// First block can be passed, if it was already read from the stream to detect the format
+		explicit CReader(FILE* pFile, const char* pFirstBlock = NULL);
+
+		// Returns false at the end of the stream or on error
+		bool ReadNextFile(std::string& name, CBuffer& data);
+		bool HasFailed() const { return m_failed; }
+
+	private:
+		CReader(const CReader&);
+		CReader& operator=(const CReader&);
+
+		bool ReadBlock(char* block);
+		bool Read(char* data, size_t size);
+		bool Skip(uint64 size);
+
+		FILE* m_pFile;
+		char m_firstBlock[BlockSize];
+		bool m_hasFirstBlock;
+		bool m_failed;
+	};
+}
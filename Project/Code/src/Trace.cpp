@@ -0,0 +1,259 @@
+#include "Trace.h"
+#include "FileSystem.h"
+#include "atomic.h"
+#include "compiler.h"
+#include "timer.h"
+#include <fstream>
+#include <string>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#elif !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+
+namespace trace {
+namespace {
+
+enum
+{
+	MaxDetailLength = 95,
+	EventsPerThread = 32768,
+};
+
+struct SEvent
+{
+	uint64 ticks;
+	const char* szName;
+	char phase;
+	char detail[MaxDetailLength + 1];
+};
+
+uint32 GetThreadId()
+{
+#if defined(_WIN32)
+	return static_cast<uint32>(::GetCurrentThreadId());
+#elif defined(__linux__)
+	return static_cast<uint32>(::syscall(SYS_gettid));
+#else
+	return static_cast<uint32>(reinterpret_cast<size_t>(::pthread_self()));
+#endif
+}
+
+struct SThreadBuffer
+{
+	SThreadBuffer()
+		: pNext(NULL)
+		, threadId(GetThreadId())
+		, eventCount(0)
+	{}
+
+	SThreadBuffer* pNext;
+	uint32 threadId;
+	uint64 eventCount; // Total events recorded, older events are overwritten when the ring is full
+	SEvent events[EventsPerThread];
+};
+
+bool s_started = false;
+uint64 s_startTicks = 0;
+std::wstring s_traceFileName;
+
+// Buffers of all threads that recorded events. Buffers are never freed before exit.
+SThreadBuffer* volatile s_pThreadBuffers = NULL;
+THREAD_LOCAL SThreadBuffer* t_pThreadBuffer = NULL;
+
+SThreadBuffer* GetThreadBuffer()
+{
+	if (t_pThreadBuffer == NULL)
+	{
+		SThreadBuffer* pBuffer = new SThreadBuffer();
+		void* pHead = NULL;
+
+		do
+		{
+			pHead = s_pThreadBuffers;
+			pBuffer->pNext = static_cast<SThreadBuffer*>(pHead);
+		}
+		while (atomic::CompareExchangePointer(reinterpret_cast<void* volatile*>(&s_pThreadBuffers), pBuffer, pHead) != pHead);
+
+		t_pThreadBuffer = pBuffer;
+	}
+	return t_pThreadBuffer;
+}
+
+SEvent& AddThreadEvent(const char* szName, char phase)
+{
+	SThreadBuffer* pBuffer = GetThreadBuffer();
+	SEvent& event = pBuffer->events[pBuffer->eventCount % EventsPerThread];
+	++pBuffer->eventCount;
+	event.ticks = timer::GetTicks();
+	event.szName = szName;
+	event.phase = phase;
+	event.detail[0] = '\0';
+	return event;
+}
+
+void WriteJsonString(std::ostream& stream, const char* str)
+{
+	stream << '"';
+	for (; *str; ++str)
+	{
+		const unsigned char c = static_cast<unsigned char>(*str);
+		if (c == '"' || c == '\\')
+		{
+			stream << '\\' << *str;
+		}
+		else if (c < 0x20 || c >= 0x80)
+		{
+			// Names are 8 bit code page strings. Bytes that are no plain ASCII are
+			// escaped as code points of the same value, so the JSON stays valid UTF-8.
+			static const char s_hexDigits[] = "0123456789abcdef";
+			stream << "\\u00" << s_hexDigits[c >> 4] << s_hexDigits[c & 0xF];
+		}
+		else
+		{
+			stream << *str;
+		}
+	}
+	stream << '"';
+}
+
+} // namespace
+
+
+bool Start(const wchar_t* wcsTraceFileName)
+{
+	if (wcsTraceFileName && *wcsTraceFileName)
+	{
+		s_traceFileName = wcsTraceFileName;
+		s_startTicks = timer::GetTicks();
+		s_started = true;
+		return true;
+	}
+	return false;
+}
+
+bool IsStarted()
+{
+	return s_started;
+}
+
+bool WriteOut()
+{
+	// Must not race with recording threads. Call after all work is done.
+	if (!s_started)
+		return false;
+
+	s_started = false;
+	std::ofstream file;
+	filesystem::OpenStream(file, s_traceFileName.c_str(), std::ios::out | std::ios::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file << "{\"traceEvents\":[" << std::endl;
+	bool first = true;
+
+	for (const SThreadBuffer* pBuffer = s_pThreadBuffers; pBuffer; pBuffer = pBuffer->pNext)
+	{
+		const uint64 eventCount = pBuffer->eventCount;
+		const uint64 firstEvent = (eventCount > EventsPerThread) ? eventCount - EventsPerThread : 0;
+		uint64 openScopeCount = 0;
+
+		for (uint64 eventIndex = firstEvent; eventIndex < eventCount; ++eventIndex)
+		{
+			const SEvent& event = pBuffer->events[eventIndex % EventsPerThread];
+
+			// Scopes nest per thread. An end event whose begin event was overwritten
+			// in the ring is left out, so that begin and end events stay in pairs.
+			if (event.phase == 'B')
+			{
+				++openScopeCount;
+			}
+			else if (event.phase == 'E')
+			{
+				if (openScopeCount == 0)
+					continue;
+				--openScopeCount;
+			}
+
+			const uint64 ticks = (event.ticks > s_startTicks) ? event.ticks - s_startTicks : 0;
+
+			file << (first ? "" : ",\n");
+			file << "{\"name\":";
+			WriteJsonString(file, event.szName);
+			file << ",\"ph\":\"" << event.phase << "\"";
+			file << ",\"ts\":" << timer::TicksToMicroseconds(ticks);
+			file << ",\"pid\":1,\"tid\":" << pBuffer->threadId;
+			if (event.detail[0] != '\0')
+			{
+				file << ",\"args\":{\"file\":";
+				WriteJsonString(file, event.detail);
+				file << "}";
+			}
+			file << "}";
+			first = false;
+		}
+	}
+
+	file << std::endl << "]}" << std::endl;
+	return file.good();
+}
+
+void AddEvent(const char* szName, char phase, const char* szDetail)
+{
+	if (s_started)
+	{
+		SEvent& event = AddThreadEvent(szName, phase);
+		if (szDetail)
+		{
+			::strncpy(event.detail, szDetail, MaxDetailLength);
+			event.detail[MaxDetailLength] = '\0';
+		}
+	}
+}
+
+void AddEvent(const char* szName, char phase, const wchar_t* wcsDetail)
+{
+	if (s_started)
+	{
+		SEvent& event = AddThreadEvent(szName, phase);
+		if (wcsDetail)
+		{
+			// Cheap narrowing, the detail is only informative
+			size_t i = 0;
+			for (; i < MaxDetailLength && wcsDetail[i]; ++i)
+			{
+				event.detail[i] = (wcsDetail[i] < 0x80) ? static_cast<char>(wcsDetail[i]) : '?';
+			}
+			event.detail[i] = '\0';
+		}
+	}
+}
+
+CScopedEvent::CScopedEvent(const char* szName)
+	: m_szName(szName)
+{
+	AddEvent(szName, 'B');
+}
+
+CScopedEvent::CScopedEvent(const char* szName, const char* szDetail)
+	: m_szName(szName)
+{
+	AddEvent(szName, 'B', szDetail);
+}
+
+CScopedEvent::CScopedEvent(const char* szName, const wchar_t* wcsDetail)
+	: m_szName(szName)
+{
+	AddEvent(szName, 'B', wcsDetail);
+}
+
+CScopedEvent::~CScopedEvent()
+{
+	AddEvent(m_szName, 'E');
+}
+
+} // namespace trace
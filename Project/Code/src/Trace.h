@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+#include <stddef.h>
+
+// Records begin and end events of pack and extract work per thread and writes them
+// out in Chrome trace event format, which can be viewed in chrome://tracing or Perfetto.
+// Each thread writes into its own ring buffer, so recording takes no locks.
+// Recording is switched off by default and then costs one branch per scope.
+
+namespace trace
+{
+	bool Start(const wchar_t* wcsTraceFileName);
+	bool IsStarted();
+	bool WriteOut();
+
+	void AddEvent(const char* szName, char phase, const char* szDetail = NULL);
+	void AddEvent(const char* szName, char phase, const wchar_t* wcsDetail);
+
+	class CScopedEvent
+	{
+	public:
+		explicit CScopedEvent(const char* szName);
+		CScopedEvent(const char* szName, const char* szDetail);
+		CScopedEvent(const char* szName, const wchar_t* wcsDetail);
+		~CScopedEvent();
+
+	private:
+		const char* m_szName;
+	};
+
+	// Writes out recorded events when leaving scope
+	class CWriteOutOnExit
+	{
+	public:
+		~CWriteOutOnExit() { if (IsStarted()) WriteOut(); }
+	};
+}
+
+#define TRACE_SCOPED_EVENT_0(line, ...) trace::CScopedEvent traceScopedEvent##line(__VA_ARGS__)
+#define TRACE_SCOPED_EVENT_1(line, ...) TRACE_SCOPED_EVENT_0(line, __VA_ARGS__)
+#define TRACE_SCOPED_EVENT(...)         TRACE_SCOPED_EVENT_1(__LINE__, __VA_ARGS__)
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "platform.h"
+
+namespace atomic
+{
+
+inline int64 Add(volatile int64* value, int64 amount)
+{
+	// Returns the new value
+#ifdef _WIN32
+	return static_cast<int64>(::InterlockedExchangeAdd64(reinterpret_cast<volatile LONGLONG*>(value), amount)) + amount;
+#else
+	return __sync_add_and_fetch(value, amount);
+#endif
+}
+
+inline int64 Load(volatile int64* value)
+{
+	return Add(value, 0);
+}
+
+inline void* CompareExchangePointer(void* volatile* destination, void* exchange, void* comparand)
+{
+	// Returns the previous value
+#ifdef _WIN32
+	return ::InterlockedCompareExchangePointer(destination, exchange, comparand);
+#else
+	return __sync_val_compare_and_swap(destination, comparand, exchange);
+#endif
+}
+
+}
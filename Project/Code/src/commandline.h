@@ -3,26 +3,84 @@
 #include "platform.h"
 #include <string>
 
+#ifndef _WIN32
+#include "FileSystem.h"
+#include <vector>
+#endif
+
 
 class CommandLineRAII
 {
 public:
+#ifdef _WIN32
 	inline CommandLineRAII()
 		: m_szArglist(0)
 		, m_nArgs(0)
 	{
 		m_szArglist = ::CommandLineToArgvW(::GetCommandLineW(), &m_nArgs);
 	}
+	// Splits a command line of arguments only, like a line of a job file
+	inline explicit CommandLineRAII(const wchar_t* commandLine)
+		: m_szArglist(0)
+		, m_nArgs(0)
+	{
+		if (*commandLine)
+			m_szArglist = ::CommandLineToArgvW(commandLine, &m_nArgs);
+	}
 	inline ~CommandLineRAII()
 	{
 		if (m_szArglist)
 			::LocalFree(m_szArglist);
 	}
-	inline const LPWSTR* GetArgList() const
+	// Windows has a process wide command line
+	static inline void SetProcessArgs(int, char*[])
+	{
+	}
+#else
+	inline CommandLineRAII()
+		: m_szArglist(0)
+		, m_nArgs(0)
+	{
+		SetArgPointers(GetProcessArgs());
+	}
+	// Splits a command line of arguments only, like a line of a job file.
+	// Quotes and backslashes follow the rules of CommandLineToArgvW on Windows.
+	inline explicit CommandLineRAII(const wchar_t* commandLine)
+		: m_szArglist(0)
+		, m_nArgs(0)
+	{
+		SplitCommandLine(m_args, commandLine);
+		SetArgPointers(m_args);
+	}
+	inline ~CommandLineRAII()
+	{
+	}
+	// Must be called by main, because POSIX has no process wide command line
+	static inline void SetProcessArgs(int argc, char* argv[])
+	{
+		TArgs& args = GetProcessArgs();
+		args.resize(argc);
+		for (int i = 0; i < argc; ++i)
+			filesystem::FromNativePath(args[i], argv[i]);
+	}
+	static inline std::wstring GetProcessCommandLine()
+	{
+		std::wstring commandLine;
+		const TArgs& args = GetProcessArgs();
+		for (size_t i = 0; i < args.size(); ++i)
+		{
+			if (i != 0)
+				commandLine.append(L" ");
+			commandLine.append(args[i]);
+		}
+		return commandLine;
+	}
+#endif
+	inline wchar_t* const* GetArgList() const
 	{
 		return m_szArglist;
 	}
-	inline const LPWSTR GetArgElement(size_t i) const
+	inline const wchar_t* GetArgElement(size_t i) const
 	{
 		return m_szArglist[i];
 	}
@@ -30,10 +88,10 @@ public:
 	{
 		return m_nArgs;
 	}
-	inline int FindArg(const wchar_t* name) const
+	inline int FindArg(const wchar_t* name, int first = 0) const
 	{
 		if (m_szArglist)
-			for (int i = 0; i < m_nArgs; ++i)
+			for (int i = first; i < m_nArgs; ++i)
 				if (::_wcsicmp(m_szArglist[i], name)==0)
 					return i;
 		return -1;
@@ -50,7 +108,69 @@ public:
 		return FindArg(name) >= 0;
 	}
 private:
-	LPWSTR* m_szArglist;
+#ifndef _WIN32
+	typedef std::vector<std::wstring> TArgs;
+
+	static inline TArgs& GetProcessArgs()
+	{
+		static TArgs s_args;
+		return s_args;
+	}
+
+	static inline void SplitCommandLine(TArgs& args, const wchar_t* commandLine)
+	{
+		const wchar_t* pos = commandLine;
+		for (;;)
+		{
+			while (*pos == L' ' || *pos == L'\t')
+				++pos;
+			if (*pos == L'\0')
+				break;
+
+			std::wstring arg;
+			bool quoted = false;
+			for (; *pos != L'\0' && (quoted || (*pos != L' ' && *pos != L'\t')); ++pos)
+			{
+				size_t backslashCount = 0;
+				while (*pos == L'\\')
+				{
+					++backslashCount;
+					++pos;
+				}
+				if (*pos == L'"')
+				{
+					// Backslashes in front of a quote escape each other and then the quote
+					arg.append(backslashCount / 2, L'\\');
+					if (backslashCount % 2)
+						arg.push_back(L'"');
+					else
+						quoted = !quoted;
+				}
+				else
+				{
+					arg.append(backslashCount, L'\\');
+					if (*pos == L'\0' || (!quoted && (*pos == L' ' || *pos == L'\t')))
+						break;
+					arg.push_back(*pos);
+				}
+			}
+			args.push_back(arg);
+		}
+	}
+
+	inline void SetArgPointers(TArgs& args)
+	{
+		m_argPointers.reserve(args.size());
+		for (size_t i = 0; i < args.size(); ++i)
+			m_argPointers.push_back(&args[i][0]);
+		m_nArgs = static_cast<int>(m_argPointers.size());
+		m_szArglist = m_argPointers.empty() ? 0 : &m_argPointers[0];
+	}
+
+	TArgs m_args;
+	std::vector<wchar_t*> m_argPointers;
+#endif
+	wchar_t** m_szArglist;
 	int m_nArgs;
 };
 
@@ -66,10 +186,15 @@ public:
 		{
 			m_commandLine = other.m_commandLine;
 		}
+		return *this;
 	}
 	inline void AddAppCommandLine()
 	{
+#ifdef _WIN32
 		m_commandLine.append(::GetCommandLineW());
+#else
+		m_commandLine.append(CommandLineRAII::GetProcessCommandLine());
+#endif
 	}
 	inline void AddArgument(const wchar_t* argument, const wchar_t* value = NULL)
 	{
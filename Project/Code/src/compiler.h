@@ -4,3 +4,9 @@
 #pragma warning(disable: 4127) // constant condition: while (true)
 #pragma warning(disable: 4480) // nonstandard extension used: specifying underlying type for enum
 #endif
+
+#if _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
@@ -1,11 +1,27 @@
+#include "ArchiveServer.h"
 #include "BIGFile.h"
+#include "EntryStream.h"
 #include "FileFinder.h"
+#include "LayoutPolicy.h"
+#include "MemoryBudget.h"
+#include "NameFilter.h"
+#include "SequentialWriter.h"
+#include "Stats.h"
+#include "Tar.h"
+#include "Trace.h"
 #include "commandline.h"
+#include "thread.h"
 #include "utils.h"
-#include <ctime>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
+#if _MSC_VER
 #pragma comment(lib, "Shlwapi.lib")
+#endif
 
 #define COMMANDLINE_ARG_HELP             "-help"
 #define COMMANDLINE_ARG_SOURCE           "-source"
@@ -15,239 +31,1602 @@
 #define COMMANDLINE_ARG_PREFIXNAMES      "-prefixnames"
 #define COMMANDLINE_ARG_SIMPLIFYNAMES    "-simplifynames"
 #define COMMANDLINE_ARG_IGNOREDUPLICATES "-ignoreduplicates"
+#define COMMANDLINE_ARG_STREAMFORMAT     "-streamformat"
+#define COMMANDLINE_ARG_FILTER           "-filter"
 #define COMMANDLINE_ARG_APPEND           "-append"
+#define COMMANDLINE_ARG_UPDATE           "-update"
+#define COMMANDLINE_ARG_MERGE            "-merge"
+#define COMMANDLINE_ARG_COMPACT          "-compact"
+#define COMMANDLINE_ARG_REMOVE           "-remove"
+#define COMMANDLINE_ARG_RENAME           "-rename"
+#define COMMANDLINE_ARG_COMPACTTHRESHOLD "-compactthreshold"
+#define COMMANDLINE_ARG_LAYOUTORDER      "-layoutorder"
+#define COMMANDLINE_ARG_LAYOUTTRACE      "-layouttrace"
+#define COMMANDLINE_ARG_REPLAYTRACE      "-replaytrace"
+#define COMMANDLINE_ARG_ALIGN            "-align"
+#define COMMANDLINE_ARG_ALIGNMINSIZE     "-alignminsize"
+#define COMMANDLINE_ARG_HEADERRESERVE    "-headerreserve"
+#define COMMANDLINE_ARG_DURABILITY       "-durability"
+#define COMMANDLINE_ARG_SYNCBATCH        "-syncbatch"
+#define COMMANDLINE_ARG_WRITEBUFFER      "-writebuffer"
+#define COMMANDLINE_ARG_FLUSHMEMORY      "-flushmemory"
+#define COMMANDLINE_ARG_SERVE            "-serve"
+#define COMMANDLINE_ARG_CACHESIZE        "-cachesize"
+#define COMMANDLINE_ARG_JOBS             "-jobs"
+#define COMMANDLINE_ARG_THREADS          "-threads"
+#define COMMANDLINE_ARG_JOBMEMORY        "-jobmemory"
+#define COMMANDLINE_ARG_STATS            "-stats"
+#define COMMANDLINE_ARG_TRACE            "-trace"
 
 
 namespace
 {
 	int Error = 1;
 	int NoError = 0;
+
+	// Path that stands for the standard input or output
+	const wchar_t* StandardStreamName = L"-";
+
+	// Bytes of file data that extraction holds in memory at once
+	const uint32 ExtractChunkSize = 1024 * 1024;
 }
 
 struct SOptions
 {
+	typedef std::vector<const wchar_t*> TStrings;
+
 	SOptions()
 		: wcsSrc(0)
 		, wcsWildcard(L"*.*")
 		, wcsDst(0)
+		, wcsCompact(0)
 		, maxDepth(999)
-		, szPrefix("")
+		, streamFormat(CEntryStreamWriter::eFormat_Frame)
+		, prefix()
 		, simplifyNames(false)
 		, ignoreDuplicates(false)
 		, append(false)
+		, update(false)
+		, layoutOrder(CLayoutPolicy::eOrder_Header)
+		, wcsLayoutTrace(0)
+		, wcsReplayTrace(0)
+		, alignment(0)
+		, minAlignedSize(0)
+		, durability(filesystem::eDurability_End)
+		, syncBatchBytes(filesystem::CReplaceFile::DefaultSyncBatchBytes)
+		, writeBufferSize(CSequentialWriter::DefaultBufferSize)
+		, flushBytes(0)
+		, compactionThreshold(CBIGFile::DefaultCompactionThreshold)
+		, headerReserve(0)
+		, hasHeaderReserve(false)
 	{}
 
 	const wchar_t* wcsSrc;
 	const wchar_t* wcsWildcard;
 	const wchar_t* wcsDst;
+	const wchar_t* wcsCompact;
 	uint32 maxDepth;
-	const char* szPrefix;
+	TStrings wcsFilters;
+	TStrings wcsMergeSources;
+	TStrings wcsRemoveNames;
+	TStrings wcsRenameNames; // Pairs of old and new name
+	CEntryStreamWriter::EFormat streamFormat;
+	std::string prefix;
 	bool simplifyNames;
 	bool ignoreDuplicates;
 	bool append;
+	bool update;
+	CLayoutPolicy::EOrder layoutOrder;
+	const wchar_t* wcsLayoutTrace;
+	const wchar_t* wcsReplayTrace;
+	uint32 alignment;
+	uint32 minAlignedSize;
+	filesystem::EDurability durability;
+	uint64 syncBatchBytes;
+	size_t writeBufferSize;
+	uint64 flushBytes; // Pending file data that triggers a write out while creating, 0 for none
+	uint32 compactionThreshold;
+	uint32 headerReserve;
+	bool hasHeaderReserve; // Otherwise an existing BIG file keeps its header reserve
 };
 
 
-void InitRandom()
+bool IsStandardStream(const wchar_t* wcsPath)
+{
+	return wcsPath && ::wcscmp(wcsPath, StandardStreamName) == 0;
+}
+
+// Logs of jobs are narrow streams, paths go into them in the native encoding
+std::string NarrowPath(const wchar_t* wcsPath)
 {
-	::srand((unsigned int)::time(0));
+	std::string path;
+	filesystem::ToNativePath(path, wcsPath);
+	return path;
 }
 
+// Moves log output to the standard error while the standard output carries data
+class CLogToStandardError
+{
+public:
+	explicit CLogToStandardError(bool enable)
+		: m_pOutBuffer(enable ? std::cout.rdbuf(std::cerr.rdbuf()) : NULL)
+		, m_pWideOutBuffer(enable ? std::wcout.rdbuf(std::wcerr.rdbuf()) : NULL)
+	{}
+	~CLogToStandardError()
+	{
+		if (m_pOutBuffer)
+			std::cout.rdbuf(m_pOutBuffer);
+		if (m_pWideOutBuffer)
+			std::wcout.rdbuf(m_pWideOutBuffer);
+	}
+
+private:
+	std::streambuf* m_pOutBuffer;
+	std::wstreambuf* m_pWideOutBuffer;
+};
+
 void Welcome()
 {
 	std::cout << "Generals Big Creator 1.3 by xezon" << std::endl;
 }
 
-bool ExtractBigFile(const SOptions& options)
+struct SFileOffsetLess
 {
-	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Read;
-	bigFlags |= options.simplifyNames ? CBIGFile::eFlags_UseSimplifiedName : 0;
-	bigFlags |= options.ignoreDuplicates ? CBIGFile::eFlags_IgnoreDuplicates : 0;
+	explicit SFileOffsetLess(const CBIGFile& bigFile) : bigFile(bigFile) {}
+
+	bool operator()(uint32 leftId, uint32 rightId) const
+	{
+		return bigFile.GetFileOffsetById(leftId) < bigFile.GetFileOffsetById(rightId);
+	}
 
-	// TODO: Implement.
+	const CBIGFile& bigFile;
+};
+
+bool BuildExtractPath(std::wstring& path, const wchar_t* wcsDirectory, const char* szName)
+{
+	// Names come from the .big file and must not reach outside of the destination
+	path.assign(wcsDirectory);
+	if (!path.empty() && !filesystem::IsPathSeparator(path[path.size() - 1]))
+	{
+		path.push_back(filesystem::PathSeparator);
+	}
 
-	std::cout << "Error: not implemented" << std::endl;
+	const size_t nameOffset = path.size();
+	utils::AppendNarrowString(path, szName);
 
-	return false;
+	size_t partBegin = nameOffset;
+	for (size_t i = nameOffset; i <= path.size(); ++i)
+	{
+		if (i == path.size() || filesystem::IsPathSeparator(path[i]))
+		{
+			const size_t partLength = i - partBegin;
+			if (partLength == 0 || (partLength == 2 && path.compare(partBegin, 2, L"..") == 0))
+				return false;
+			if (path.find(L':', partBegin) < i)
+				return false;
+			if (i != path.size())
+				path[i] = filesystem::PathSeparator;
+			partBegin = i + 1;
+		}
+	}
+	return true;
 }
 
-bool CreateBigFile(const SOptions& options)
+void MakeParentDirectories(const std::wstring& path, size_t offset)
 {
-	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Write;
-	bigFlags |= options.append ? CBIGFile::eFlags_Read : 0;
+	// Creates each directory of the path after offset. Existing directories fail silently.
+	std::wstring directory;
+	for (size_t i = offset; i < path.size(); ++i)
+	{
+		if (filesystem::IsPathSeparator(path[i]))
+		{
+			directory.assign(path, 0, i);
+			filesystem::MakeDirectory(directory.c_str());
+		}
+	}
+}
+
+bool ExtractBigFile(const SOptions& options)
+{
+	TRACE_SCOPED_EVENT("extract", options.wcsSrc);
+
+	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Read;
 	bigFlags |= options.simplifyNames ? CBIGFile::eFlags_UseSimplifiedName : 0;
 	bigFlags |= options.ignoreDuplicates ? CBIGFile::eFlags_IgnoreDuplicates : 0;
 
 	CBIGFile bigFile;
-	if (!bigFile.OpenFile(options.wcsDst, bigFlags))
+	if (!bigFile.OpenFile(options.wcsSrc, bigFlags))
 	{
-		std::cout << "Error: '" << options.wcsDst << "' cannot be opened" << std::endl;
+		std::wcout << "Error: '" << options.wcsSrc << "' cannot be opened" << std::endl;
 		return false;
 	}
 
-	bigFile.SetCurrentFileId(~0u);
-	CFileFinder fileFinder;
-	if (!fileFinder.Initialize(options.wcsSrc, options.wcsWildcard, options.maxDepth, CBIGFile::eFlags_None))
+	// Select files on header table alone, so that only selected file data is read
+	CBIGFile::TFileIds fileIds;
+	if (options.wcsFilters.empty())
 	{
-		std::cout << "Error: '" << options.wcsSrc << "' '" << options.wcsWildcard << "' cannot be used" << std::endl;
-		return false;
+		const uint32 fileCount = bigFile.GetFileCount();
+		fileIds.resize(fileCount);
+		for (uint32 fileId = 0; fileId < fileCount; ++fileId)
+		{
+			fileIds[fileId] = fileId;
+		}
+	}
+	else
+	{
+		CNameFilter nameFilter;
+		std::string pattern;
+		const size_t filterCount = options.wcsFilters.size();
+		for (size_t filterIndex = 0; filterIndex < filterCount; ++filterIndex)
+		{
+			pattern.clear();
+			utils::AppendWideString(pattern, options.wcsFilters[filterIndex]);
+			nameFilter.AddPattern(pattern.c_str(), options.simplifyNames);
+		}
+		nameFilter.FindFileIds(fileIds, bigFile);
 	}
 
-	const char* szFileName = fileFinder.GetFirstFileName();
-	
-	do
+	// Read file data in the order it is stored in
+	std::stable_sort(fileIds.begin(), fileIds.end(), SFileOffsetLess(bigFile));
+
+	// Files go to a folder or one after another to the standard output
+	const bool toStandardOutput = IsStandardStream(options.wcsDst);
+	CEntryStreamWriter entryStreamWriter(stdout, options.streamFormat);
+
+	std::wstring path;
+	CBIGFile::TData data;
+	const size_t directoryLength = ::wcslen(options.wcsDst);
+	const size_t fileIdCount = fileIds.size();
+
+	for (size_t fileIdIndex = 0; fileIdIndex < fileIdCount; ++fileIdIndex)
 	{
-		if (!(szFileName && *szFileName))
-			break;
+		const uint32 fileId = fileIds[fileIdIndex];
+		const char* szFileName = bigFile.GetFileNameById(fileId);
 
-		CBIGFile::TData data;
-		std::string fullFileName;
-		fullFileName.append(options.szPrefix).append(szFileName);
+		TRACE_SCOPED_EVENT("entry", szFileName);
+
+		if (!toStandardOutput && !BuildExtractPath(path, options.wcsDst, szFileName))
+		{
+			std::cout << "Error: '" << szFileName << "' is no valid file name" << std::endl;
+			return false;
+		}
 
-		if (fileFinder.ReadDataFromCurrentFile(data) != fileaccess::eError_Success)
+		CBIGFile::TEntryReaderPtr entryReaderPtr = bigFile.OpenEntryReader(fileId);
+		if (!entryReaderPtr.get())
 		{
-			std::cout << "Error: '" << fullFileName << "' cannot be read" << std::endl;
+			std::cout << "Error: '" << szFileName << "' cannot be read from BIG file" << std::endl;
 			return false;
 		}
 
-		if (!bigFile.AddNewFile(fullFileName.c_str(), data))
+		// File data is copied piece by piece, so that large files need not fit in memory
+		std::ofstream file;
+		bool written = true;
+		if (toStandardOutput)
+		{
+			written = entryStreamWriter.BeginEntry(szFileName, entryReaderPtr->GetSize());
+		}
+		else
+		{
+			MakeParentDirectories(path, directoryLength);
+			filesystem::OpenStream(file, path.c_str(), std::ios::out | std::ios::binary);
+			written = file.is_open() && file.good();
+		}
+
+		while (written && entryReaderPtr->GetPosition() < entryReaderPtr->GetSize())
+		{
+			data.resize(std::min<uint32>(ExtractChunkSize, entryReaderPtr->GetSize() - entryReaderPtr->GetPosition()));
+			if (entryReaderPtr->Read(&data[0], data.size()) != data.size())
+				break;
+
+			if (toStandardOutput)
+				written = entryStreamWriter.WriteEntryData(data.data(), data.size());
+			else
+				written = file.write(data.data(), data.size()).good();
+		}
+
+		if (entryReaderPtr->HasReadError())
 		{
-			std::cout << "Error: '" << fullFileName << "' cannot be added to BIG file" << std::endl;
+			// Leave no partly written file behind that looks extracted
+			if (!toStandardOutput)
+			{
+				file.close();
+				filesystem::RemoveFile(path.c_str());
+			}
+			std::cout << "Error: '" << szFileName << "' cannot be read from BIG file" << std::endl;
 			return false;
 		}
 
-		std::cout << "OK '" << fullFileName << "'" << std::endl;
+		if (toStandardOutput)
+		{
+			if (!written || !entryStreamWriter.EndEntry())
+			{
+				std::cout << "Error: '" << szFileName << "' cannot be written to standard output" << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			file.close();
+			if (!written || file.fail())
+			{
+				filesystem::RemoveFile(path.c_str());
+				std::wcout << "Error: '" << path << "' cannot be written" << std::endl;
+				return false;
+			}
+		}
 
-		// TODO: Check pending file size and write out if necessary otherwise process memory will grow large.
+		std::cout << "OK '" << szFileName << "'" << std::endl;
 	}
-	while (szFileName = fileFinder.GetNextFileName());
 
-	if (!bigFile.WriteOutPendingFileChanges())
+	if (toStandardOutput && !entryStreamWriter.Finish())
 	{
-		std::cout << "Error: '" << options.wcsDst << "' write out failed" << std::endl;
+		std::cout << "Error: standard output cannot be written" << std::endl;
 		return false;
 	}
 
 	return true;
 }
 
-int main(int argc, wchar_t* argv[])
+// State that the functions adding files to a created .big file share
+struct SCreateContext
 {
-	Welcome();
+	SCreateContext(CBIGFile& bigFile, const SOptions& options, std::ostream& log, CMemoryBudget* pMemoryBudget)
+		: bigFile(bigFile)
+		, options(options)
+		, log(log)
+		, pMemoryBudget(pMemoryBudget)
+		, budgetBytes(0)
+		, headerReserve(bigFile.GetHeaderReserve())
+		, addedHeaderBytes(0)
+	{}
 
-	InitRandom();
+	CBIGFile& bigFile;
+	const SOptions& options;
+	std::ostream& log;
+	// Optional budget for pending file data that concurrent jobs share
+	CMemoryBudget* pMemoryBudget;
+	uint64 budgetBytes;
+	// Header reserve of the finished .big file, and the size of the file headers added to it
+	uint32 headerReserve;
+	uint64 addedHeaderBytes;
+};
 
-	CommandLineRAII commandline;
-	bool help = commandline.HasArg(W(COMMANDLINE_ARG_HELP));
+bool WriteOutBeforeLastFile(SCreateContext& context)
+{
+	// Leaves room after the header for as many file headers as were added so far, so that
+	// the next write outs append file data and rewrite only the header. The room doubles each
+	// time the header outgrows it, so that frequent write outs do not each rewrite the whole .big file.
+	const uint64 headerReserve = std::max<uint64>(context.headerReserve, context.addedHeaderBytes);
+	context.bigFile.SetHeaderReserve(static_cast<uint32>(std::min<uint64>(headerReserve, 0xFFFFFFFFu)));
+	const bool written = context.bigFile.WriteOutPendingFileChanges();
+	context.bigFile.SetHeaderReserve(context.headerReserve);
 
-	SOptions options;
+	if (!written)
+	{
+		context.log << "Error: '" << NarrowPath(context.options.wcsDst) << "' write out failed" << std::endl;
+		return false;
+	}
 
-	options.simplifyNames = commandline.HasArg(W(COMMANDLINE_ARG_SIMPLIFYNAMES));
-	options.ignoreDuplicates = commandline.HasArg(W(COMMANDLINE_ARG_IGNOREDUPLICATES));
-	options.append = commandline.HasArg(W(COMMANDLINE_ARG_APPEND));
-	options.wcsSrc = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCE));
-	options.wcsDst = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DEST));
-	const wchar_t* wcsPrefixNames = commandline.FindArgAssignment(W(COMMANDLINE_ARG_PREFIXNAMES));
-	const wchar_t* wcsMaxDepth = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCEMAXDEPTH));
-	const wchar_t* wcsWildcard = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCEWILDCARD));
+	if (context.pMemoryBudget)
+	{
+		context.pMemoryBudget->Release(context.budgetBytes);
+		context.budgetBytes = 0;
+	}
+	return true;
+}
+
+bool AddFileToBigFile(SCreateContext& context, const char* szFileName, const CBIGFile::TConstDataPtr& dataPtr)
+{
+	std::string fullFileName;
+	fullFileName.append(context.options.prefix).append(szFileName);
 
-	if (!options.wcsSrc || !options.wcsDst)
+	if (context.pMemoryBudget)
 	{
-		help = true;
+		// Memory blocks can be larger than the data they hold
+		const uint64 dataSize = dataPtr->data.capacity();
+		if (!context.pMemoryBudget->TryAcquire(dataSize))
+		{
+			// Hand back the pending file data of this job before waiting for other jobs
+			if (!WriteOutBeforeLastFile(context))
+				return false;
+			context.pMemoryBudget->Acquire(dataSize);
+		}
+		context.budgetBytes += dataSize;
 	}
 
-	if (help)
+	uint32 fileId = ~0u;
+	if (context.options.update)
 	{
-		std::cout
-		<< "h: " << "ARGUMENT"              "          [TYPE1|TYPE2 {default}]"                                                             << std::endl
-		<< "   " << COMMANDLINE_ARG_SOURCE "           [PATH|FILE.big {}] -> Specifies path to create BIG from or BIG file to extract from" << std::endl
-		<< "   " << COMMANDLINE_ARG_SOURCEMAXDEPTH "   [NUMBER {999}]     -> Max folder depth to use files from"                            << std::endl
-		<< "   " << COMMANDLINE_ARG_SOURCEWILDCARD "   [STRING {*.*}]     -> Filter for file name or extension"                             << std::endl
-		<< "   " << COMMANDLINE_ARG_DEST "             [PATH|FILE.big {}] -> Specifies path to extract to or BIG file to create to"         << std::endl
-		<< "   " << COMMANDLINE_ARG_SIMPLIFYNAMES "    [{}]               -> Simplify file names in BIG file"                               << std::endl
-		<< "   " << COMMANDLINE_ARG_IGNOREDUPLICATES " [{}]               -> Ignore file duplicates in BIG file"                            << std::endl
-		<< "   " << COMMANDLINE_ARG_PREFIXNAMES "      [STRING {}]        -> Prefix file names in created BIG file"                         << std::endl
-		<< "   " << COMMANDLINE_ARG_APPEND "           [{}]               -> Append to existing BIG file instead of creating new one"       << std::endl;
+		// Existing files are overwritten. Write out appends the new data and leaves the old data unused,
+		// unless durability none lets new data that fits go over the old data.
+		std::string name(fullFileName);
+		if (context.options.simplifyNames)
+			CBIGFile::ApplySimplifiedCharset(name);
+
+		fileId = context.bigFile.FindFileIdByName(name.c_str());
 	}
 
-	if (!options.wcsSrc)
+	if (fileId < context.bigFile.GetFileCount())
 	{
-		std::cout << "Error: missing argument for " COMMANDLINE_ARG_SOURCE << std::endl;
-		return Error;
+		if (!context.bigFile.WriteFileDataById(fileId, dataPtr))
+		{
+			context.log << "Error: '" << fullFileName << "' cannot be written to BIG file" << std::endl;
+			return false;
+		}
+	}
+	else if (!context.bigFile.AddNewFile(fullFileName.c_str(), dataPtr))
+	{
+		context.log << "Error: '" << fullFileName << "' cannot be added to BIG file" << std::endl;
+		return false;
+	}
+	else
+	{
+		// Offset, size and terminated name
+		context.addedHeaderBytes += 2 * sizeof(uint32) + fullFileName.size() + 1;
 	}
 
-	if (!options.wcsDst)
+	context.log << "OK '" << fullFileName << "'" << std::endl;
+
+	// Write out once enough file data is pending, so that process memory does not grow large
+	if (context.options.flushBytes != 0 && context.bigFile.GetPendingFileBytes() >= context.options.flushBytes)
 	{
-		std::cout << "Error: missing argument for " COMMANDLINE_ARG_DEST << std::endl;
-		return Error;
+		return WriteOutBeforeLastFile(context);
 	}
+	return true;
+}
 
-	const bool srcBigFile = CBIGFile::HasBigFileExtension(options.wcsSrc);
-	const bool dstBigFile = CBIGFile::HasBigFileExtension(options.wcsDst);
-	const bool createBigFile = !srcBigFile && dstBigFile;
-	const bool extractBigFile = srcBigFile && !dstBigFile;
+bool AddFilesFromDirectory(SCreateContext& context)
+{
+	const SOptions& options = context.options;
 
-	if (!(createBigFile || extractBigFile))
+	CFileFinder fileFinder;
+	if (!fileFinder.Initialize(options.wcsSrc, options.wcsWildcard, options.maxDepth, CBIGFile::eFlags_None))
 	{
-		std::cout << "Error: no creation or extraction job" << std::endl;
-		return Error;
+		context.log << "Error: '" << NarrowPath(options.wcsSrc) << "' '" << NarrowPath(options.wcsWildcard) << "' cannot be used" << std::endl;
+		return false;
 	}
 
-	if (createBigFile)
+	const char* szFileName = fileFinder.GetFirstFileName();
+	
+	do
 	{
-		if (!fileaccess::FileExists(options.wcsSrc))
+		if (!(szFileName && *szFileName))
+			break;
+
+		TRACE_SCOPED_EVENT("entry", szFileName);
+
+		CBIGFile::TConstDataPtr dataPtr;
+		if (fileFinder.ReadDataFromCurrentFile(dataPtr) != fileaccess::eError_Success)
 		{
-			std::wcout << "Error: '" << options.wcsSrc << "' is no valid path" << std::endl;
-			return Error;
+			context.log << "Error: '" << options.prefix << szFileName << "' cannot be read" << std::endl;
+			return false;
 		}
 
-		if (options.append && !fileaccess::FileExists(options.wcsDst))
+		if (!AddFileToBigFile(context, szFileName, dataPtr))
+			return false;
+	}
+	while ((szFileName = fileFinder.GetNextFileName()) != NULL);
+
+	return true;
+}
+
+void MakeBigFileName(std::string& name)
+{
+	// Names in .big files use backslashes and are relative
+	std::replace(name.begin(), name.end(), '/', '\\');
+	while (name.compare(0, 2, ".\\") == 0)
+	{
+		name.erase(0, 2);
+	}
+}
+
+bool AddFilesFromTarStream(SCreateContext& context, const char* pFirstBlock)
+{
+	// Files go from the stream into the .big file without landing on disk
+	tar::CReader reader(stdin, pFirstBlock);
+	std::string name;
+
+	for (;;)
+	{
+		CBIGFile::TDataPtr dataPtr(new CBIGFile::SDataRef());
+		if (!reader.ReadNextFile(name, dataPtr->data))
+			break;
+
+		MakeBigFileName(name);
+		TRACE_SCOPED_EVENT("entry", name.c_str());
+
+		if (!AddFileToBigFile(context, name.c_str(), dataPtr))
+			return false;
+	}
+
+	if (reader.HasFailed())
+	{
+		context.log << "Error: tar stream on standard input is broken" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool AddFilesFromFileList(SCreateContext& context, const std::string& fileList)
+{
+	// One file per line. A tab separates an optional name in the .big file from the path.
+	std::wstring path;
+	std::string name;
+	size_t lineBegin = 0;
+
+	while (lineBegin < fileList.size())
+	{
+		size_t lineEnd = fileList.find('\n', lineBegin);
+		if (lineEnd == std::string::npos)
+			lineEnd = fileList.size();
+
+		std::string line(fileList, lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd + 1;
+
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.empty())
+			continue;
+
+		const size_t tab = line.find('\t');
+		if (tab != std::string::npos)
 		{
-			std::wcout << "Error: '" << options.wcsDst << "' is no valid file" << std::endl;
-			return Error;
+			name.assign(line, tab + 1, std::string::npos);
+			line.erase(tab);
 		}
-	}
+		else
+		{
+			name = line;
+		}
+		MakeBigFileName(name);
+		filesystem::FromNativePath(path, line.c_str());
 
-	// TODO: Add error codes and messages.
+		TRACE_SCOPED_EVENT("entry", name.c_str());
 
-	std::string prefixNames;
+		CBIGFile::TDataPtr dataPtr(new CBIGFile::SDataRef());
+		if (fileaccess::ReadDataFromFile(path.c_str(), dataPtr->data) != fileaccess::eError_Success)
+		{
+			context.log << "Error: '" << line << "' cannot be read" << std::endl;
+			return false;
+		}
 
-	if (wcsPrefixNames)
+		if (!AddFileToBigFile(context, name.c_str(), dataPtr))
+			return false;
+	}
+	return true;
+}
+
+bool AddFilesFromStandardInput(SCreateContext& context)
+{
+	// The first block tells a tar stream from a file list
+	char firstBlock[tar::BlockSize];
+	const size_t firstBlockSize = ::fread(firstBlock, 1, sizeof(firstBlock), stdin);
+
+	if (firstBlockSize == sizeof(firstBlock) && tar::IsHeader(firstBlock))
 	{
-		utils::AppendWideString(prefixNames, wcsPrefixNames);
-		options.szPrefix = prefixNames.c_str();
+		return AddFilesFromTarStream(context, firstBlock);
 	}
 
-	if (wcsMaxDepth)
+	std::string fileList(firstBlock, firstBlockSize);
+	char buffer[4096];
+	size_t readSize;
+	while ((readSize = ::fread(buffer, 1, sizeof(buffer), stdin)) != 0)
 	{
-		options.maxDepth = static_cast<uint32>(::_wtoi(wcsMaxDepth));
+		fileList.append(buffer, readSize);
 	}
 
-	if (wcsWildcard)
+	if (::ferror(stdin))
 	{
-		options.wcsWildcard = wcsWildcard;
+		context.log << "Error: standard input cannot be read" << std::endl;
+		return false;
 	}
+	return AddFilesFromFileList(context, fileList);
+}
 
-	bool success = false;
+bool OpenBigFileToWrite(CBIGFile& bigFile, CLayoutPolicy& layoutPolicy, const SOptions& options, std::ostream& log)
+{
+	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Write;
+	bigFlags |= options.append ? CBIGFile::eFlags_Read : 0;
+	bigFlags |= options.simplifyNames ? CBIGFile::eFlags_UseSimplifiedName : 0;
+	bigFlags |= options.ignoreDuplicates ? CBIGFile::eFlags_IgnoreDuplicates : 0;
 
-	if (extractBigFile)
+	layoutPolicy.SetOrder(options.layoutOrder);
+
+	if (options.wcsLayoutTrace && !layoutPolicy.LoadAccessTrace(options.wcsLayoutTrace))
 	{
-		success = ExtractBigFile(options);
+		log << "Error: '" << NarrowPath(options.wcsLayoutTrace) << "' cannot be read" << std::endl;
+		return false;
 	}
 
-	if (createBigFile)
+	if (!bigFile.OpenFile(options.wcsDst, bigFlags))
 	{
-		success = CreateBigFile(options);
+		log << "Error: '" << NarrowPath(options.wcsDst) << "' cannot be opened" << std::endl;
+		return false;
 	}
 
-	if (success)
+	bigFile.SetLayoutPolicy(&layoutPolicy);
+	bigFile.SetPayloadAlignment(options.alignment, options.minAlignedSize);
+	bigFile.SetDurability(options.durability, options.syncBatchBytes);
+	bigFile.SetWriteBufferSize(options.writeBufferSize);
+	bigFile.SetCompactionThreshold(options.compactionThreshold);
+	if (options.hasHeaderReserve)
+		bigFile.SetHeaderReserve(options.headerReserve);
+
+	bigFile.SetCurrentFileId(~0u);
+	return true;
+}
+
+bool CreateBigFile(const SOptions& options, std::ostream& log, CMemoryBudget* pMemoryBudget)
+{
+	TRACE_SCOPED_EVENT("create", options.wcsDst);
+
+	CLayoutPolicy layoutPolicy;
+	CBIGFile bigFile;
+	if (!OpenBigFileToWrite(bigFile, layoutPolicy, options, log))
+		return false;
+
+	SCreateContext context(bigFile, options, log, pMemoryBudget);
+
+	bool success = IsStandardStream(options.wcsSrc)
+		? AddFilesFromStandardInput(context)
+		: AddFilesFromDirectory(context);
+
+	if (success && !bigFile.WriteOutPendingFileChanges())
 	{
-		std::cout << "Operation completed" << std::endl;
-		return NoError;
+		log << "Error: '" << NarrowPath(options.wcsDst) << "' write out failed" << std::endl;
+		success = false;
 	}
-	else
+
+	if (pMemoryBudget)
 	{
-		std::cout << "Error: operation failed" << std::endl;
-		return Error;
+		// File data still pending after a failure goes away with the .big file on return
+		pMemoryBudget->Release(context.budgetBytes);
+	}
+
+	return success;
+}
+
+// File of a .big file that is written out, where data refers to a range of a source .big file
+struct SBigFileEntry
+{
+	std::string name;
+	CBIGFile::TDataPtr dataPtr;
+};
+
+typedef std::vector<SBigFileEntry> TBigFileEntries;
+
+bool OpenSourceBigFile(CBIGFile& bigFile, CBIGFile::TSourceFilePtr& sourceFilePtr, const wchar_t* wcsSource, CBIGFile::TFlags flags)
+{
+	sourceFilePtr = new CBIGFile::SSourceFile();
+	if (!bigFile.OpenFile(wcsSource, flags) || !sourceFilePtr->file.Open(wcsSource))
+	{
+		std::wcout << "Error: '" << wcsSource << "' cannot be opened" << std::endl;
+		return false;
 	}
+	return true;
+}
+
+bool MakeBigFileEntry(SBigFileEntry& entry, const CBIGFile& bigFile, uint32 fileId, const CBIGFile::TSourceFilePtr& sourceFilePtr, uint64 sourceFileSize)
+{
+	const uint32 offset = bigFile.GetFileOffsetById(fileId);
+	const uint32 size = bigFile.GetFileSizeById(fileId);
+
+	if (static_cast<uint64>(offset) + size > sourceFileSize)
+		return false;
+
+	entry.name.assign(bigFile.GetStoredFileNameById(fileId));
+	entry.dataPtr = new CBIGFile::SDataRef(sourceFilePtr, offset, size);
+	return true;
+}
+
+bool WriteBigFileEntries(const TBigFileEntries& entries, const SOptions& options)
+{
+	CLayoutPolicy layoutPolicy;
+	CBIGFile bigFile;
+	if (!OpenBigFileToWrite(bigFile, layoutPolicy, options, std::cout))
+		return false;
+
+	const size_t entryCount = entries.size();
+	for (size_t entryIndex = 0; entryIndex < entryCount; ++entryIndex)
+	{
+		if (!bigFile.AddNewFile(entries[entryIndex].name.c_str(), entries[entryIndex].dataPtr))
+		{
+			std::cout << "Error: '" << entries[entryIndex].name << "' cannot be added to BIG file" << std::endl;
+			return false;
+		}
+	}
+
+	if (!bigFile.WriteOutPendingFileChanges())
+	{
+		std::wcout << "Error: '" << options.wcsDst << "' write out failed" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool MergeBigFiles(const SOptions& options)
+{
+	// Files of later archives replace files of the same name in earlier archives, as patches do.
+	// Names compare like the game looks them up. File data is copied from the archives on write out.
+	// The destination can be one of the archives, it is replaced once the merged file is written.
+	TRACE_SCOPED_EVENT("merge", options.wcsDst);
+
+	typedef std::map<std::string, size_t> TMergeEntryIndices;
+
+	TBigFileEntries entries;
+	TMergeEntryIndices entryIndices;
+	std::string key;
+	uint32 replacedCount = 0;
+	const size_t sourceCount = options.wcsMergeSources.size();
+
+	for (size_t sourceIndex = 0; sourceIndex < sourceCount; ++sourceIndex)
+	{
+		const wchar_t* wcsSource = options.wcsMergeSources[sourceIndex];
+
+		CBIGFile sourceBigFile;
+		CBIGFile::TSourceFilePtr sourceFilePtr;
+		if (!OpenSourceBigFile(sourceBigFile, sourceFilePtr, wcsSource, CBIGFile::eFlags_Read))
+			return false;
+
+		const uint64 sourceFileSize = sourceFilePtr->file.GetSize();
+		const uint32 fileCount = sourceBigFile.GetFileCount();
+
+		for (uint32 fileId = 0; fileId < fileCount; ++fileId)
+		{
+			SBigFileEntry entry;
+			if (!MakeBigFileEntry(entry, sourceBigFile, fileId, sourceFilePtr, sourceFileSize))
+			{
+				std::wcout << "Error: '" << wcsSource << "' is damaged" << std::endl;
+				return false;
+			}
+
+			key.assign(entry.name);
+			CBIGFile::ApplySimplifiedCharset(key);
+
+			std::pair<TMergeEntryIndices::iterator, bool> inserted = entryIndices.insert(TMergeEntryIndices::value_type(key, entries.size()));
+			if (inserted.second)
+			{
+				entries.push_back(entry);
+			}
+			else
+			{
+				// The replacing file takes the place of the replaced one
+				entries[inserted.first->second] = entry;
+				++replacedCount;
+			}
+		}
+
+		std::wcout << "OK '" << wcsSource << "'" << std::endl;
+	}
+
+	if (!WriteBigFileEntries(entries, options))
+		return false;
+
+	std::cout << "Files: " << entries.size() << ", replaced " << replacedCount << std::endl;
+	return true;
+}
+
+bool CompactBigFile(const wchar_t* wcsSource, const SOptions& options)
+{
+	// Keeps the file of each name that the game loads and drops the files it shadows.
+	// File data is laid out without gaps in between, other than for alignment.
+	TRACE_SCOPED_EVENT("compact", wcsSource);
+
+	TBigFileEntries entries;
+	uint64 sourceFileSize = 0;
+	uint32 droppedCount = 0;
+	{
+		CBIGFile sourceBigFile;
+		CBIGFile::TSourceFilePtr sourceFilePtr;
+		if (!OpenSourceBigFile(sourceBigFile, sourceFilePtr, wcsSource, CBIGFile::eFlags_Read | CBIGFile::eFlags_UseSimplifiedName | CBIGFile::eFlags_IgnoreDuplicates))
+			return false;
+
+		sourceFileSize = sourceFilePtr->file.GetSize();
+		const uint32 fileCount = sourceBigFile.GetFileCount();
+		entries.resize(fileCount);
+		droppedCount = sourceBigFile.GetPhysicalFileCount() - fileCount;
+
+		for (uint32 fileId = 0; fileId < fileCount; ++fileId)
+		{
+			if (!MakeBigFileEntry(entries[fileId], sourceBigFile, fileId, sourceFilePtr, sourceFileSize))
+			{
+				std::wcout << "Error: '" << wcsSource << "' is damaged" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	if (!WriteBigFileEntries(entries, options))
+		return false;
+
+	filesystem::CInputFile compactFile;
+	const uint64 compactFileSize = compactFile.Open(options.wcsDst) ? compactFile.GetSize() : 0;
+
+	std::cout << "Files: " << entries.size() << ", dropped " << droppedCount << std::endl;
+	std::cout << "Bytes: " << sourceFileSize << " -> " << compactFileSize
+	          << ", reclaimed " << static_cast<int64>(sourceFileSize - compactFileSize) << std::endl;
+	return true;
+}
+
+bool EditBigFile(const SOptions& options)
+{
+	// Only the header is rewritten, unless it outgrows its space or too much of the BIG file would be unused afterwards
+	TRACE_SCOPED_EVENT("edit", options.wcsDst);
+
+	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Read | CBIGFile::eFlags_Write;
+	bigFlags |= options.simplifyNames ? CBIGFile::eFlags_UseSimplifiedName : 0;
+	bigFlags |= options.ignoreDuplicates ? CBIGFile::eFlags_IgnoreDuplicates : 0;
+
+	CBIGFile bigFile;
+	if (!bigFile.OpenFile(options.wcsDst, bigFlags))
+	{
+		std::wcout << "Error: '" << options.wcsDst << "' cannot be opened" << std::endl;
+		return false;
+	}
+
+	bigFile.SetPayloadAlignment(options.alignment, options.minAlignedSize);
+	bigFile.SetDurability(options.durability, options.syncBatchBytes);
+	bigFile.SetWriteBufferSize(options.writeBufferSize);
+	bigFile.SetCompactionThreshold(options.compactionThreshold);
+	if (options.hasHeaderReserve)
+		bigFile.SetHeaderReserve(options.headerReserve);
+
+	const uint32 unusedSizeBefore = bigFile.GetUnusedSizeOnDisk();
+	std::string name;
+
+	for (size_t nameIndex = 0; nameIndex + 1 < options.wcsRenameNames.size(); nameIndex += 2)
+	{
+		const wchar_t* wcsName = options.wcsRenameNames[nameIndex];
+		name.clear();
+		utils::AppendWideString(name, wcsName);
+		if (options.simplifyNames)
+			CBIGFile::ApplySimplifiedCharset(name);
+
+		const uint32 fileId = bigFile.FindFileIdByName(name.c_str());
+		if (fileId >= bigFile.GetFileCount())
+		{
+			std::wcout << "Error: '" << wcsName << "' is not in BIG file" << std::endl;
+			return false;
+		}
+
+		name.clear();
+		utils::AppendWideString(name, options.wcsRenameNames[nameIndex + 1]);
+		bigFile.SetFileNameById(fileId, name.c_str());
+	}
+
+	for (size_t nameIndex = 0; nameIndex < options.wcsRemoveNames.size(); ++nameIndex)
+	{
+		const wchar_t* wcsName = options.wcsRemoveNames[nameIndex];
+		name.clear();
+		utils::AppendWideString(name, wcsName);
+		if (options.simplifyNames)
+			CBIGFile::ApplySimplifiedCharset(name);
+
+		if (!bigFile.RemoveFileByName(name.c_str()))
+		{
+			std::wcout << "Error: '" << wcsName << "' is not in BIG file" << std::endl;
+			return false;
+		}
+	}
+
+	if (!bigFile.WriteOutPendingFileChanges())
+	{
+		std::wcout << "Error: '" << options.wcsDst << "' write out failed" << std::endl;
+		return false;
+	}
+
+	std::cout << "Files: " << bigFile.GetFileCount() << ", renamed " << options.wcsRenameNames.size() / 2 << ", removed " << options.wcsRemoveNames.size() << std::endl;
+	std::cout << "Bytes unused: " << unusedSizeBefore << " -> " << bigFile.GetUnusedSizeOnDisk() << std::endl;
+	return true;
+}
+
+bool ServeArchives(const wchar_t* wcsSocketPath, uint64 cacheSize)
+{
+	if (!CArchiveServer::IsSupported())
+	{
+		std::cout << "Error: " COMMANDLINE_ARG_SERVE " is not supported on this platform" << std::endl;
+		return false;
+	}
+
+	CArchiveServer archiveServer;
+	if (!archiveServer.Start(wcsSocketPath, cacheSize))
+	{
+		std::wcout << "Error: '" << wcsSocketPath << "' cannot be listened on" << std::endl;
+		return false;
+	}
+
+	std::wcout << "Serving on '" << wcsSocketPath << "'" << std::endl;
+	return archiveServer.Run();
+}
+
+bool ReplayAccessTrace(const SOptions& options)
+{
+	// Simulates the reads of a recorded access trace on a .big file and measures
+	// how far a disk head would need to travel between consecutive file reads.
+	CLayoutPolicy::TStrings names;
+	if (!CLayoutPolicy::ReadAccessTrace(names, options.wcsReplayTrace))
+	{
+		std::wcout << "Error: '" << options.wcsReplayTrace << "' cannot be read" << std::endl;
+		return false;
+	}
+
+	CBIGFile::TFlags bigFlags = CBIGFile::eFlags_Read | CBIGFile::eFlags_UseSimplifiedName | CBIGFile::eFlags_IgnoreDuplicates;
+
+	CBIGFile bigFile;
+	if (!bigFile.OpenFile(options.wcsSrc, bigFlags))
+	{
+		std::wcout << "Error: '" << options.wcsSrc << "' cannot be opened" << std::endl;
+		return false;
+	}
+
+	const uint32 fileCount = bigFile.GetFileCount();
+	uint64 position = 0;
+	uint64 readBytes = 0;
+	uint64 seekDistance = 0;
+	uint32 seekCount = 0;
+	uint32 readCount = 0;
+	const uint32 nameCount = static_cast<uint32>(names.size());
+
+	for (uint32 nameIndex = 0; nameIndex < nameCount; ++nameIndex)
+	{
+		const uint32 fileId = bigFile.FindFileIdByName(names[nameIndex].c_str());
+		if (fileId == fileCount)
+			continue;
+
+		const uint64 offset = bigFile.GetFileOffsetById(fileId);
+		const uint64 size = bigFile.GetFileSizeById(fileId);
+
+		if (offset != position)
+		{
+			seekDistance += (offset > position) ? (offset - position) : (position - offset);
+			++seekCount;
+		}
+
+		position = offset + size;
+		readBytes += size;
+		++readCount;
+	}
+
+	std::cout << "Trace entries:  " << nameCount << std::endl;
+	std::cout << "Files read:     " << readCount << std::endl;
+	std::cout << "Bytes read:     " << readBytes << std::endl;
+	std::cout << "Seeks:          " << seekCount << std::endl;
+	std::cout << "Seek distance:  " << seekDistance << std::endl;
+
+	return true;
+}
+
+bool ParseOptions(SOptions& options, const CommandLineRAII& commandline)
+{
+	options.simplifyNames = commandline.HasArg(W(COMMANDLINE_ARG_SIMPLIFYNAMES));
+	options.ignoreDuplicates = commandline.HasArg(W(COMMANDLINE_ARG_IGNOREDUPLICATES));
+	options.update = commandline.HasArg(W(COMMANDLINE_ARG_UPDATE));
+	options.append = commandline.HasArg(W(COMMANDLINE_ARG_APPEND)) || options.update;
+	options.wcsSrc = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCE));
+	options.wcsDst = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DEST));
+	options.wcsCompact = commandline.FindArgAssignment(W(COMMANDLINE_ARG_COMPACT));
+	const wchar_t* wcsPrefixNames = commandline.FindArgAssignment(W(COMMANDLINE_ARG_PREFIXNAMES));
+	const wchar_t* wcsMaxDepth = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCEMAXDEPTH));
+
+	for (int argIndex = commandline.FindArg(W(COMMANDLINE_ARG_FILTER)); argIndex >= 0 && argIndex < commandline.GetArgCount() - 1;
+		argIndex = commandline.FindArg(W(COMMANDLINE_ARG_FILTER), argIndex + 2))
+	{
+		options.wcsFilters.push_back(commandline.GetArgElement(argIndex + 1));
+	}
+
+	for (int argIndex = commandline.FindArg(W(COMMANDLINE_ARG_REMOVE)); argIndex >= 0 && argIndex < commandline.GetArgCount() - 1;
+		argIndex = commandline.FindArg(W(COMMANDLINE_ARG_REMOVE), argIndex + 2))
+	{
+		options.wcsRemoveNames.push_back(commandline.GetArgElement(argIndex + 1));
+	}
+
+	for (int argIndex = commandline.FindArg(W(COMMANDLINE_ARG_RENAME)); argIndex >= 0 && argIndex < commandline.GetArgCount() - 2;
+		argIndex = commandline.FindArg(W(COMMANDLINE_ARG_RENAME), argIndex + 3))
+	{
+		options.wcsRenameNames.push_back(commandline.GetArgElement(argIndex + 1));
+		options.wcsRenameNames.push_back(commandline.GetArgElement(argIndex + 2));
+	}
+
+	// Archives to merge follow the argument up to the next argument
+	const int mergeArgIndex = commandline.FindArg(W(COMMANDLINE_ARG_MERGE));
+	for (int argIndex = mergeArgIndex + 1; mergeArgIndex >= 0 && argIndex < commandline.GetArgCount(); ++argIndex)
+	{
+		const wchar_t* wcsArg = commandline.GetArgElement(argIndex);
+		if (wcsArg[0] == L'-')
+			break;
+		options.wcsMergeSources.push_back(wcsArg);
+	}
+
+	const wchar_t* wcsWildcard = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SOURCEWILDCARD));
+	const wchar_t* wcsLayoutOrder = commandline.FindArgAssignment(W(COMMANDLINE_ARG_LAYOUTORDER));
+	options.wcsLayoutTrace = commandline.FindArgAssignment(W(COMMANDLINE_ARG_LAYOUTTRACE));
+	options.wcsReplayTrace = commandline.FindArgAssignment(W(COMMANDLINE_ARG_REPLAYTRACE));
+	const wchar_t* wcsAlign = commandline.FindArgAssignment(W(COMMANDLINE_ARG_ALIGN));
+	const wchar_t* wcsAlignMinSize = commandline.FindArgAssignment(W(COMMANDLINE_ARG_ALIGNMINSIZE));
+	const wchar_t* wcsHeaderReserve = commandline.FindArgAssignment(W(COMMANDLINE_ARG_HEADERRESERVE));
+	const wchar_t* wcsDurability = commandline.FindArgAssignment(W(COMMANDLINE_ARG_DURABILITY));
+	const wchar_t* wcsSyncBatch = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SYNCBATCH));
+	const wchar_t* wcsWriteBuffer = commandline.FindArgAssignment(W(COMMANDLINE_ARG_WRITEBUFFER));
+	const wchar_t* wcsFlushMemory = commandline.FindArgAssignment(W(COMMANDLINE_ARG_FLUSHMEMORY));
+	const wchar_t* wcsStreamFormat = commandline.FindArgAssignment(W(COMMANDLINE_ARG_STREAMFORMAT));
+	const wchar_t* wcsCompactThreshold = commandline.FindArgAssignment(W(COMMANDLINE_ARG_COMPACTTHRESHOLD));
+
+	// TODO: Add error codes and messages.
+
+	if (wcsPrefixNames)
+	{
+		utils::AppendWideString(options.prefix, wcsPrefixNames);
+	}
+
+	if (wcsMaxDepth)
+	{
+		options.maxDepth = static_cast<uint32>(::_wtoi(wcsMaxDepth));
+	}
+
+	if (wcsWildcard)
+	{
+		options.wcsWildcard = wcsWildcard;
+	}
+
+	if (wcsLayoutOrder)
+	{
+		std::string layoutOrder;
+		utils::AppendWideString(layoutOrder, wcsLayoutOrder);
+		if (!CLayoutPolicy::ParseOrder(options.layoutOrder, layoutOrder.c_str()))
+		{
+			std::wcout << "Error: '" << wcsLayoutOrder << "' is no valid layout order" << std::endl;
+			return false;
+		}
+	}
+
+	if (wcsAlign)
+	{
+		options.alignment = static_cast<uint32>(::_wtoi(wcsAlign));
+		options.minAlignedSize = options.alignment;
+
+		if (options.alignment & (options.alignment - 1))
+		{
+			std::wcout << "Error: '" << wcsAlign << "' is no power of 2" << std::endl;
+			return false;
+		}
+	}
+
+	if (wcsAlignMinSize)
+	{
+		options.minAlignedSize = static_cast<uint32>(::_wtoi(wcsAlignMinSize));
+	}
+
+	if (wcsHeaderReserve)
+	{
+		const int headerReserve = ::_wtoi(wcsHeaderReserve);
+		if (headerReserve < 0)
+		{
+			std::wcout << "Error: '" << wcsHeaderReserve << "' is no valid reserve size" << std::endl;
+			return false;
+		}
+		options.headerReserve = static_cast<uint32>(headerReserve);
+		options.hasHeaderReserve = true;
+	}
+
+	if (wcsDurability && !filesystem::ParseDurability(options.durability, wcsDurability))
+	{
+		std::wcout << "Error: '" << wcsDurability << "' is no valid durability" << std::endl;
+		return false;
+	}
+
+	if (wcsSyncBatch)
+	{
+		const int syncBatchMegabytes = ::_wtoi(wcsSyncBatch);
+		if (syncBatchMegabytes <= 0)
+		{
+			std::wcout << "Error: '" << wcsSyncBatch << "' is no valid batch size" << std::endl;
+			return false;
+		}
+		options.syncBatchBytes = static_cast<uint64>(syncBatchMegabytes) * 1024u * 1024u;
+	}
+
+	if (wcsStreamFormat && !CEntryStreamWriter::ParseFormat(options.streamFormat, wcsStreamFormat))
+	{
+		std::wcout << "Error: '" << wcsStreamFormat << "' is no valid stream format" << std::endl;
+		return false;
+	}
+
+	if (wcsWriteBuffer)
+	{
+		const int writeBufferMegabytes = ::_wtoi(wcsWriteBuffer);
+		if (writeBufferMegabytes <= 0)
+		{
+			std::wcout << "Error: '" << wcsWriteBuffer << "' is no valid buffer size" << std::endl;
+			return false;
+		}
+		options.writeBufferSize = static_cast<size_t>(writeBufferMegabytes) * 1024u * 1024u;
+	}
+
+	if (wcsFlushMemory)
+	{
+		const int flushMegabytes = ::_wtoi(wcsFlushMemory);
+		if (flushMegabytes < 0)
+		{
+			std::wcout << "Error: '" << wcsFlushMemory << "' is no valid memory size" << std::endl;
+			return false;
+		}
+		options.flushBytes = static_cast<uint64>(flushMegabytes) * 1024u * 1024u;
+	}
+
+	if (wcsCompactThreshold)
+	{
+		const int compactionThreshold = ::_wtoi(wcsCompactThreshold);
+		if (compactionThreshold < 0 || compactionThreshold > 100)
+		{
+			std::wcout << "Error: '" << wcsCompactThreshold << "' is no valid percentage" << std::endl;
+			return false;
+		}
+		options.compactionThreshold = static_cast<uint32>(compactionThreshold);
+	}
+
+	if (options.layoutOrder == CLayoutPolicy::eOrder_Trace && !options.wcsLayoutTrace)
+	{
+		std::cout << "Error: missing argument for " COMMANDLINE_ARG_LAYOUTTRACE << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool CheckCreateOptions(const SOptions& options)
+{
+	if (!IsStandardStream(options.wcsSrc) && !fileaccess::FileExists(options.wcsSrc))
+	{
+		std::wcout << "Error: '" << options.wcsSrc << "' is no valid path" << std::endl;
+		return false;
+	}
+
+	if (options.append && !fileaccess::FileExists(options.wcsDst))
+	{
+		std::wcout << "Error: '" << options.wcsDst << "' is no valid file" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// One line of a job file, which holds the arguments of one BIG file creation
+struct SJob : public _reference_target_t
+{
+	explicit SJob(const wchar_t* wcsCommandLine)
+		: commandline(wcsCommandLine)
+		, options()
+		, log()
+		, success(false)
+	{}
+
+	CommandLineRAII commandline;
+	SOptions options;
+	std::ostringstream log;
+	bool success;
+};
+
+typedef _smart_ptr<SJob> TJobPtr;
+typedef std::vector<TJobPtr> TJobs;
+
+// Jobs that the threads take one after another until none is left
+struct SJobQueue
+{
+	SJobQueue(TJobs& jobs, CMemoryBudget& memoryBudget)
+		: jobs(jobs)
+		, memoryBudget(memoryBudget)
+		, nextJobIndex(0)
+	{}
+
+	TJobs& jobs;
+	CMemoryBudget& memoryBudget;
+	CMutex mutex;
+	size_t nextJobIndex;
+};
+
+void RunQueuedJobs(void* pJobQueue)
+{
+	SJobQueue& jobQueue = *static_cast<SJobQueue*>(pJobQueue);
+
+	for (;;)
+	{
+		SJob* pJob = NULL;
+		{
+			CScopedLock lock(jobQueue.mutex);
+			if (jobQueue.nextJobIndex < jobQueue.jobs.size())
+				pJob = jobQueue.jobs[jobQueue.nextJobIndex++];
+		}
+
+		if (!pJob)
+			break;
+
+		pJob->success = CreateBigFile(pJob->options, pJob->log, &jobQueue.memoryBudget);
+
+		// Each log is printed at once, so that lines of concurrent jobs do not mix
+		CScopedLock lock(jobQueue.mutex);
+		std::cout << "Job '" << NarrowPath(pJob->options.wcsDst) << "'" << std::endl;
+		std::cout << pJob->log.str();
+		if (!pJob->success)
+		{
+			std::cout << "Error: job '" << NarrowPath(pJob->options.wcsDst) << "' failed" << std::endl;
+		}
+		std::cout.flush();
+	}
+}
+
+bool ReadJobFile(TJobs& jobs, const wchar_t* wcsJobFile)
+{
+	// One job per line with the arguments of one creation. Empty lines and lines starting with # are skipped.
+	CBIGFile::TData jobFileData;
+	if (fileaccess::ReadDataFromFile(wcsJobFile, jobFileData) != fileaccess::eError_Success)
+	{
+		std::wcout << "Error: '" << wcsJobFile << "' cannot be read" << std::endl;
+		return false;
+	}
+
+	const std::string jobFile(jobFileData.data(), jobFileData.size());
+	std::wstring commandLine;
+	size_t lineBegin = 0;
+	uint32 lineNumber = 0;
+
+	while (lineBegin < jobFile.size())
+	{
+		size_t lineEnd = jobFile.find('\n', lineBegin);
+		if (lineEnd == std::string::npos)
+			lineEnd = jobFile.size();
+
+		std::string line(jobFile, lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd + 1;
+		++lineNumber;
+
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+
+		const size_t first = line.find_first_not_of(" \t");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+
+		filesystem::FromNativePath(commandLine, line.c_str());
+		TJobPtr job(new SJob(commandLine.c_str()));
+		const SOptions& options = job->options;
+
+		if (!ParseOptions(job->options, job->commandline))
+		{
+			std::wcout << "Error: line " << lineNumber << " of '" << wcsJobFile << "' has invalid arguments" << std::endl;
+			return false;
+		}
+
+		if (!options.wcsSrc || !options.wcsDst || IsStandardStream(options.wcsSrc)
+			|| CBIGFile::HasBigFileExtension(options.wcsSrc) || !CBIGFile::HasBigFileExtension(options.wcsDst))
+		{
+			std::wcout << "Error: line " << lineNumber << " of '" << wcsJobFile << "' is no creation job from a path" << std::endl;
+			return false;
+		}
+
+		if (!CheckCreateOptions(options))
+			return false;
+
+		for (size_t jobIndex = 0; jobIndex < jobs.size(); ++jobIndex)
+		{
+			if (filesystem::ComparePaths(jobs[jobIndex]->options.wcsDst, options.wcsDst) == 0)
+			{
+				std::wcout << "Error: '" << options.wcsDst << "' is created by more than one job" << std::endl;
+				return false;
+			}
+		}
+
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+bool RunJobFile(const wchar_t* wcsJobFile, uint32 threadCount, uint64 memoryLimit)
+{
+	TJobs jobs;
+	if (!ReadJobFile(jobs, wcsJobFile))
+		return false;
+
+	if (jobs.empty())
+	{
+		std::wcout << "Error: '" << wcsJobFile << "' has no jobs" << std::endl;
+		return false;
+	}
+
+	// The buffer pool is created here, before threads race to create it
+	CBufferPool::GetInstance();
+
+	CMemoryBudget memoryBudget(memoryLimit);
+	SJobQueue jobQueue(jobs, memoryBudget);
+
+	// The calling thread is one of the threads that run jobs
+	threadCount = std::min(threadCount, static_cast<uint32>(jobs.size()));
+	CThread* threads = new CThread[threadCount - 1];
+	for (uint32 threadIndex = 0; threadIndex < threadCount - 1; ++threadIndex)
+	{
+		if (!threads[threadIndex].Start(&RunQueuedJobs, &jobQueue))
+			break;
+	}
+	RunQueuedJobs(&jobQueue);
+	delete[] threads;
+
+	uint32 failedJobCount = 0;
+	for (size_t jobIndex = 0; jobIndex < jobs.size(); ++jobIndex)
+	{
+		failedJobCount += jobs[jobIndex]->success ? 0 : 1;
+	}
+
+	std::cout << "Jobs: " << jobs.size() << " run, " << failedJobCount << " failed" << std::endl;
+	return failedJobCount == 0;
+}
+
+int ReportResult(bool success)
+{
+	if (success)
+	{
+		std::cout << "Operation completed" << std::endl;
+		return NoError;
+	}
+	else
+	{
+		std::cout << "Error: operation failed" << std::endl;
+		return Error;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineRAII::SetProcessArgs(argc, argv);
+	CommandLineRAII commandline;
+	bool help = commandline.HasArg(W(COMMANDLINE_ARG_HELP));
+
+	// Standard output is reserved for file data when extracting to it
+	const bool dataToStandardOutput = IsStandardStream(commandline.FindArgAssignment(W(COMMANDLINE_ARG_DEST)));
+	CLogToStandardError logToStandardError(dataToStandardOutput);
+
+	Welcome();
+
+	stats::Enable(commandline.HasArg(W(COMMANDLINE_ARG_STATS)));
+	stats::CPrintOnExit statsPrintOnExit(std::cout);
+
+	const wchar_t* wcsTrace = commandline.FindArgAssignment(W(COMMANDLINE_ARG_TRACE));
+	trace::Start(wcsTrace);
+	trace::CWriteOutOnExit traceWriteOutOnExit;
+
+	const wchar_t* wcsServe = commandline.FindArgAssignment(W(COMMANDLINE_ARG_SERVE));
+	if (wcsServe && !help)
+	{
+		uint64 cacheSize = CArchiveServer::DefaultCacheSize;
+		if (const wchar_t* wcsCacheSize = commandline.FindArgAssignment(W(COMMANDLINE_ARG_CACHESIZE)))
+		{
+			const int cacheMegabytes = ::_wtoi(wcsCacheSize);
+			if (cacheMegabytes <= 0)
+			{
+				std::wcout << "Error: '" << wcsCacheSize << "' is no valid cache size" << std::endl;
+				return Error;
+			}
+			cacheSize = static_cast<uint64>(cacheMegabytes) * 1024u * 1024u;
+		}
+		return ServeArchives(wcsServe, cacheSize) ? NoError : Error;
+	}
+
+	const wchar_t* wcsJobs = commandline.FindArgAssignment(W(COMMANDLINE_ARG_JOBS));
+	if (wcsJobs && !help)
+	{
+		uint32 threadCount = CThread::GetProcessorCount();
+		if (const wchar_t* wcsThreads = commandline.FindArgAssignment(W(COMMANDLINE_ARG_THREADS)))
+		{
+			const int threads = ::_wtoi(wcsThreads);
+			if (threads <= 0)
+			{
+				std::wcout << "Error: '" << wcsThreads << "' is no valid thread count" << std::endl;
+				return Error;
+			}
+			threadCount = static_cast<uint32>(threads);
+		}
+
+		uint64 memoryLimit = CMemoryBudget::DefaultLimit;
+		if (const wchar_t* wcsJobMemory = commandline.FindArgAssignment(W(COMMANDLINE_ARG_JOBMEMORY)))
+		{
+			const int jobMemoryMegabytes = ::_wtoi(wcsJobMemory);
+			if (jobMemoryMegabytes <= 0)
+			{
+				std::wcout << "Error: '" << wcsJobMemory << "' is no valid memory size" << std::endl;
+				return Error;
+			}
+			memoryLimit = static_cast<uint64>(jobMemoryMegabytes) * 1024u * 1024u;
+		}
+
+		return ReportResult(RunJobFile(wcsJobs, threadCount, memoryLimit));
+	}
+
+	SOptions options;
+	const bool validOptions = ParseOptions(options, commandline);
+
+	const bool mergeBigFiles = !options.wcsMergeSources.empty();
+	const bool compactBigFile = options.wcsCompact != NULL;
+	const bool editBigFile = !options.wcsRemoveNames.empty() || !options.wcsRenameNames.empty();
+
+	if ((!options.wcsSrc && !mergeBigFiles && !compactBigFile && !editBigFile) || (!options.wcsDst && !options.wcsReplayTrace && !compactBigFile))
+	{
+		help = true;
+	}
+
+	if (help)
+	{
+		std::cout
+		<< "h: " << "ARGUMENT"              "          [TYPE1|TYPE2 {default}]"                                                             << std::endl
+		<< "   " << COMMANDLINE_ARG_SOURCE "           [PATH|FILE.big {}] -> Specifies path to create BIG from or BIG file to extract from" << std::endl
+		<< "   " << COMMANDLINE_ARG_SOURCE "           [- {}]             -> Create from tar stream or file list with PATH[<tab>NAME] lines on standard input" << std::endl
+		<< "   " << COMMANDLINE_ARG_SOURCEMAXDEPTH "   [NUMBER {999}]     -> Max folder depth to use files from"                            << std::endl
+		<< "   " << COMMANDLINE_ARG_SOURCEWILDCARD "   [STRING {*.*}]     -> Filter for file name or extension"                             << std::endl
+		<< "   " << COMMANDLINE_ARG_DEST "             [PATH|FILE.big {}] -> Specifies path to extract to or BIG file to create to"         << std::endl
+		<< "   " << COMMANDLINE_ARG_DEST "             [- {}]             -> Extract to standard output, log goes to standard error"       << std::endl
+		<< "   " << COMMANDLINE_ARG_STREAMFORMAT "     [frame|tar {frame}] -> Format of standard output, frame is name and data with sizes" << std::endl
+		<< "   " << COMMANDLINE_ARG_FILTER "           [STRING {}]        -> Extract files matching glob, can repeat, ** spans folders"    << std::endl
+		<< "   " << COMMANDLINE_ARG_SIMPLIFYNAMES "    [{}]               -> Simplify file names in BIG file"                               << std::endl
+		<< "   " << COMMANDLINE_ARG_IGNOREDUPLICATES " [{}]               -> Ignore file duplicates in BIG file"                            << std::endl
+		<< "   " << COMMANDLINE_ARG_PREFIXNAMES "      [STRING {}]        -> Prefix file names in created BIG file"                         << std::endl
+		<< "   " << COMMANDLINE_ARG_APPEND "           [{}]               -> Append to existing BIG file instead of creating new one"       << std::endl
+		<< "   " << COMMANDLINE_ARG_UPDATE "           [{}]               -> Append to existing BIG file and overwrite files of same name, in place if they fit with " COMMANDLINE_ARG_DURABILITY " none" << std::endl
+		<< "   " << COMMANDLINE_ARG_MERGE "            [FILE.big ... {}]  -> Merge BIG files into BIG file of " COMMANDLINE_ARG_DEST ", later files replace same names" << std::endl
+		<< "   " << COMMANDLINE_ARG_COMPACT "          [FILE.big {}]      -> Rewrite BIG file without shadowed duplicates and gaps, to " COMMANDLINE_ARG_DEST " if given" << std::endl
+		<< "   " << COMMANDLINE_ARG_REMOVE "           [NAME {}]          -> Remove file from BIG file of " COMMANDLINE_ARG_DEST ", can repeat" << std::endl
+		<< "   " << COMMANDLINE_ARG_RENAME "           [NAME NAME {}]     -> Rename file in BIG file of " COMMANDLINE_ARG_DEST ", can repeat" << std::endl
+		<< "   " << COMMANDLINE_ARG_COMPACTTHRESHOLD " [NUMBER {25}]      -> Percent of BIG file left unused by removals and changes before it is rewritten" << std::endl
+		<< "   " << COMMANDLINE_ARG_LAYOUTORDER "      [header|extension|directory|trace {header}] -> Order of file data in created BIG file" << std::endl
+		<< "   " << COMMANDLINE_ARG_LAYOUTTRACE "      [FILE {}]          -> Access trace with one file name per line for trace order"      << std::endl
+		<< "   " << COMMANDLINE_ARG_REPLAYTRACE "      [FILE {}]          -> Measure read distance of access trace on source BIG file"     << std::endl
+		<< "   " << COMMANDLINE_ARG_ALIGN "            [NUMBER {0}]       -> Align file data in created BIG file to power of 2 boundary"    << std::endl
+		<< "   " << COMMANDLINE_ARG_ALIGNMINSIZE "     [NUMBER {ALIGN}]   -> Min file size to align, smaller files are packed unaligned"  << std::endl
+		<< "   " << COMMANDLINE_ARG_HEADERRESERVE "    [NUMBER {0}]       -> Bytes left free after header of BIG file for later renames and appends" << std::endl
+		<< "   " << COMMANDLINE_ARG_DURABILITY "       [none|end|batch {end}] -> Flush created BIG file to disk never, before replace or per batch" << std::endl
+		<< "   " << COMMANDLINE_ARG_SYNCBATCH "        [NUMBER {64}]      -> Megabytes written between flushes with batch durability"     << std::endl
+		<< "   " << COMMANDLINE_ARG_WRITEBUFFER "      [NUMBER {8}]       -> Megabytes buffered before each write to created BIG file"   << std::endl
+		<< "   " << COMMANDLINE_ARG_FLUSHMEMORY "      [NUMBER {0}]       -> Megabytes of file data held before each write out while creating, 0 holds all" << std::endl
+		<< "   " << COMMANDLINE_ARG_SERVE "            [SOCKET {}]        -> Serve files of BIG files to local clients on Unix socket"     << std::endl
+		<< "   " << COMMANDLINE_ARG_CACHESIZE "        [NUMBER {256}]     -> Megabytes of served files kept in memory"                    << std::endl
+		<< "   " << COMMANDLINE_ARG_JOBS "             [FILE {}]          -> Create BIG files of all job file lines at once, a line holds the arguments of one creation" << std::endl
+		<< "   " << COMMANDLINE_ARG_THREADS "          [NUMBER {CPUS}]    -> Threads that run jobs"                                        << std::endl
+		<< "   " << COMMANDLINE_ARG_JOBMEMORY "        [NUMBER {1024}]    -> Megabytes of file data all jobs hold before they write out"   << std::endl
+		<< "   " << COMMANDLINE_ARG_STATS "            [{}]               -> Print time, bytes, file operations and allocations per phase at exit" << std::endl
+		<< "   " << COMMANDLINE_ARG_TRACE "            [FILE {}]          -> Write Chrome trace event timeline of file reads and writes"  << std::endl;
+	}
+
+	if (!validOptions)
+	{
+		return Error;
+	}
+
+	if (mergeBigFiles)
+	{
+		if (!options.wcsDst || !CBIGFile::HasBigFileExtension(options.wcsDst))
+		{
+			std::cout << "Error: " COMMANDLINE_ARG_MERGE " needs a BIG file for " COMMANDLINE_ARG_DEST << std::endl;
+			return Error;
+		}
+
+		for (size_t sourceIndex = 0; sourceIndex < options.wcsMergeSources.size(); ++sourceIndex)
+		{
+			const wchar_t* wcsSource = options.wcsMergeSources[sourceIndex];
+			if (!CBIGFile::HasBigFileExtension(wcsSource) || !fileaccess::FileExists(wcsSource))
+			{
+				std::wcout << "Error: '" << wcsSource << "' is no valid BIG file" << std::endl;
+				return Error;
+			}
+
+			// Merging into a source rewrites it, appending to it would add its own files a second time
+			if (options.append && filesystem::ComparePaths(wcsSource, options.wcsDst) == 0)
+			{
+				std::wcout << "Error: '" << wcsSource << "' cannot be merged and appended to at once" << std::endl;
+				return Error;
+			}
+		}
+
+		return ReportResult(MergeBigFiles(options));
+	}
+
+	if (compactBigFile)
+	{
+		// Compacts in place unless a destination is given
+		if (!options.wcsDst)
+		{
+			options.wcsDst = options.wcsCompact;
+		}
+
+		if (!CBIGFile::HasBigFileExtension(options.wcsCompact) || !fileaccess::FileExists(options.wcsCompact))
+		{
+			std::wcout << "Error: '" << options.wcsCompact << "' is no valid BIG file" << std::endl;
+			return Error;
+		}
+
+		if (!CBIGFile::HasBigFileExtension(options.wcsDst))
+		{
+			std::wcout << "Error: '" << options.wcsDst << "' is no BIG file" << std::endl;
+			return Error;
+		}
+
+		return ReportResult(CompactBigFile(options.wcsCompact, options));
+	}
+
+	if (editBigFile)
+	{
+		// Editing happens instead of creating, files of a source would be left out
+		if (options.wcsSrc)
+		{
+			std::cout << "Error: " COMMANDLINE_ARG_REMOVE " and " COMMANDLINE_ARG_RENAME " cannot be used with " COMMANDLINE_ARG_SOURCE << std::endl;
+			return Error;
+		}
+
+		if (!CBIGFile::HasBigFileExtension(options.wcsDst) || !fileaccess::FileExists(options.wcsDst))
+		{
+			std::wcout << "Error: '" << options.wcsDst << "' is no valid BIG file" << std::endl;
+			return Error;
+		}
+
+		return ReportResult(EditBigFile(options));
+	}
+
+	if (!options.wcsSrc)
+	{
+		std::cout << "Error: missing argument for " COMMANDLINE_ARG_SOURCE << std::endl;
+		return Error;
+	}
+
+	if (options.wcsReplayTrace)
+	{
+		if (!CBIGFile::HasBigFileExtension(options.wcsSrc))
+		{
+			std::wcout << "Error: '" << options.wcsSrc << "' is no BIG file" << std::endl;
+			return Error;
+		}
+		return ReplayAccessTrace(options) ? NoError : Error;
+	}
+
+	if (!options.wcsDst)
+	{
+		std::cout << "Error: missing argument for " COMMANDLINE_ARG_DEST << std::endl;
+		return Error;
+	}
+
+	const bool srcBigFile = CBIGFile::HasBigFileExtension(options.wcsSrc);
+	const bool dstBigFile = CBIGFile::HasBigFileExtension(options.wcsDst);
+	const bool createBigFile = !srcBigFile && dstBigFile;
+	const bool extractBigFile = srcBigFile && !dstBigFile;
+
+	if (!(createBigFile || extractBigFile))
+	{
+		std::cout << "Error: no creation or extraction job" << std::endl;
+		return Error;
+	}
+
+	if (createBigFile && !CheckCreateOptions(options))
+	{
+		return Error;
+	}
+
+	if (IsStandardStream(options.wcsSrc) && !filesystem::SetBinaryMode(stdin))
+	{
+		std::cout << "Error: standard input cannot be used for binary data" << std::endl;
+		return Error;
+	}
+
+	if (dataToStandardOutput && !filesystem::SetBinaryMode(stdout))
+	{
+		std::cout << "Error: standard output cannot be used for binary data" << std::endl;
+		return Error;
+	}
+
+	bool success = false;
+
+	if (extractBigFile)
+	{
+		success = ExtractBigFile(options);
+	}
+
+	if (createBigFile)
+	{
+		success = CreateBigFile(options, std::cout, NULL);
+	}
+
+	return ReportResult(success);
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "platform.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+class CMutex
+{
+public:
+#ifdef _WIN32
+	inline CMutex()
+	{
+		::InitializeCriticalSection(&m_criticalSection);
+	}
+	inline ~CMutex()
+	{
+		::DeleteCriticalSection(&m_criticalSection);
+	}
+	inline void Lock()
+	{
+		::EnterCriticalSection(&m_criticalSection);
+	}
+	inline void Unlock()
+	{
+		::LeaveCriticalSection(&m_criticalSection);
+	}
+#else
+	inline CMutex()
+	{
+		::pthread_mutex_init(&m_mutex, NULL);
+	}
+	inline ~CMutex()
+	{
+		::pthread_mutex_destroy(&m_mutex);
+	}
+	inline void Lock()
+	{
+		::pthread_mutex_lock(&m_mutex);
+	}
+	inline void Unlock()
+	{
+		::pthread_mutex_unlock(&m_mutex);
+	}
+#endif
+private:
+	friend class CConditionVariable;
+
+	CMutex(const CMutex&);
+	CMutex& operator=(const CMutex&);
+
+#ifdef _WIN32
+	CRITICAL_SECTION m_criticalSection;
+#else
+	pthread_mutex_t m_mutex;
+#endif
+};
+
+class CScopedLock
+{
+public:
+	inline explicit CScopedLock(CMutex& mutex)
+		: m_mutex(mutex)
+	{
+		m_mutex.Lock();
+	}
+	inline ~CScopedLock()
+	{
+		m_mutex.Unlock();
+	}
+private:
+	CScopedLock(const CScopedLock&);
+	CScopedLock& operator=(const CScopedLock&);
+
+	CMutex& m_mutex;
+};
+
+// Lets threads sleep until a state that a mutex guards changes
+class CConditionVariable
+{
+public:
+#ifdef _WIN32
+	inline CConditionVariable()
+	{
+		::InitializeConditionVariable(&m_conditionVariable);
+	}
+	inline ~CConditionVariable()
+	{
+	}
+	// Mutex must be locked and is locked again on return
+	inline void Wait(CMutex& mutex)
+	{
+		::SleepConditionVariableCS(&m_conditionVariable, &mutex.m_criticalSection, INFINITE);
+	}
+	inline void NotifyAll()
+	{
+		::WakeAllConditionVariable(&m_conditionVariable);
+	}
+#else
+	inline CConditionVariable()
+	{
+		::pthread_cond_init(&m_condition, NULL);
+	}
+	inline ~CConditionVariable()
+	{
+		::pthread_cond_destroy(&m_condition);
+	}
+	// Mutex must be locked and is locked again on return
+	inline void Wait(CMutex& mutex)
+	{
+		::pthread_cond_wait(&m_condition, &mutex.m_mutex);
+	}
+	inline void NotifyAll()
+	{
+		::pthread_cond_broadcast(&m_condition);
+	}
+#endif
+private:
+	CConditionVariable(const CConditionVariable&);
+	CConditionVariable& operator=(const CConditionVariable&);
+
+#ifdef _WIN32
+	CONDITION_VARIABLE m_conditionVariable;
+#else
+	pthread_cond_t m_condition;
+#endif
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -11,3 +13,36 @@
 
 #undef min
 #undef max
+
+#else // POSIX
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <cassert>
+#include "types.h"
+#include "compiler.h"
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+// Runtime functions of the Microsoft CRT that are used throughout the code
+
+inline int _wcsicmp(const wchar_t* left, const wchar_t* right)
+{
+	return ::wcscasecmp(left, right);
+}
+
+inline int _wcsnicmp(const wchar_t* left, const wchar_t* right, size_t count)
+{
+	return ::wcsncasecmp(left, right, count);
+}
+
+inline int _wtoi(const wchar_t* str)
+{
+	return static_cast<int>(::wcstol(str, NULL, 10));
+}
+
+#endif
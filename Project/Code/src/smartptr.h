@@ -137,18 +137,18 @@ public:
 	{
 	}
 
-	void AddRef()
+	void AddRef() const
 	{
 		CHECK_REFCOUNT_CRASH(m_nRefCounter >= 0);
 		++m_nRefCounter;
 	}
 
-	void Release()
+	void Release() const
 	{
 		CHECK_REFCOUNT_CRASH(m_nRefCounter > 0);
 		if (--m_nRefCounter == 0)
 		{
-			delete static_cast<TDerived*>(this);
+			delete static_cast<const TDerived*>(this);
 		}
 		else if (m_nRefCounter < 0)
 		{
@@ -156,12 +156,13 @@ public:
 		}
 	}
 
-	Counter NumRefs()
+	Counter NumRefs() const
 	{
 		return m_nRefCounter;
 	}
 protected:
-	Counter m_nRefCounter;
+	// Counting references does not change the object, so that const objects can be shared
+	mutable Counter m_nRefCounter;
 };
 
 
@@ -178,13 +179,13 @@ public:
 	{
 	}
 
-	void AddRef()
+	void AddRef() const
 	{
 		CHECK_REFCOUNT_CRASH(m_nRefCounter >= 0);
 		++m_nRefCounter;
 	}
 
-	void Release()
+	void Release() const
 	{
 		CHECK_REFCOUNT_CRASH(m_nRefCounter > 0);
 		if (--m_nRefCounter == 0)
@@ -197,12 +198,13 @@ public:
 		}
 	}
 
-	Counter NumRefs()
+	Counter NumRefs() const
 	{
 		return m_nRefCounter;
 	}
 protected:
-	Counter m_nRefCounter;
+	// Counting references does not change the object, so that const objects can be shared
+	mutable Counter m_nRefCounter;
 };
 
 typedef _reference_target<int> _reference_target_t;
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "platform.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Runs a function on a thread of its own. The destructor waits for the thread to end.
+class CThread
+{
+public:
+	typedef void (*TFunction)(void* pContext);
+
+	inline CThread()
+		: m_function(NULL)
+		, m_pContext(NULL)
+		, m_started(false)
+	{
+	}
+	inline ~CThread()
+	{
+		Join();
+	}
+
+	inline bool Start(TFunction function, void* pContext)
+	{
+		assert(!m_started);
+		m_function = function;
+		m_pContext = pContext;
+#ifdef _WIN32
+		m_hThread = ::CreateThread(NULL, 0, &CThread::Run, this, 0, NULL);
+		m_started = (m_hThread != NULL);
+#else
+		m_started = (::pthread_create(&m_thread, NULL, &CThread::Run, this) == 0);
+#endif
+		return m_started;
+	}
+
+	inline void Join()
+	{
+		if (m_started)
+		{
+#ifdef _WIN32
+			::WaitForSingleObject(m_hThread, INFINITE);
+			::CloseHandle(m_hThread);
+#else
+			::pthread_join(m_thread, NULL);
+#endif
+			m_started = false;
+		}
+	}
+
+	// Number of threads that the processors run at the same time
+	static inline uint32 GetProcessorCount()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO systemInfo;
+		::GetSystemInfo(&systemInfo);
+		const long processorCount = static_cast<long>(systemInfo.dwNumberOfProcessors);
+#else
+		const long processorCount = ::sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		return processorCount > 0 ? static_cast<uint32>(processorCount) : 1u;
+	}
+
+private:
+	CThread(const CThread&);
+	CThread& operator=(const CThread&);
+
+#ifdef _WIN32
+	static DWORD WINAPI Run(LPVOID pThread)
+	{
+		CThread* pThis = static_cast<CThread*>(pThread);
+		pThis->m_function(pThis->m_pContext);
+		return 0;
+	}
+
+	HANDLE m_hThread;
+#else
+	static void* Run(void* pThread)
+	{
+		CThread* pThis = static_cast<CThread*>(pThread);
+		pThis->m_function(pThis->m_pContext);
+		return NULL;
+	}
+
+	pthread_t m_thread;
+#endif
+	TFunction m_function;
+	void* m_pContext;
+	bool m_started;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "platform.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+namespace timer
+{
+
+#ifdef _WIN32
+
+inline uint64 GetTicks()
+{
+	LARGE_INTEGER ticks;
+	::QueryPerformanceCounter(&ticks);
+	return static_cast<uint64>(ticks.QuadPart);
+}
+
+inline uint64 GetTicksPerSecond()
+{
+	static uint64 s_ticksPerSecond = 0;
+	if (s_ticksPerSecond == 0)
+	{
+		LARGE_INTEGER frequency;
+		::QueryPerformanceFrequency(&frequency);
+		s_ticksPerSecond = static_cast<uint64>(frequency.QuadPart);
+	}
+	return s_ticksPerSecond;
+}
+
+#else
+
+inline uint64 GetTicks()
+{
+	// Ticks are nanoseconds
+	struct timespec time;
+	::clock_gettime(CLOCK_MONOTONIC, &time);
+	return static_cast<uint64>(time.tv_sec) * 1000000000ull + static_cast<uint64>(time.tv_nsec);
+}
+
+inline uint64 GetTicksPerSecond()
+{
+	return 1000000000ull;
+}
+
+#endif
+
+inline double TicksToSeconds(uint64 ticks)
+{
+	return static_cast<double>(ticks) / static_cast<double>(GetTicksPerSecond());
+}
+
+inline uint64 TicksToMicroseconds(uint64 ticks)
+{
+	const uint64 ticksPerSecond = GetTicksPerSecond();
+	return (ticks / ticksPerSecond) * 1000000ull + ((ticks % ticksPerSecond) * 1000000ull) / ticksPerSecond;
+}
+
+class CTimer
+{
+public:
+	inline CTimer()
+		: m_startTicks(GetTicks())
+	{}
+
+	inline void Restart()
+	{
+		m_startTicks = GetTicks();
+	}
+
+	inline uint64 GetElapsedTicks() const
+	{
+		return GetTicks() - m_startTicks;
+	}
+
+	inline double GetElapsedSeconds() const
+	{
+		return TicksToSeconds(GetElapsedTicks());
+	}
+
+private:
+	uint64 m_startTicks;
+};
+
+}
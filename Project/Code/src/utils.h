@@ -4,6 +4,16 @@
 #include "utildef.h"
 #include <cassert>
 #include <locale>
+#include <string>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define UTILS_SSE2 1
+#else
+#define UTILS_SSE2 0
+#endif
 
 namespace utils
 {
@@ -60,57 +70,121 @@ inline void ClearMemory(SwapType& object)
 	object.swap(emptyObject);
 }
 
-template <typename CharType>
-inline void FillStringWithRandomNumbers(CharType* cstr, size_t count)
+// Converts leading ASCII characters and returns their count.
+// Stops at the first character that needs the locale to be converted.
+inline size_t NarrowAscii(char* str, const wchar_t* wideStr, size_t count)
 {
-	assert(cstr != 0);
-	assert(count != 0);
-	static const CharType numbers[10] = {'0','1','2','3','4','5','6','7','8','9'};
-	while (count != 0)
+	size_t i = 0;
+
+#if UTILS_SSE2
+	// Convert 16 characters per step when all of them are ASCII
+	if (sizeof(wchar_t) == 2)
 	{
-		const int val = ::rand() % ARRAY_SIZE(numbers);
-		cstr[--count] = numbers[val];
+		const __m128i nonAsciiMask = _mm_set1_epi16(static_cast<short>(0xFF80));
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i));
+			const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i + 8));
+			const __m128i nonAscii = _mm_and_si128(_mm_or_si128(v0, v1), nonAsciiMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(nonAscii, _mm_setzero_si128())) != 0xFFFF)
+				break;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(str + i), _mm_packus_epi16(v0, v1));
+		}
 	}
-}
-
-template <typename CharType, size_t Size>
-inline void FillStringWithRandomNumbers(CharType (&cstr)[Size])
-{
-	cstr[Size - 1] = '\0';
-	FillStringWithRandomNumbers(cstr, Size - 1);
-}
+	else if (sizeof(wchar_t) == 4)
+	{
+		const __m128i nonAsciiMask = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i));
+			const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i + 4));
+			const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i + 8));
+			const __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i + 12));
+			const __m128i nonAscii = _mm_and_si128(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3)), nonAsciiMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(nonAscii, _mm_setzero_si128())) != 0xFFFF)
+				break;
+			const __m128i v01 = _mm_packs_epi32(v0, v1);
+			const __m128i v23 = _mm_packs_epi32(v2, v3);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(str + i), _mm_packus_epi16(v01, v23));
+		}
+	}
+#endif
 
-template <typename StringType>
-inline StringType AppendRandomNumbers(const StringType& str, size_t count)
-{
-	StringType newStr;
-	newStr.reserve(str.size() + count);
-	newStr.append(str);
-	newStr.append(count, '0');
-	typename StringType::value_type* numbers = &newStr[0] + str.size();
-	FillStringWithRandomNumbers(numbers, count);
-	return newStr;
+	for (; i < count; ++i)
+	{
+		const uint32 c = static_cast<uint32>(wideStr[i]);
+		if (c > 0x7F)
+			break;
+		str[i] = static_cast<char>(c);
+	}
+	return i;
 }
 
+// Appends wide string converted with the current locale.
+// Returns false and stops at the first character that cannot be converted.
 inline bool AppendWideString(std::string& str, const wchar_t* wideStr)
 {
-	bool success = true;
-	if (wideStr)
+	if (!wideStr)
+		return true;
+
+	const size_t count = ::wcslen(wideStr);
+	if (count == 0)
+		return true;
+
+	const size_t offset = str.size();
+	str.resize(offset + count);
+	char* narrowStr = &str[offset];
+
+	size_t i = NarrowAscii(narrowStr, wideStr, count);
+
+	if (i < count)
 	{
+		// Only non ASCII names pay for the locale
 		const std::locale locale = std::locale();
-		while (*wideStr)
+		const std::ctype<wchar_t>& facet = std::use_facet<std::ctype<wchar_t> >(locale);
+
+		for (; i < count; ++i)
 		{
-			char c = std::use_facet<std::ctype<wchar_t>>(locale).narrow(*wideStr, '\0');
+			const char c = facet.narrow(wideStr[i], '\0');
 			if (c == '\0')
 			{
-				success = false;
-				break;
+				str.resize(offset + i);
+				return false;
 			}
-			str.push_back(c);
-			wideStr++;
+			narrowStr[i] = c;
+		}
+	}
+	return true;
+}
+
+// Appends narrow string converted with the current locale
+inline void AppendNarrowString(std::wstring& str, const char* narrowStr)
+{
+	if (!narrowStr)
+		return;
+
+	const size_t count = ::strlen(narrowStr);
+	const size_t offset = str.size();
+	str.resize(offset + count);
+	wchar_t* wideStr = count ? &str[offset] : NULL;
+
+	size_t i = 0;
+	while (i < count && static_cast<uint8>(narrowStr[i]) < 0x80)
+	{
+		wideStr[i] = static_cast<wchar_t>(narrowStr[i]);
+		++i;
+	}
+
+	if (i < count)
+	{
+		const std::locale locale = std::locale();
+		const std::ctype<wchar_t>& facet = std::use_facet<std::ctype<wchar_t> >(locale);
+
+		for (; i < count; ++i)
+		{
+			wideStr[i] = facet.widen(narrowStr[i]);
 		}
 	}
-	return success;
 }
 
 }